@@ -0,0 +1,450 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "clock.h"
+#include "state_delta.h"
+#include <clog/console.h>
+#include <math.h>
+#include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+clog_config g_clog;
+
+char g_clog_temp_str[CLOG_TEMP_STR_SIZE];
+
+#define NL_BENCH_MAX_SAMPLES (256)
+#define NL_BENCH_MAX_PLAYERS (16)
+#define NL_BENCH_MAX_ROLLBACK_TICKS (64)
+
+typedef enum NlBenchFormat {
+    NlBenchFormatJson,
+    NlBenchFormatCsv,
+} NlBenchFormat;
+
+typedef struct NlBenchOptions {
+    NlBenchFormat format;
+    size_t sampleCount;
+    size_t warmupSampleCount;
+    NlClockMicros minSampleDuration;
+    size_t maxPlayerCount;
+    size_t maxTicksFromAuthoritative;
+} NlBenchOptions;
+
+/// Nanoseconds per iteration for all samples of a single benchmark
+typedef struct NlBenchResult {
+    const char* name;
+    const char* parameterName;
+    size_t parameter;
+    size_t iterationsPerSample;
+    size_t sampleCount;
+    double medianNs;
+    double meanNs;
+    double stddevNs;
+    double ci95Ns;
+    double minNs;
+    double maxNs;
+} NlBenchResult;
+
+typedef void (*NlBenchPrepareFn)(void* context);
+typedef void (*NlBenchRunFn)(void* context, size_t iterationCount);
+
+/// All benchmarks work on the same simulation and a set of pre-generated inputs
+typedef struct NlBenchContext {
+    NlSimulationVm vm;
+    NlGame startGame;
+    NlGame copyTarget;
+    uint8_t serializedGame[sizeof(NlGame)];
+    NlGame defaultGame;
+    NlGame decodedGame;
+    uint8_t stateDelta[sizeof(NlGame)];
+    size_t playerCount;
+    size_t rollbackTickCount;
+    size_t inputIndex;
+    NlPlayerInput playerInputs[NL_BENCH_MAX_ROLLBACK_TICKS][NL_BENCH_MAX_PLAYERS];
+    TransmuteParticipantInput participantInputs[NL_BENCH_MAX_ROLLBACK_TICKS][NL_BENCH_MAX_PLAYERS];
+    TransmuteInput inputs[NL_BENCH_MAX_ROLLBACK_TICKS];
+} NlBenchContext;
+
+static void printUsage(void)
+{
+    fprintf(stderr, "usage: nimble-ball-bench [--format json|csv] [--samples <count>] [--warmup <count>] "
+                    "[--sample-ms <ms>] [--max-players <count>] [--max-ticks-from-authoritative <count>]\n");
+}
+
+static int parseOptions(NlBenchOptions* options, int argc, char* argv[])
+{
+    options->format = NlBenchFormatJson;
+    options->sampleCount = 30U;
+    options->warmupSampleCount = 3U;
+    options->minSampleDuration = 2000U;
+    options->maxPlayerCount = 8U;
+    options->maxTicksFromAuthoritative = 10U;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* name = argv[i];
+        if (i + 1 >= argc) {
+            return -1;
+        }
+        const char* value = argv[++i];
+        long intValue = strtol(value, 0, 10);
+
+        if (strcmp(name, "--format") == 0) {
+            if (strcmp(value, "json") == 0) {
+                options->format = NlBenchFormatJson;
+            } else if (strcmp(value, "csv") == 0) {
+                options->format = NlBenchFormatCsv;
+            } else {
+                return -2;
+            }
+        } else if (strcmp(name, "--warmup") == 0 && intValue >= 0) {
+            options->warmupSampleCount = (size_t) intValue;
+        } else if (intValue <= 0) {
+            return -3;
+        } else if (strcmp(name, "--samples") == 0 && intValue <= NL_BENCH_MAX_SAMPLES) {
+            options->sampleCount = (size_t) intValue;
+        } else if (strcmp(name, "--sample-ms") == 0) {
+            options->minSampleDuration = (NlClockMicros) intValue * 1000U;
+        } else if (strcmp(name, "--max-players") == 0 && intValue <= NL_BENCH_MAX_PLAYERS) {
+            options->maxPlayerCount = (size_t) intValue;
+        } else if (strcmp(name, "--max-ticks-from-authoritative") == 0 && intValue <= NL_BENCH_MAX_ROLLBACK_TICKS) {
+            options->maxTicksFromAuthoritative = (size_t) intValue;
+        } else {
+            return -4;
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t nextRandom(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/// Generates deterministic random in-game input for every player and tick, so every run simulates the same thing
+/// @param self context
+/// @param playerCount number of participants in each input
+static void generateInputs(NlBenchContext* self, size_t playerCount)
+{
+    uint32_t random = 0x5eedU;
+
+    for (size_t tick = 0U; tick < NL_BENCH_MAX_ROLLBACK_TICKS; ++tick) {
+        for (size_t player = 0U; player < playerCount; ++player) {
+            uint32_t value = nextRandom(&random);
+            NlPlayerInput* playerInput = &self->playerInputs[tick][player];
+            playerInput->inputType = NlPlayerInputTypeInGame;
+            playerInput->input.inGameInput.horizontalAxis = (int8_t) ((int) (value % 201U) - 100);
+            playerInput->input.inGameInput.verticalAxis = (int8_t) ((int) ((value >> 8U) % 201U) - 100);
+            playerInput->input.inGameInput.buttons = (uint8_t) ((value >> 16U) & 0x03U);
+
+            TransmuteParticipantInput* participantInput = &self->participantInputs[tick][player];
+            participantInput->participantId = (uint8_t) (player + 1U);
+            participantInput->inputType = TransmuteParticipantInputTypeNormal;
+            participantInput->input = playerInput;
+            participantInput->octetSize = sizeof(NlPlayerInput);
+        }
+        self->inputs[tick].participantInputs = self->participantInputs[tick];
+        self->inputs[tick].participantCount = playerCount;
+    }
+}
+
+/// Starts a fresh game and lets all players join and select team, so the benchmarks measure a game in progress
+/// @param self context
+/// @param playerCount number of players
+static void setupGame(NlBenchContext* self, size_t playerCount)
+{
+    Clog vmLog;
+    vmLog.constantPrefix = "BenchVm";
+    vmLog.config = &g_clog;
+    nlSimulationVmInit(&self->vm, vmLog);
+
+    self->playerCount = playerCount;
+    self->inputIndex = 0U;
+
+    NlPlayerInput selectTeamInputs[NL_BENCH_MAX_PLAYERS];
+    TransmuteParticipantInput selectTeamParticipantInputs[NL_BENCH_MAX_PLAYERS];
+    for (size_t player = 0U; player < playerCount; ++player) {
+        NlPlayerInput* playerInput = &selectTeamInputs[player];
+        playerInput->inputType = NlPlayerInputTypeSelectTeam;
+        playerInput->input.selectTeam.preferredTeamToJoin = (uint8_t) (player % 2U);
+        tc_snprintf(playerInput->input.selectTeam.playerName, 32, "bench %zu", player);
+
+        TransmuteParticipantInput* participantInput = &selectTeamParticipantInputs[player];
+        participantInput->participantId = (uint8_t) (player + 1U);
+        participantInput->inputType = TransmuteParticipantInputTypeNormal;
+        participantInput->input = playerInput;
+        participantInput->octetSize = sizeof(NlPlayerInput);
+    }
+
+    TransmuteInput selectTeamInput;
+    selectTeamInput.participantInputs = selectTeamParticipantInputs;
+    selectTeamInput.participantCount = playerCount;
+
+    for (size_t i = 0U; i < 10U; ++i) {
+        transmuteVmTick(&self->vm.transmuteVm, &selectTeamInput);
+    }
+
+    generateInputs(self, playerCount);
+
+    // Move the players and the ball away from the kickoff positions
+    for (size_t i = 0U; i < 120U; ++i) {
+        transmuteVmTick(&self->vm.transmuteVm, &self->inputs[i % NL_BENCH_MAX_ROLLBACK_TICKS]);
+    }
+
+    self->startGame = self->vm.game;
+}
+
+static void restoreStartGame(void* _self)
+{
+    NlBenchContext* self = (NlBenchContext*) _self;
+    TransmuteState state;
+    state.state = &self->startGame;
+    state.octetSize = sizeof(NlGame);
+    transmuteVmSetState(&self->vm.transmuteVm, &state);
+    self->inputIndex = 0U;
+}
+
+static void runTicks(void* _self, size_t iterationCount)
+{
+    NlBenchContext* self = (NlBenchContext*) _self;
+    for (size_t i = 0U; i < iterationCount; ++i) {
+        transmuteVmTick(&self->vm.transmuteVm, &self->inputs[self->inputIndex]);
+        self->inputIndex = (self->inputIndex + 1U) % NL_BENCH_MAX_ROLLBACK_TICKS;
+    }
+}
+
+/// Does the same work as the engine client when a new authoritative state arrives:
+/// resets the predicted simulation to the authoritative state and re-applies the predicted inputs
+static void runRollback(void* _self, size_t iterationCount)
+{
+    NlBenchContext* self = (NlBenchContext*) _self;
+    TransmuteState authoritativeState;
+    authoritativeState.state = &self->startGame;
+    authoritativeState.octetSize = sizeof(NlGame);
+
+    for (size_t i = 0U; i < iterationCount; ++i) {
+        transmuteVmSetState(&self->vm.transmuteVm, &authoritativeState);
+        for (size_t tick = 0U; tick < self->rollbackTickCount; ++tick) {
+            transmuteVmTick(&self->vm.transmuteVm, &self->inputs[tick]);
+        }
+    }
+}
+
+static void runGameCopy(void* _self, size_t iterationCount)
+{
+    NlBenchContext* self = (NlBenchContext*) _self;
+    volatile NlGame* target = &self->copyTarget;
+    for (size_t i = 0U; i < iterationCount; ++i) {
+        tc_memcpy_octets((void*) target, &self->vm.game, sizeof(NlGame));
+    }
+}
+
+/// The game state is sent as is on the wire, so serializing is getting the state from the simulation and
+/// copying it into an octet buffer. Deserializing is setting it back.
+static void runGameSerialize(void* _self, size_t iterationCount)
+{
+    NlBenchContext* self = (NlBenchContext*) _self;
+    for (size_t i = 0U; i < iterationCount; ++i) {
+        TransmuteState state = transmuteVmGetState(&self->vm.transmuteVm);
+        tc_memcpy_octets(self->serializedGame, state.state, state.octetSize);
+
+        TransmuteState deserialized;
+        deserialized.state = self->serializedGame;
+        deserialized.octetSize = state.octetSize;
+        transmuteVmSetState(&self->vm.transmuteVm, &deserialized);
+    }
+}
+
+/// Encodes the game as a delta against the default game and decodes it again
+/// @return the encoded octet count
+static size_t encodeAndDecodeStateDelta(NlBenchContext* self)
+{
+    int deltaOctetCount = nlStateDeltaEncode((const uint8_t*) &self->defaultGame, (const uint8_t*) &self->vm.game,
+                                             sizeof(NlGame), self->stateDelta, sizeof(self->stateDelta));
+    if (deltaOctetCount < 0) {
+        return sizeof(NlGame);
+    }
+    nlStateDeltaDecode((const uint8_t*) &self->defaultGame, self->stateDelta, (size_t) deltaOctetCount,
+                       (uint8_t*) &self->decodedGame, sizeof(NlGame));
+
+    return (size_t) deltaOctetCount;
+}
+
+static void runStateDelta(void* _self, size_t iterationCount)
+{
+    NlBenchContext* self = (NlBenchContext*) _self;
+    for (size_t i = 0U; i < iterationCount; ++i) {
+        encodeAndDecodeStateDelta(self);
+    }
+}
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double lhs = *(const double*) a;
+    double rhs = *(const double*) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/// Finds how many iterations are needed for a single sample to take at least minSampleDuration,
+/// so the clock resolution does not affect the measurement
+static size_t calibrate(NlBenchPrepareFn prepare, NlBenchRunFn run, void* context, NlClockMicros minSampleDuration)
+{
+    size_t iterationCount = 1U;
+    for (;;) {
+        prepare(context);
+        NlClockMicros startedAt = nlClockNowMicros();
+        run(context, iterationCount);
+        NlClockMicros duration = nlClockNowMicros() - startedAt;
+        if (duration >= minSampleDuration || iterationCount >= (1U << 30U)) {
+            return iterationCount;
+        }
+        iterationCount *= duration > 0U && duration * 8U < minSampleDuration ? 8U : 2U;
+    }
+}
+
+/// Runs warmup samples followed by the measured samples and calculates the statistics
+/// @param result result to fill in
+/// @param options sample counts and sample duration
+/// @param prepare called before each sample, not included in the measurement
+/// @param run runs the benchmark the specified number of iterations
+/// @param context benchmark context
+static void measure(NlBenchResult* result, const NlBenchOptions* options, NlBenchPrepareFn prepare, NlBenchRunFn run,
+                    void* context)
+{
+    double samples[NL_BENCH_MAX_SAMPLES];
+
+    size_t iterationCount = calibrate(prepare, run, context, options->minSampleDuration);
+
+    for (size_t i = 0U; i < options->warmupSampleCount; ++i) {
+        prepare(context);
+        run(context, iterationCount);
+    }
+
+    for (size_t i = 0U; i < options->sampleCount; ++i) {
+        prepare(context);
+        NlClockMicros startedAt = nlClockNowMicros();
+        run(context, iterationCount);
+        NlClockMicros duration = nlClockNowMicros() - startedAt;
+        samples[i] = (double) duration * 1000.0 / (double) iterationCount;
+    }
+
+    size_t sampleCount = options->sampleCount;
+    qsort(samples, sampleCount, sizeof(samples[0]), compareDoubles);
+
+    double sum = 0.0;
+    for (size_t i = 0U; i < sampleCount; ++i) {
+        sum += samples[i];
+    }
+    double mean = sum / (double) sampleCount;
+
+    double squaredDiffSum = 0.0;
+    for (size_t i = 0U; i < sampleCount; ++i) {
+        double diff = samples[i] - mean;
+        squaredDiffSum += diff * diff;
+    }
+    double stddev = sampleCount > 1U ? sqrt(squaredDiffSum / (double) (sampleCount - 1U)) : 0.0;
+
+    result->iterationsPerSample = iterationCount;
+    result->sampleCount = sampleCount;
+    result->medianNs = (sampleCount % 2U) != 0U
+                           ? samples[sampleCount / 2U]
+                           : (samples[sampleCount / 2U - 1U] + samples[sampleCount / 2U]) * 0.5;
+    result->meanNs = mean;
+    result->stddevNs = stddev;
+    // Normal approximation, good enough for the default 30 samples
+    result->ci95Ns = 1.96 * stddev / sqrt((double) sampleCount);
+    result->minNs = samples[0];
+    result->maxNs = samples[sampleCount - 1U];
+}
+
+static void printResult(const NlBenchResult* result, NlBenchFormat format, bool isFirst)
+{
+    switch (format) {
+        case NlBenchFormatJson:
+            printf("%s    {\"name\": \"%s\", \"%s\": %zu, \"iterations\": %zu, \"samples\": %zu, \"medianNs\": %.1f, "
+                   "\"meanNs\": %.1f, \"stddevNs\": %.1f, \"ci95Ns\": %.1f, \"minNs\": %.1f, \"maxNs\": %.1f}",
+                   isFirst ? "" : ",\n", result->name, result->parameterName, result->parameter,
+                   result->iterationsPerSample, result->sampleCount, result->medianNs, result->meanNs,
+                   result->stddevNs, result->ci95Ns, result->minNs, result->maxNs);
+            break;
+        case NlBenchFormatCsv:
+            printf("%s,%s,%zu,%zu,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", result->name, result->parameterName,
+                   result->parameter, result->iterationsPerSample, result->sampleCount, result->medianNs,
+                   result->meanNs, result->stddevNs, result->ci95Ns, result->minNs, result->maxNs);
+            break;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    g_clog.log = clog_console;
+    g_clog.level = CLOG_TYPE_WARN;
+
+    NlBenchOptions options;
+    if (parseOptions(&options, argc, argv) < 0) {
+        printUsage();
+        return -1;
+    }
+
+    static NlBenchContext context;
+    NlBenchResult result;
+    bool isFirst = true;
+
+    if (options.format == NlBenchFormatJson) {
+        printf("{\n  \"stateOctetCount\": %zu,\n  \"results\": [\n", sizeof(NlGame));
+    } else {
+        printf("name,parameter,value,iterations,samples,medianNs,meanNs,stddevNs,ci95Ns,minNs,maxNs\n");
+    }
+
+    for (size_t playerCount = 1U; playerCount <= options.maxPlayerCount; playerCount *= 2U) {
+        setupGame(&context, playerCount);
+        result.name = "tick";
+        result.parameterName = "players";
+        result.parameter = playerCount;
+        measure(&result, &options, restoreStartGame, runTicks, &context);
+        printResult(&result, options.format, isFirst);
+        isFirst = false;
+    }
+
+    setupGame(&context, options.maxPlayerCount < 2U ? options.maxPlayerCount : 2U);
+    for (size_t tickCount = 1U; tickCount <= options.maxTicksFromAuthoritative; ++tickCount) {
+        context.rollbackTickCount = tickCount;
+        result.name = "rollback";
+        result.parameterName = "ticks";
+        result.parameter = tickCount;
+        measure(&result, &options, restoreStartGame, runRollback, &context);
+        printResult(&result, options.format, false);
+    }
+
+    result.name = "game_copy";
+    result.parameterName = "octets";
+    result.parameter = sizeof(NlGame);
+    measure(&result, &options, restoreStartGame, runGameCopy, &context);
+    printResult(&result, options.format, false);
+
+    result.name = "game_serialize";
+    measure(&result, &options, restoreStartGame, runGameSerialize, &context);
+    printResult(&result, options.format, false);
+
+    nlGameInit(&context.defaultGame);
+    result.name = "state_delta";
+    result.parameterName = "encodedOctets";
+    restoreStartGame(&context);
+    result.parameter = encodeAndDecodeStateDelta(&context);
+    measure(&result, &options, restoreStartGame, runStateDelta, &context);
+    printResult(&result, options.format, false);
+
+    if (options.format == NlBenchFormatJson) {
+        printf("\n  ]\n}\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,449 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "counting_transport.h"
+#include "impaired_transport.h"
+#include "engine_client.h"
+#include "host.h"
+#include "tick_scheduler.h"
+#include <clog/console.h>
+#include <imprint/default_setup.h>
+#include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
+#include <nimble-engine-client/client.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <transport-stack/single.h>
+
+clog_config g_clog;
+
+char g_clog_temp_str[CLOG_TEMP_STR_SIZE];
+
+typedef enum NlBotInputMode {
+    NlBotInputModeRandom,
+    NlBotInputModeScripted,
+} NlBotInputMode;
+
+typedef struct NlBotsOptions {
+    const char* remoteHost;
+    uint16_t port;
+    size_t maxBotCount;
+    size_t botsPerStage;
+    size_t stageSeconds;
+    uint32_t seed;
+    NlBotInputMode inputMode;
+    size_t memoryMiB;
+    const char* impairmentFilename;
+} NlBotsOptions;
+
+/// A headless participant. Set up the same way as the game client, but the gamepad is
+/// replaced with random or scripted input.
+typedef struct NlBot {
+    size_t index;
+    TransportStackSingle singleTransport;
+    NlCountingTransport countingTransport;
+    bool isImpaired;
+    NlImpairedTransport impairedTransport;
+    NlCountingTransport deliveredCountingTransport;
+    NimbleEngineClient nimbleEngineClient;
+    NlSimulationVm authoritative;
+    NlSimulationVm predicted;
+    NlClockMicros joinRequestedAt;
+    bool isSynced;
+    StepId lastAuthoritativeTickId;
+    size_t receivedStepCount;
+    size_t receivedStepCountAtStageStart;
+    size_t predictedInputCount;
+    uint32_t random;
+} NlBot;
+
+typedef struct NlBotsStageStats {
+    NlClockMicros hostUpdateTotal;
+    NlClockMicros hostUpdateMax;
+    size_t hostUpdateCount;
+    size_t joinCount;
+    NlClockMicros joinLatencyTotal;
+    NlClockMicros joinLatencyMax;
+} NlBotsStageStats;
+
+static void printUsage(void)
+{
+    fprintf(stderr, "usage: nimble-ball-bots [--bots <count>] [--bots-per-stage <count>] [--stage-seconds <s>] "
+                    "[--remote <ip>] [--port <port>] [--seed <seed>] [--input random|scripted] [--memory <MiB>] "
+                    "[--impairment <filename>]\n");
+}
+
+static int parseOptions(NlBotsOptions* options, int argc, char* argv[])
+{
+    options->remoteHost = 0;
+    options->port = 27003U;
+    options->maxBotCount = 16U;
+    options->botsPerStage = 2U;
+    options->stageSeconds = 5U;
+    options->seed = 0x5eedU;
+    options->inputMode = NlBotInputModeRandom;
+    options->memoryMiB = 256U;
+    options->impairmentFilename = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* name = argv[i];
+        if (i + 1 >= argc) {
+            return -1;
+        }
+        const char* value = argv[++i];
+        long intValue = strtol(value, 0, 10);
+
+        if (strcmp(name, "--remote") == 0) {
+            options->remoteHost = value;
+        } else if (strcmp(name, "--impairment") == 0) {
+            options->impairmentFilename = value;
+        } else if (strcmp(name, "--input") == 0) {
+            if (strcmp(value, "random") == 0) {
+                options->inputMode = NlBotInputModeRandom;
+            } else if (strcmp(value, "scripted") == 0) {
+                options->inputMode = NlBotInputModeScripted;
+            } else {
+                return -2;
+            }
+        } else if (intValue <= 0) {
+            return -3;
+        } else if (strcmp(name, "--port") == 0 && intValue <= 0xffff) {
+            options->port = (uint16_t) intValue;
+        } else if (strcmp(name, "--bots") == 0) {
+            options->maxBotCount = (size_t) intValue;
+        } else if (strcmp(name, "--bots-per-stage") == 0) {
+            options->botsPerStage = (size_t) intValue;
+        } else if (strcmp(name, "--stage-seconds") == 0) {
+            options->stageSeconds = (size_t) intValue;
+        } else if (strcmp(name, "--seed") == 0) {
+            options->seed = (uint32_t) intValue;
+        } else if (strcmp(name, "--memory") == 0) {
+            options->memoryMiB = (size_t) intValue;
+        } else {
+            return -4;
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t nextRandom(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static NlPlayerInput botInGameInput(NlBot* self, NlBotInputMode mode)
+{
+    NlPlayerInput playerInput;
+    playerInput.inputType = NlPlayerInputTypeInGame;
+
+    switch (mode) {
+        case NlBotInputModeRandom: {
+            uint32_t value = nextRandom(&self->random);
+            playerInput.input.inGameInput.horizontalAxis = (int8_t) ((int) (value % 201U) - 100);
+            playerInput.input.inGameInput.verticalAxis = (int8_t) ((int) ((value >> 8U) % 201U) - 100);
+            playerInput.input.inGameInput.buttons = (uint8_t) ((value >> 16U) & 0x03U);
+        } break;
+        case NlBotInputModeScripted: {
+            // Runs in a square and kicks on every corner
+            static const int8_t directions[4][2] = {{100, 0}, {0, 100}, {-100, 0}, {0, -100}};
+            size_t phaseTicks = 40U;
+            size_t side = (self->predictedInputCount / phaseTicks + self->index) % 4U;
+            playerInput.input.inGameInput.horizontalAxis = directions[side][0];
+            playerInput.input.inGameInput.verticalAxis = directions[side][1];
+            playerInput.input.inGameInput.buttons = (self->predictedInputCount % phaseTicks) == 0U ? 0x01 : 0x00;
+        } break;
+    }
+
+    return playerInput;
+}
+
+static void botAddPredictedInput(NlBot* self, NlBotInputMode mode)
+{
+    StepId outStepId;
+    TransmuteState authoritativeState = assentGetState(&self->nimbleEngineClient.rectify.authoritative, &outStepId);
+    const NlGame* authoritative = (const NlGame*) authoritativeState.state;
+
+    uint8_t participantId = self->nimbleEngineClient.nimbleClient.client.localParticipantLookup[0].participantId;
+    const NlPlayer* simulationPlayer = nlGameFindSimulationPlayerFromParticipantId(authoritative, participantId);
+
+    NlPlayerInput input;
+    if (simulationPlayer != 0 && simulationPlayer->phase == NlPlayerPhaseSelectTeam) {
+        input.inputType = NlPlayerInputTypeSelectTeam;
+        input.input.selectTeam.preferredTeamToJoin = (uint8_t) (self->index % 2U);
+        tc_snprintf(input.input.selectTeam.playerName, 32, "bot %zu", self->index);
+    } else {
+        input = botInGameInput(self, mode);
+    }
+
+    TransmuteParticipantInput participantInput;
+    participantInput.input = &input;
+    participantInput.octetSize = sizeof(input);
+    participantInput.participantId = participantId;
+    participantInput.inputType = TransmuteParticipantInputTypeNormal;
+
+    TransmuteInput transmuteInput;
+    transmuteInput.participantInputs = &participantInput;
+    transmuteInput.participantCount = 1U;
+
+    nimbleEngineClientAddPredictedInput(&self->nimbleEngineClient, &transmuteInput);
+    self->predictedInputCount++;
+}
+
+static void botInit(NlBot* self, size_t index, const NlBotsOptions* options, const char* hostname,
+                    const NlImpairmentProfile* impairmentProfile, struct ImprintAllocator* allocator,
+                    struct ImprintAllocatorWithFree* allocatorWithFree)
+{
+    self->index = index;
+    self->isSynced = false;
+    self->lastAuthoritativeTickId = 0;
+    self->receivedStepCount = 0U;
+    self->receivedStepCountAtStageStart = 0U;
+    self->predictedInputCount = 0U;
+    self->random = options->seed ^ (uint32_t) ((index + 1U) * 0x9e3779b9U);
+    if (self->random == 0U) {
+        self->random = 1U;
+    }
+
+    Clog vmLog;
+    vmLog.constantPrefix = "BotVm";
+    vmLog.config = &g_clog;
+    nlSimulationVmInit(&self->authoritative, vmLog);
+    nlSimulationVmInit(&self->predicted, vmLog);
+
+    Clog singleLog;
+    singleLog.config = &g_clog;
+    singleLog.constantPrefix = "bot";
+    transportStackSingleInit(&self->singleTransport, allocator, allocatorWithFree, TransportStackModeLocalUdp,
+                             singleLog);
+    transportStackSingleConnect(&self->singleTransport, hostname, options->port);
+    nlCountingTransportInit(&self->countingTransport, self->singleTransport.singleTransport);
+
+    // Sent datagrams are counted below the impairment, where they reach the socket, and received datagrams above
+    // it, where they reach the engine client. Datagrams the impairment drops are not counted in either direction.
+    DatagramTransport transport = self->countingTransport.transport;
+    self->isImpaired = impairmentProfile != 0;
+    if (self->isImpaired) {
+        nlImpairedTransportInit(&self->impairedTransport, transport, impairmentProfile, self->random);
+        transport = self->impairedTransport.transport;
+    }
+    nlCountingTransportInit(&self->deliveredCountingTransport, transport);
+    transport = self->deliveredCountingTransport.transport;
+
+    NlEngineClientSetup setup;
+    nlEngineClientSetupInit(&setup, transport, &self->authoritative.transmuteVm,
+                            &self->predicted.transmuteVm, allocator, allocatorWithFree);
+    nlEngineClientStartJoining(&self->nimbleEngineClient, &setup);
+
+    self->joinRequestedAt = nlClockNowMicros();
+}
+
+static void botUpdate(NlBot* self, NlBotInputMode mode, NlBotsStageStats* stats)
+{
+    transportStackSingleUpdate(&self->singleTransport);
+    if (!transportStackSingleIsConnected(&self->singleTransport)) {
+        return;
+    }
+
+    nimbleEngineClientUpdate(&self->nimbleEngineClient);
+    if (self->nimbleEngineClient.phase != NimbleEngineClientPhaseSynced) {
+        return;
+    }
+
+    NimbleGameState authoritativeState;
+    NimbleGameState predictedState;
+    nimbleEngineClientGetGameStates(&self->nimbleEngineClient, &authoritativeState, &predictedState);
+
+    if (!self->isSynced) {
+        self->isSynced = true;
+        NlClockMicros joinLatency = nlClockNowMicros() - self->joinRequestedAt;
+        stats->joinCount++;
+        stats->joinLatencyTotal += joinLatency;
+        if (joinLatency > stats->joinLatencyMax) {
+            stats->joinLatencyMax = joinLatency;
+        }
+    } else if (authoritativeState.tickId > self->lastAuthoritativeTickId) {
+        self->receivedStepCount += authoritativeState.tickId - self->lastAuthoritativeTickId;
+    }
+    self->lastAuthoritativeTickId = authoritativeState.tickId;
+
+    if (self->nimbleEngineClient.nimbleClient.client.localParticipantCount > 0 &&
+        nimbleEngineClientMustAddPredictedInput(&self->nimbleEngineClient)) {
+        botAddPredictedInput(self, mode);
+    }
+}
+
+static void sumDatagrams(const NlBot* bots, size_t botCount, size_t* outSent, size_t* outReceived)
+{
+    size_t sent = 0U;
+    size_t received = 0U;
+    for (size_t i = 0U; i < botCount; ++i) {
+        sent += bots[i].countingTransport.sentDatagramCount;
+        received += bots[i].deliveredCountingTransport.receivedDatagramCount;
+    }
+    *outSent = sent;
+    *outReceived = received;
+}
+
+/// The host sends every authoritative step to every bot, so a bot that was synced for the whole stage has received
+/// all steps the host produced. Bots that joined during the stage or fell behind received fewer.
+/// @return the most steps a single bot received during the stage
+static size_t hostStepCountInStage(const NlBot* bots, size_t botCount)
+{
+    size_t maxStepCount = 0U;
+    for (size_t i = 0U; i < botCount; ++i) {
+        size_t stepCount = bots[i].receivedStepCount - bots[i].receivedStepCountAtStageStart;
+        if (stepCount > maxStepCount) {
+            maxStepCount = stepCount;
+        }
+    }
+    return maxStepCount;
+}
+
+int main(int argc, char* argv[])
+{
+    g_clog.log = clog_console;
+    g_clog.level = CLOG_TYPE_WARN;
+
+    NlBotsOptions options;
+    if (parseOptions(&options, argc, argv) < 0) {
+        printUsage();
+        return -1;
+    }
+
+    ImprintDefaultSetup imprintDefaultSetup;
+    imprintDefaultSetupInit(&imprintDefaultSetup, options.memoryMiB * 1024 * 1024);
+    struct ImprintAllocator* allocator = &imprintDefaultSetup.tagAllocator.info;
+    struct ImprintAllocatorWithFree* allocatorWithFree = &imprintDefaultSetup.slabAllocator.info;
+
+    bool isHostingLocally = options.remoteHost == 0;
+    NlAppHost host;
+    if (isHostingLocally) {
+        NlSimulationVm versionVm;
+        Clog versionLog;
+        versionLog.constantPrefix = "NimbleBallVersion";
+        versionLog.config = &g_clog;
+        nlSimulationVmInit(&versionVm, versionLog);
+
+        NimbleSerializeVersion applicationVersion = {
+            versionVm.transmuteVm.version.major,
+            versionVm.transmuteVm.version.minor,
+            versionVm.transmuteVm.version.patch,
+        };
+
+        NlAppHostSetup hostSetup;
+        nlAppHostSetupInit(&hostSetup, applicationVersion, allocator, allocatorWithFree);
+        hostSetup.maxConnectionCount = options.maxBotCount;
+        hostSetup.maxParticipantCount = options.maxBotCount;
+        if (nlAppHostInit(&host, "", options.port, TransportStackModeLocalUdp, &hostSetup) < 0) {
+            return -2;
+        }
+    }
+
+    static NlImpairmentProfile impairmentProfile;
+    const NlImpairmentProfile* botImpairmentProfile = 0;
+    if (options.impairmentFilename != 0) {
+        if (nlImpairmentProfileLoad(&impairmentProfile, options.impairmentFilename) < 0) {
+            return -3;
+        }
+        botImpairmentProfile = &impairmentProfile;
+    }
+
+    NlBot* bots = IMPRINT_ALLOC_TYPE_COUNT(allocator, NlBot, options.maxBotCount);
+    size_t botCount = 0U;
+    const char* hostname = isHostingLocally ? "127.0.0.1" : options.remoteHost;
+
+    NlTickScheduler tickScheduler;
+    nlTickSchedulerInit(&tickScheduler, 2000U, nlClockNowMicros());
+
+    if (!isHostingLocally) {
+        fprintf(stderr, "host update time is only measured when hosting in-process, it is n/a with --remote\n");
+    }
+    printf("participants,synced,hostUpdateAvgUs,hostUpdateMaxUs,hostStepsPerSecond,datagramsOutPerSecond,"
+           "datagramsInPerSecond,joinLatencyAvgMs,joinLatencyMaxMs\n");
+
+    while (botCount < options.maxBotCount) {
+        size_t targetBotCount = botCount + options.botsPerStage;
+        if (targetBotCount > options.maxBotCount) {
+            targetBotCount = options.maxBotCount;
+        }
+        for (; botCount < targetBotCount; ++botCount) {
+            botInit(&bots[botCount], botCount, &options, hostname, botImpairmentProfile, allocator,
+                    allocatorWithFree);
+        }
+
+        NlBotsStageStats stats;
+        memset(&stats, 0, sizeof(stats));
+
+        size_t sentBefore;
+        size_t receivedBefore;
+        sumDatagrams(bots, botCount, &sentBefore, &receivedBefore);
+        for (size_t i = 0U; i < botCount; ++i) {
+            bots[i].receivedStepCountAtStageStart = bots[i].receivedStepCount;
+        }
+
+        NlClockMicros stageStartedAt = nlClockNowMicros();
+        NlClockMicros stageDuration = (NlClockMicros) options.stageSeconds * 1000000U;
+        while (nlClockNowMicros() - stageStartedAt < stageDuration) {
+            nlTickSchedulerWaitForNextTick(&tickScheduler);
+            if (nlTickSchedulerTicksDue(&tickScheduler, nlClockNowMicros()) == 0U) {
+                continue;
+            }
+
+            for (size_t i = 0U; i < botCount; ++i) {
+                botUpdate(&bots[i], options.inputMode, &stats);
+            }
+
+            if (isHostingLocally) {
+                NlClockMicros before = nlClockNowMicros();
+                nlAppHostUpdate(&host, monotonicTimeMsNow());
+                NlClockMicros hostUpdateTime = nlClockNowMicros() - before;
+                stats.hostUpdateTotal += hostUpdateTime;
+                stats.hostUpdateCount++;
+                if (hostUpdateTime > stats.hostUpdateMax) {
+                    stats.hostUpdateMax = hostUpdateTime;
+                }
+                if (bots[0].isSynced && nlAppHostMustProvideGameState(&host)) {
+                    nlAppHostProvideGameStateFromClient(&host, &bots[0].nimbleEngineClient);
+                }
+            }
+        }
+
+        double seconds = (double) (nlClockNowMicros() - stageStartedAt) / 1000000.0;
+        size_t sentAfter;
+        size_t receivedAfter;
+        sumDatagrams(bots, botCount, &sentAfter, &receivedAfter);
+
+        size_t syncedCount = 0U;
+        for (size_t i = 0U; i < botCount; ++i) {
+            syncedCount += bots[i].isSynced ? 1U : 0U;
+        }
+
+        char hostUpdateAvg[32];
+        char hostUpdateMax[32];
+        if (isHostingLocally) {
+            tc_snprintf(hostUpdateAvg, sizeof(hostUpdateAvg), "%.1f",
+                        stats.hostUpdateCount > 0U ? (double) stats.hostUpdateTotal / (double) stats.hostUpdateCount
+                                                   : 0.0);
+            tc_snprintf(hostUpdateMax, sizeof(hostUpdateMax), "%.1f", (double) stats.hostUpdateMax);
+        } else {
+            tc_snprintf(hostUpdateAvg, sizeof(hostUpdateAvg), "n/a");
+            tc_snprintf(hostUpdateMax, sizeof(hostUpdateMax), "n/a");
+        }
+
+        printf("%zu,%zu,%s,%s,%.1f,%.1f,%.1f,%.1f,%.1f\n", botCount, syncedCount, hostUpdateAvg, hostUpdateMax,
+               (double) hostStepCountInStage(bots, botCount) / seconds,
+               (double) (sentAfter - sentBefore) / seconds, (double) (receivedAfter - receivedBefore) / seconds,
+               stats.joinCount > 0U ? (double) stats.joinLatencyTotal / (double) stats.joinCount / 1000.0 : 0.0,
+               (double) stats.joinLatencyMax / 1000.0);
+        fflush(stdout);
+    }
+
+    return 0;
+}
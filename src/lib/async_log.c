@@ -0,0 +1,278 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "async_log.h"
+#include "clock.h"
+#include "thread.h"
+#include <clog/console.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <tiny-libc/tiny_libc.h>
+
+#define NL_ASYNC_LOG_MAX_THREADS (8)
+#define NL_ASYNC_LOG_RING_OCTET_COUNT (64 * 1024)
+#define NL_ASYNC_LOG_MAX_TEXT_OCTET_COUNT (1024)
+
+/// Single producer (the owning thread) and single consumer (the writer thread). The positions only grow,
+/// the ring index is the position modulo the ring size.
+/// A released ring can be taken over by another thread right away. What the exited thread published is
+/// still drained, and the new owner continues from the same write position.
+typedef struct NlAsyncLogRing {
+    _Alignas(64) atomic_size_t writePosition;
+    _Alignas(64) atomic_size_t readPosition;
+    atomic_bool isReleased;
+    uint8_t octets[NL_ASYNC_LOG_RING_OCTET_COUNT];
+} NlAsyncLogRing;
+
+typedef struct NlAsyncLog {
+    NlAsyncLogRing* rings;
+    atomic_size_t ringCount;
+    atomic_size_t droppedCount;
+    size_t reportedDroppedCount;
+    atomic_bool isRunning;
+    NlThread writerThread;
+    FILE* file;
+} NlAsyncLog;
+
+static NlAsyncLog g_asyncLog;
+static NL_THREAD_LOCAL NlAsyncLogRing* t_asyncLogRing;
+static NL_THREAD_LOCAL size_t t_asyncLogThreadIndex;
+
+static NlAsyncLogRing* asyncLogRing(void)
+{
+    if (t_asyncLogRing != 0) {
+        return t_asyncLogRing;
+    }
+
+    size_t claimedCount = atomic_load(&g_asyncLog.ringCount);
+    if (claimedCount > NL_ASYNC_LOG_MAX_THREADS) {
+        claimedCount = NL_ASYNC_LOG_MAX_THREADS;
+    }
+    for (size_t i = 0U; i < claimedCount; ++i) {
+        bool isReleased = true;
+        if (atomic_compare_exchange_strong(&g_asyncLog.rings[i].isReleased, &isReleased, false)) {
+            t_asyncLogThreadIndex = i;
+            t_asyncLogRing = &g_asyncLog.rings[i];
+            return t_asyncLogRing;
+        }
+    }
+
+    size_t index = atomic_fetch_add(&g_asyncLog.ringCount, 1U);
+    if (index >= NL_ASYNC_LOG_MAX_THREADS) {
+        return 0;
+    }
+
+    t_asyncLogThreadIndex = index;
+    t_asyncLogRing = &g_asyncLog.rings[index];
+
+    return t_asyncLogRing;
+}
+
+static void ringWrite(NlAsyncLogRing* self, size_t position, const void* source, size_t octetCount)
+{
+    const uint8_t* octets = (const uint8_t*) source;
+    size_t index = position % NL_ASYNC_LOG_RING_OCTET_COUNT;
+    size_t firstOctetCount = NL_ASYNC_LOG_RING_OCTET_COUNT - index;
+    if (firstOctetCount > octetCount) {
+        firstOctetCount = octetCount;
+    }
+    tc_memcpy_octets(self->octets + index, octets, firstOctetCount);
+    tc_memcpy_octets(self->octets, octets + firstOctetCount, octetCount - firstOctetCount);
+}
+
+/// Writes everything that has been published in the ring to the file
+/// @return number of octets written
+static size_t ringDrain(NlAsyncLogRing* self, FILE* file)
+{
+    size_t readPosition = atomic_load_explicit(&self->readPosition, memory_order_relaxed);
+    size_t writePosition = atomic_load_explicit(&self->writePosition, memory_order_acquire);
+    size_t octetCount = writePosition - readPosition;
+    if (octetCount == 0U) {
+        return 0U;
+    }
+
+    size_t index = readPosition % NL_ASYNC_LOG_RING_OCTET_COUNT;
+    size_t firstOctetCount = NL_ASYNC_LOG_RING_OCTET_COUNT - index;
+    if (firstOctetCount > octetCount) {
+        firstOctetCount = octetCount;
+    }
+    fwrite(self->octets + index, 1, firstOctetCount, file);
+    fwrite(self->octets, 1, octetCount - firstOctetCount, file);
+
+    atomic_store_explicit(&self->readPosition, writePosition, memory_order_release);
+
+    return octetCount;
+}
+
+/// Adds a record with the total number of dropped lines, if it has grown since the last one
+static void reportDropped(void)
+{
+    size_t droppedCount = atomic_load_explicit(&g_asyncLog.droppedCount, memory_order_relaxed);
+    if (droppedCount == g_asyncLog.reportedDroppedCount) {
+        return;
+    }
+    g_asyncLog.reportedDroppedCount = droppedCount;
+
+    static const char prefix[] = "AsyncLog";
+    char text[64];
+    int textOctetCount = tc_snprintf(text, sizeof(text), "%zu log lines dropped so far", droppedCount);
+
+    NlAsyncLogRecordHeader header;
+    header.time = nlClockNowMicros();
+    header.type = (uint8_t) CLOG_TYPE_WARN;
+    header.threadIndex = NL_ASYNC_LOG_WRITER_THREAD_INDEX;
+    header.prefixOctetCount = (uint8_t) (sizeof(prefix) - 1U);
+    header.reserved = 0U;
+    header.textOctetCount = (uint16_t) textOctetCount;
+
+    fwrite(&header, 1, sizeof(header), g_asyncLog.file);
+    fwrite(prefix, 1, sizeof(prefix) - 1U, g_asyncLog.file);
+    fwrite(text, 1, (size_t) textOctetCount, g_asyncLog.file);
+}
+
+static void drainAll(void)
+{
+    size_t ringCount = atomic_load(&g_asyncLog.ringCount);
+    if (ringCount > NL_ASYNC_LOG_MAX_THREADS) {
+        ringCount = NL_ASYNC_LOG_MAX_THREADS;
+    }
+
+    size_t octetCount = 0U;
+    for (size_t i = 0U; i < ringCount; ++i) {
+        octetCount += ringDrain(&g_asyncLog.rings[i], g_asyncLog.file);
+    }
+    reportDropped();
+
+    if (octetCount > 0U) {
+        fflush(g_asyncLog.file);
+    }
+}
+
+static void writerThread(void* arg)
+{
+    (void) arg;
+
+    while (atomic_load(&g_asyncLog.isRunning)) {
+        drainAll();
+        nlClockSleepMicros(10000U);
+    }
+}
+
+/// Opens the log file and starts the writer thread. Set `g_clog.log = nlAsyncLogClog` afterwards.
+/// @param filename file to write the binary log to
+/// @return negative on error
+int nlAsyncLogStart(const char* filename)
+{
+    g_asyncLog.file = fopen(filename, "wb");
+    if (g_asyncLog.file == 0) {
+        return -1;
+    }
+    fwrite(NL_ASYNC_LOG_MAGIC, 1, NL_ASYNC_LOG_MAGIC_OCTET_COUNT, g_asyncLog.file);
+
+    g_asyncLog.rings = (NlAsyncLogRing*) tc_malloc(sizeof(NlAsyncLogRing) * NL_ASYNC_LOG_MAX_THREADS);
+    for (size_t i = 0U; i < NL_ASYNC_LOG_MAX_THREADS; ++i) {
+        atomic_init(&g_asyncLog.rings[i].writePosition, 0U);
+        atomic_init(&g_asyncLog.rings[i].readPosition, 0U);
+        atomic_init(&g_asyncLog.rings[i].isReleased, false);
+    }
+    atomic_init(&g_asyncLog.ringCount, 0U);
+    atomic_init(&g_asyncLog.droppedCount, 0U);
+    g_asyncLog.reportedDroppedCount = 0U;
+    atomic_init(&g_asyncLog.isRunning, true);
+
+    if (nlThreadCreate(&g_asyncLog.writerThread, writerThread, 0) < 0) {
+        fclose(g_asyncLog.file);
+        tc_free(g_asyncLog.rings);
+        g_asyncLog.rings = 0;
+        return -2;
+    }
+
+    return 0;
+}
+
+/// Stops the writer thread and writes what is left in the rings. No thread may log after this,
+/// so switch `g_clog.log` back to another backend first.
+void nlAsyncLogStop(void)
+{
+    if (g_asyncLog.rings == 0) {
+        return;
+    }
+
+    atomic_store(&g_asyncLog.isRunning, false);
+    nlThreadJoin(&g_asyncLog.writerThread);
+    drainAll();
+    fclose(g_asyncLog.file);
+    tc_free(g_asyncLog.rings);
+    g_asyncLog.rings = 0;
+}
+
+/// @return number of log lines that were dropped because a ring was full or there were too many threads
+size_t nlAsyncLogDroppedCount(void)
+{
+    return atomic_load(&g_asyncLog.droppedCount);
+}
+
+/// Gives the ring of the calling thread back, so a thread that is started later can use it.
+/// Called by nlThreadCreate() threads when they exit.
+void nlAsyncLogReleaseThread(void)
+{
+    NlAsyncLogRing* ring = t_asyncLogRing;
+    if (ring == 0) {
+        return;
+    }
+    t_asyncLogRing = 0;
+    atomic_store(&ring->isReleased, true);
+}
+
+/// Clog backend. Never blocks, errors are also written to the console right away so they are not lost in a crash.
+/// @param type log type
+/// @param prefix constant prefix of the log
+/// @param string formatted log line
+void nlAsyncLogClog(enum clog_type type, const char* prefix, const char* string)
+{
+    if (type >= CLOG_TYPE_ERROR) {
+        clog_console(type, prefix, string);
+    }
+
+    NlAsyncLogRing* ring = asyncLogRing();
+    if (ring == 0) {
+        atomic_fetch_add_explicit(&g_asyncLog.droppedCount, 1U, memory_order_relaxed);
+        return;
+    }
+
+    if (prefix == 0) {
+        prefix = "";
+    }
+    size_t prefixOctetCount = tc_strlen(prefix);
+    if (prefixOctetCount > 0xffU) {
+        prefixOctetCount = 0xffU;
+    }
+    size_t textOctetCount = tc_strlen(string);
+    if (textOctetCount > NL_ASYNC_LOG_MAX_TEXT_OCTET_COUNT) {
+        textOctetCount = NL_ASYNC_LOG_MAX_TEXT_OCTET_COUNT;
+    }
+
+    NlAsyncLogRecordHeader header;
+    header.time = nlClockNowMicros();
+    header.type = (uint8_t) type;
+    header.threadIndex = (uint8_t) t_asyncLogThreadIndex;
+    header.prefixOctetCount = (uint8_t) prefixOctetCount;
+    header.reserved = 0U;
+    header.textOctetCount = (uint16_t) textOctetCount;
+
+    size_t recordOctetCount = sizeof(header) + prefixOctetCount + textOctetCount;
+    size_t writePosition = atomic_load_explicit(&ring->writePosition, memory_order_relaxed);
+    size_t readPosition = atomic_load_explicit(&ring->readPosition, memory_order_acquire);
+    if (NL_ASYNC_LOG_RING_OCTET_COUNT - (writePosition - readPosition) < recordOctetCount) {
+        atomic_fetch_add_explicit(&g_asyncLog.droppedCount, 1U, memory_order_relaxed);
+        return;
+    }
+
+    ringWrite(ring, writePosition, &header, sizeof(header));
+    ringWrite(ring, writePosition + sizeof(header), prefix, prefixOctetCount);
+    ringWrite(ring, writePosition + sizeof(header) + prefixOctetCount, string, textOctetCount);
+
+    atomic_store_explicit(&ring->writePosition, writePosition + recordOctetCount, memory_order_release);
+}
@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_ASYNC_LOG_H
+#define NIMBLE_BALL_ASYNC_LOG_H
+
+#include <clog/clog.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Clog backend that copies each log line as a compact binary record into a lock-free ring for each
+/// thread. A background thread drains the rings to a file, so logging never waits for console or disk I/O.
+/// Records are dropped (and counted) if a ring is full or all rings are taken. The writer adds a record with
+/// the number of dropped lines when it has grown. A thread gives its ring back when it exits, see
+/// nlAsyncLogReleaseThread(). Use nimble-ball-log-decode to turn the file into text.
+///
+/// The backend only copies lines that are already formatted. Code that logs from more than one thread
+/// should use the NL_LOG_* macros in thread_log.h, which format into a buffer for each thread instead of
+/// the shared clog one.
+///
+/// File format, in host byte order: the NL_ASYNC_LOG_MAGIC octets followed by records of
+/// NlAsyncLogRecordHeader, prefix octets and text octets. The thread index is the index of the ring, a thread
+/// that is started later can reuse the ring (and index) of one that has exited. Records written by the writer
+/// thread itself use NL_ASYNC_LOG_WRITER_THREAD_INDEX.
+
+#define NL_ASYNC_LOG_MAGIC "NBLG0001"
+#define NL_ASYNC_LOG_MAGIC_OCTET_COUNT (8)
+#define NL_ASYNC_LOG_WRITER_THREAD_INDEX (0xff)
+
+typedef struct NlAsyncLogRecordHeader {
+    uint64_t time;
+    uint8_t type;
+    uint8_t threadIndex;
+    uint8_t prefixOctetCount;
+    uint8_t reserved;
+    uint16_t textOctetCount;
+} NlAsyncLogRecordHeader;
+
+int nlAsyncLogStart(const char* filename);
+void nlAsyncLogStop(void);
+size_t nlAsyncLogDroppedCount(void);
+void nlAsyncLogReleaseThread(void);
+void nlAsyncLogClog(enum clog_type type, const char* prefix, const char* string);
+
+#endif
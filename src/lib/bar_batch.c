@@ -0,0 +1,82 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "bar_batch.h"
+#include <sdl-render/rect.h>
+
+static void setColor(SDL_Color* color, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
+{
+    color->r = r;
+    color->g = g;
+    color->b = b;
+    color->a = a;
+}
+
+/// Initializes the batches
+/// @param self bar batches
+/// @param rectsRender rectangle render to fill on
+/// @param typeCount number of bar types (colors), at most NL_BAR_BATCH_MAX_TYPES
+void nlBarBatchesInit(NlBarBatches* self, SrRects* rectsRender, size_t typeCount)
+{
+    self->rectsRender = rectsRender;
+    self->typeCount = typeCount > NL_BAR_BATCH_MAX_TYPES ? NL_BAR_BATCH_MAX_TYPES : typeCount;
+    setColor(&self->backgroundColor, 0U, 0U, 0U, 0U);
+    for (size_t type = 0U; type < NL_BAR_BATCH_MAX_TYPES; ++type) {
+        setColor(&self->batches[type].color, 0xffU, 0xffU, 0xffU, 0xffU);
+        self->batches[type].count = 0;
+    }
+}
+
+void nlBarBatchesSetColor(NlBarBatches* self, size_t type, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
+{
+    setColor(&self->batches[type].color, r, g, b, a);
+}
+
+void nlBarBatchesSetBackgroundColor(NlBarBatches* self, Uint8 r, Uint8 g, Uint8 b, Uint8 a)
+{
+    setColor(&self->backgroundColor, r, g, b, a);
+}
+
+/// Fills the area behind the bars right away
+void nlBarBatchesFillBackground(NlBarBatches* self, int x, int y, int w, int h)
+{
+    SDL_Color color = self->backgroundColor;
+    SDL_SetRenderDrawColor(self->rectsRender->renderer, color.r, color.g, color.b, color.a);
+    srRectsFillRect(self->rectsRender, x, y, w, h);
+}
+
+void nlBarBatchesClear(NlBarBatches* self)
+{
+    for (size_t type = 0U; type < self->typeCount; ++type) {
+        self->batches[type].count = 0;
+    }
+}
+
+/// Adds a bar to the batch of its type. Bars that do not fit are not drawn.
+void nlBarBatchesAdd(NlBarBatches* self, size_t type, int x, int y, int w, int h)
+{
+    NlBarBatch* batch = &self->batches[type];
+    if (batch->count == NL_BAR_BATCH_MAX_BARS) {
+        return;
+    }
+    SDL_Rect* rect = &batch->rects[batch->count++];
+    rect->x = x;
+    rect->y = self->rectsRender->height - y - h;
+    rect->w = w;
+    rect->h = h;
+}
+
+/// Draws all added bars, one fill call for each type that has bars
+void nlBarBatchesSubmit(NlBarBatches* self)
+{
+    for (size_t type = 0U; type < self->typeCount; ++type) {
+        const NlBarBatch* batch = &self->batches[type];
+        if (batch->count == 0) {
+            continue;
+        }
+        SDL_Color color = batch->color;
+        SDL_SetRenderDrawColor(self->rectsRender->renderer, color.r, color.g, color.b, color.a);
+        SDL_RenderFillRects(self->rectsRender->renderer, batch->rects, batch->count);
+    }
+}
@@ -0,0 +1,39 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_BAR_BATCH_H
+#define NIMBLE_BALL_BAR_BATCH_H
+
+#include <sdl-render/window.h>
+#include <stddef.h>
+
+struct SrRects;
+
+#define NL_BAR_BATCH_MAX_TYPES (4)
+#define NL_BAR_BATCH_MAX_BARS (256)
+
+typedef struct NlBarBatch {
+    SDL_Color color;
+    SDL_Rect rects[NL_BAR_BATCH_MAX_BARS];
+    int count;
+} NlBarBatch;
+
+/// Collects the bars of a graph overlay (e.g. the lagometer) for each color and submits them with a single fill call
+/// per color. Coordinates are flipped the same way as srRectsFillRect().
+typedef struct NlBarBatches {
+    struct SrRects* rectsRender;
+    SDL_Color backgroundColor;
+    NlBarBatch batches[NL_BAR_BATCH_MAX_TYPES];
+    size_t typeCount;
+} NlBarBatches;
+
+void nlBarBatchesInit(NlBarBatches* self, struct SrRects* rectsRender, size_t typeCount);
+void nlBarBatchesSetColor(NlBarBatches* self, size_t type, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+void nlBarBatchesSetBackgroundColor(NlBarBatches* self, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+void nlBarBatchesFillBackground(NlBarBatches* self, int x, int y, int w, int h);
+void nlBarBatchesClear(NlBarBatches* self);
+void nlBarBatchesAdd(NlBarBatches* self, size_t type, int x, int y, int w, int h);
+void nlBarBatchesSubmit(NlBarBatches* self);
+
+#endif
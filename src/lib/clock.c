@@ -0,0 +1,47 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "clock.h"
+
+#if defined _WIN32
+#include <windows.h>
+
+NlClockMicros nlClockNowMicros(void)
+{
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return (NlClockMicros) (counter.QuadPart / frequency.QuadPart) * 1000000U +
+           (NlClockMicros) (counter.QuadPart % frequency.QuadPart) * 1000000U / (NlClockMicros) frequency.QuadPart;
+}
+
+void nlClockSleepMicros(NlClockMicros duration)
+{
+    Sleep((DWORD) (duration / 1000U));
+}
+
+#else
+#include <time.h>
+
+NlClockMicros nlClockNowMicros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (NlClockMicros) now.tv_sec * 1000000U + (NlClockMicros) now.tv_nsec / 1000U;
+}
+
+void nlClockSleepMicros(NlClockMicros duration)
+{
+    struct timespec sleepTime;
+    sleepTime.tv_sec = (time_t) (duration / 1000000U);
+    sleepTime.tv_nsec = (long) (duration % 1000000U) * 1000L;
+    nanosleep(&sleepTime, 0);
+}
+
+#endif
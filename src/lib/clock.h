@@ -0,0 +1,15 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_CLOCK_H
+#define NIMBLE_BALL_CLOCK_H
+
+#include <stdint.h>
+
+typedef uint64_t NlClockMicros;
+
+NlClockMicros nlClockNowMicros(void);
+void nlClockSleepMicros(NlClockMicros duration);
+
+#endif
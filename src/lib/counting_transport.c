@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "counting_transport.h"
+
+static int countingSend(void* _self, const uint8_t* data, size_t octetCount)
+{
+    NlCountingTransport* self = (NlCountingTransport*) _self;
+
+    int result = datagramTransportSend(&self->inner, data, octetCount);
+    if (result >= 0) {
+        self->sentDatagramCount++;
+        self->sentOctetCount += octetCount;
+    }
+
+    return result;
+}
+
+static ssize_t countingReceive(void* _self, uint8_t* data, size_t maxOctetCount)
+{
+    NlCountingTransport* self = (NlCountingTransport*) _self;
+
+    ssize_t octetCount = datagramTransportReceive(&self->inner, data, maxOctetCount);
+    if (octetCount > 0) {
+        self->receivedDatagramCount++;
+        self->receivedOctetCount += (size_t) octetCount;
+    }
+
+    return octetCount;
+}
+
+/// Wraps a datagram transport. Use self->transport instead of the inner transport after this call.
+/// @param self counting transport
+/// @param inner transport to forward to
+void nlCountingTransportInit(NlCountingTransport* self, DatagramTransport inner)
+{
+    self->inner = inner;
+    self->transport.self = self;
+    self->transport.send = countingSend;
+    self->transport.receive = countingReceive;
+    self->sentDatagramCount = 0U;
+    self->sentOctetCount = 0U;
+    self->receivedDatagramCount = 0U;
+    self->receivedOctetCount = 0U;
+}
@@ -0,0 +1,22 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_COUNTING_TRANSPORT_H
+#define NIMBLE_BALL_COUNTING_TRANSPORT_H
+
+#include <datagram-transport/transport.h>
+
+/// Forwards to another datagram transport and counts the datagrams and octets passing through
+typedef struct NlCountingTransport {
+    DatagramTransport inner;
+    DatagramTransport transport;
+    size_t sentDatagramCount;
+    size_t sentOctetCount;
+    size_t receivedDatagramCount;
+    size_t receivedOctetCount;
+} NlCountingTransport;
+
+void nlCountingTransportInit(NlCountingTransport* self, DatagramTransport inner);
+
+#endif
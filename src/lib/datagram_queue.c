@@ -0,0 +1,62 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "datagram_queue.h"
+#include <tiny-libc/tiny_libc.h>
+
+void nlDatagramQueueInit(NlDatagramQueue* self)
+{
+    self->readIndex = 0U;
+    self->count = 0U;
+    self->droppedCount = 0U;
+}
+
+/// Copies a datagram to the end of the queue. The datagram is dropped if the queue is full,
+/// the same as a full socket buffer would do.
+/// @param self queue
+/// @param connectionId connection the datagram was received from or should be sent to
+/// @param octets datagram
+/// @param octetCount octet count of the datagram
+/// @return negative if the datagram was dropped
+int nlDatagramQueuePush(NlDatagramQueue* self, int connectionId, const uint8_t* octets, size_t octetCount)
+{
+    if (self->count == NL_DATAGRAM_QUEUE_CAPACITY || octetCount > NL_DATAGRAM_MAX_OCTET_COUNT) {
+        self->droppedCount++;
+        return -1;
+    }
+
+    NlQueuedDatagram* datagram = &self->datagrams[(self->readIndex + self->count) % NL_DATAGRAM_QUEUE_CAPACITY];
+    datagram->connectionId = connectionId;
+    datagram->octetCount = octetCount;
+    tc_memcpy_octets(datagram->octets, octets, octetCount);
+    self->count++;
+
+    return 0;
+}
+
+/// Copies the oldest datagram in the queue to target and removes it
+/// @param self queue
+/// @param connectionId connection id of the datagram
+/// @param target target buffer
+/// @param maxTargetOctetCount capacity of target
+/// @return octet count of the datagram, zero if the queue is empty and negative if the target is too small
+int nlDatagramQueuePop(NlDatagramQueue* self, int* connectionId, uint8_t* target, size_t maxTargetOctetCount)
+{
+    if (self->count == 0U) {
+        return 0;
+    }
+
+    const NlQueuedDatagram* datagram = &self->datagrams[self->readIndex];
+    self->readIndex = (self->readIndex + 1U) % NL_DATAGRAM_QUEUE_CAPACITY;
+    self->count--;
+
+    if (datagram->octetCount > maxTargetOctetCount) {
+        return -1;
+    }
+
+    *connectionId = datagram->connectionId;
+    tc_memcpy_octets(target, datagram->octets, datagram->octetCount);
+
+    return (int) datagram->octetCount;
+}
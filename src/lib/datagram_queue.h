@@ -0,0 +1,32 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_DATAGRAM_QUEUE_H
+#define NIMBLE_BALL_DATAGRAM_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_DATAGRAM_QUEUE_CAPACITY (64)
+#define NL_DATAGRAM_MAX_OCTET_COUNT (1200)
+
+typedef struct NlQueuedDatagram {
+    int connectionId;
+    size_t octetCount;
+    uint8_t octets[NL_DATAGRAM_MAX_OCTET_COUNT];
+} NlQueuedDatagram;
+
+/// Fixed size first-in first-out queue of datagrams. Not thread safe.
+typedef struct NlDatagramQueue {
+    NlQueuedDatagram datagrams[NL_DATAGRAM_QUEUE_CAPACITY];
+    size_t readIndex;
+    size_t count;
+    size_t droppedCount;
+} NlDatagramQueue;
+
+void nlDatagramQueueInit(NlDatagramQueue* self);
+int nlDatagramQueuePush(NlDatagramQueue* self, int connectionId, const uint8_t* octets, size_t octetCount);
+int nlDatagramQueuePop(NlDatagramQueue* self, int* connectionId, uint8_t* target, size_t maxTargetOctetCount);
+
+#endif
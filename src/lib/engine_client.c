@@ -0,0 +1,74 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "engine_client.h"
+#include "thread_log.h"
+#include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
+#include <nimble-engine-client/client.h>
+
+/// Fills in the engine client setup with the values used by the game client
+/// @param self setup
+/// @param transport connected (or connecting) datagram transport
+/// @param authoritative simulation used for the authoritative state
+/// @param predicted simulation used for the predicted state
+/// @param allocator allocator
+/// @param allocatorWithFree allocator with free
+void nlEngineClientSetupInit(NlEngineClientSetup* self, DatagramTransport transport, TransmuteVm* authoritative,
+                             TransmuteVm* predicted, struct ImprintAllocator* allocator,
+                             struct ImprintAllocatorWithFree* allocatorWithFree)
+{
+    self->transport = transport;
+    self->authoritative = authoritative;
+    self->predicted = predicted;
+    self->allocator = allocator;
+    self->allocatorWithFree = allocatorWithFree;
+    self->localPlayerCount = 1U;
+    self->maxTicksFromAuthoritative = 10U;
+    self->useSecret = false;
+    self->secret = 0;
+}
+
+/// Initializes a nimble engine client on a previously setup single datagram transport and requests to join
+/// @param self nimble engine client
+/// @param setup engine client setup
+void nlEngineClientStartJoining(NimbleEngineClient* self, const NlEngineClientSetup* setup)
+{
+    NimbleSerializeVersion clientReportTransmuteVmVersion = {
+        setup->authoritative->version.major,
+        setup->authoritative->version.minor,
+        setup->authoritative->version.patch,
+    };
+
+    NimbleEngineClientSetup engineSetup;
+    engineSetup.memory = setup->allocator;
+    engineSetup.blobMemory = setup->allocatorWithFree;
+    engineSetup.transport = setup->transport;
+
+    engineSetup.authoritative = *setup->authoritative;
+    engineSetup.predicted = *setup->predicted;
+    engineSetup.maximumSingleParticipantStepOctetCount = sizeof(NlPlayerInput);
+    engineSetup.maximumParticipantCount = 8;
+    engineSetup.applicationVersion = clientReportTransmuteVmVersion;
+    engineSetup.maxTicksFromAuthoritative = setup->maxTicksFromAuthoritative;
+    engineSetup.wantsDebugStream = true;
+
+    Clog nimbleEngineClientLog;
+    nimbleEngineClientLog.config = &g_clog;
+    nimbleEngineClientLog.constantPrefix = "NimbleEngineClient";
+
+    engineSetup.log = nimbleEngineClientLog;
+    nimbleEngineClientInit(self, engineSetup);
+
+    NL_LOG_DEBUG("nimble client is setup with transport")
+
+    NimbleEngineClientGameJoinOptions joinOptions;
+    joinOptions.playerCount = setup->localPlayerCount;
+    joinOptions.players[0].localIndex = 99;
+    joinOptions.players[1].localIndex = 42;
+    joinOptions.useSecret = setup->useSecret;
+    joinOptions.secret = setup->secret;
+    nimbleEngineClientRequestJoin(self, joinOptions);
+
+    NL_LOG_DEBUG("nimble client is trying to join / rejoin server")
+}
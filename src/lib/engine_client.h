@@ -0,0 +1,32 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_ENGINE_CLIENT_H
+#define NIMBLE_BALL_ENGINE_CLIENT_H
+
+#include <datagram-transport/transport.h>
+#include <nimble-serialize/serialize.h>
+#include <stdbool.h>
+
+struct NimbleEngineClient;
+struct TransmuteVm;
+
+typedef struct NlEngineClientSetup {
+    DatagramTransport transport;
+    struct TransmuteVm* authoritative;
+    struct TransmuteVm* predicted;
+    struct ImprintAllocator* allocator;
+    struct ImprintAllocatorWithFree* allocatorWithFree;
+    size_t localPlayerCount;
+    size_t maxTicksFromAuthoritative;
+    bool useSecret;
+    NimbleSerializeParticipantConnectionSecret secret;
+} NlEngineClientSetup;
+
+void nlEngineClientSetupInit(NlEngineClientSetup* self, DatagramTransport transport, struct TransmuteVm* authoritative,
+                             struct TransmuteVm* predicted, struct ImprintAllocator* allocator,
+                             struct ImprintAllocatorWithFree* allocatorWithFree);
+void nlEngineClientStartJoining(struct NimbleEngineClient* self, const NlEngineClientSetup* setup);
+
+#endif
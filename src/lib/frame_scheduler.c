@@ -0,0 +1,156 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "frame_scheduler.h"
+#include <math.h>
+
+static void frameTimeStatsReset(NlFrameTimeStats* self)
+{
+    self->count = 0U;
+    self->mean = 0.0;
+    self->sumOfSquaredDeltas = 0.0;
+    self->min = (NlClockMicros) -1;
+    self->max = 0U;
+}
+
+static void frameTimeStatsAdd(NlFrameTimeStats* self, NlClockMicros frameTime)
+{
+    // Welford, so the variance does not need the samples to be stored
+    self->count++;
+    double value = (double) frameTime;
+    double delta = value - self->mean;
+    self->mean += delta / (double) self->count;
+    self->sumOfSquaredDeltas += delta * (value - self->mean);
+    if (frameTime < self->min) {
+        self->min = frameTime;
+    }
+    if (frameTime > self->max) {
+        self->max = frameTime;
+    }
+}
+
+static void frameTimeStatsReport(const NlFrameTimeStats* self, NlFrameTimeReport* report)
+{
+    report->frameCount = self->count;
+    if (self->count == 0U) {
+        report->averageMs = 0.0;
+        report->jitterMs = 0.0;
+        report->minMs = 0.0;
+        report->maxMs = 0.0;
+        return;
+    }
+    report->averageMs = self->mean / 1000.0;
+    report->jitterMs = sqrt(self->sumOfSquaredDeltas / (double) self->count) / 1000.0;
+    report->minMs = (double) self->min / 1000.0;
+    report->maxMs = (double) self->max / 1000.0;
+}
+
+/// Initializes the frame scheduler
+/// @param self frame scheduler
+/// @param mode pacing mode
+/// @param targetFps frames per second in fixed mode
+/// @param lowPowerFps frames per second while in low power mode
+/// @param log log to report frame time jitter to
+void nlFrameSchedulerInit(NlFrameScheduler* self, NlFrameSchedulerMode mode, size_t targetFps, size_t lowPowerFps,
+                          Clog log)
+{
+    NlClockMicros now = nlClockNowMicros();
+
+    self->mode = mode;
+    self->frameDuration = 1000000U / (targetFps > 0U ? targetFps : 60U);
+    self->lowPowerFrameDuration = 1000000U / (lowPowerFps > 0U ? lowPowerFps : 30U);
+    self->spinDuration = 1500U;
+    self->isLowPower = false;
+    self->isReducedRate = false;
+    self->isRecordingFrameTimes = false;
+    self->wasRecordingFrameTimes = false;
+    self->nextFrameAt = now;
+    self->lastFrameAt = now;
+    self->reportInterval = 1000000U;
+    self->nextReportAt = now + self->reportInterval;
+    self->log = log;
+    frameTimeStatsReset(&self->stats);
+    frameTimeStatsReport(&self->stats, &self->lastReport);
+    nlHistogramInit(&self->frameTimes);
+}
+
+/// Switches to and from low power mode, typically used while in menus
+/// @param self frame scheduler
+/// @param isLowPower true to use the low power frame rate
+void nlFrameSchedulerSetLowPower(NlFrameScheduler* self, bool isLowPower)
+{
+    self->isLowPower = isLowPower;
+}
+
+/// Renders at half the fixed frame rate, typically while the prediction is over its CPU budget
+/// @param self frame scheduler
+/// @param isReducedRate true to use half the frame rate
+void nlFrameSchedulerSetReducedRate(NlFrameScheduler* self, bool isReducedRate)
+{
+    self->isReducedRate = isReducedRate;
+}
+
+/// Only recorded frame times are kept in the session long histogram, typically only the in-game frames
+/// @param self frame scheduler
+/// @param isRecordingFrameTimes true to record the frame times
+void nlFrameSchedulerSetRecordFrameTimes(NlFrameScheduler* self, bool isRecordingFrameTimes)
+{
+    self->isRecordingFrameTimes = isRecordingFrameTimes;
+}
+
+static void sleepAndSpinUntil(NlClockMicros deadline, NlClockMicros spinDuration)
+{
+    NlClockMicros now = nlClockNowMicros();
+    if (now + spinDuration < deadline) {
+        nlClockSleepMicros(deadline - now - spinDuration);
+    }
+
+    while (nlClockNowMicros() < deadline) {
+    }
+}
+
+/// Waits until the next frame should start and updates the frame time statistics. Frame times are also kept in
+/// a session long histogram while recording, see nlFrameSchedulerSetRecordFrameTimes().
+/// Call it once every frame, right before polling input, so input is sampled as late as possible.
+/// @param self frame scheduler
+void nlFrameSchedulerWaitForNextFrame(NlFrameScheduler* self)
+{
+    if (self->isLowPower) {
+        NlClockMicros now = nlClockNowMicros();
+        NlClockMicros deadline = self->lastFrameAt + self->lowPowerFrameDuration;
+        if (now < deadline) {
+            nlClockSleepMicros(deadline - now);
+        }
+    } else if (self->mode == NlFrameSchedulerModeFixed) {
+        NlClockMicros frameDuration = self->isReducedRate ? self->frameDuration * 2U : self->frameDuration;
+        self->nextFrameAt += frameDuration;
+        NlClockMicros now = nlClockNowMicros();
+        if (self->nextFrameAt + frameDuration < now) {
+            // Too far behind, do not try to catch up with a burst of short frames
+            self->nextFrameAt = now;
+        }
+        sleepAndSpinUntil(self->nextFrameAt, self->spinDuration);
+    }
+
+    NlClockMicros now = nlClockNowMicros();
+    frameTimeStatsAdd(&self->stats, now - self->lastFrameAt);
+    // The first frame after recording starts still took as long as the frame before it, e.g. a menu frame
+    if (self->isRecordingFrameTimes && self->wasRecordingFrameTimes) {
+        nlHistogramRecord(&self->frameTimes, now - self->lastFrameAt);
+    }
+    self->wasRecordingFrameTimes = self->isRecordingFrameTimes;
+    self->lastFrameAt = now;
+    if (self->mode != NlFrameSchedulerModeFixed || self->isLowPower) {
+        self->nextFrameAt = now;
+    }
+
+    if (now >= self->nextReportAt) {
+        frameTimeStatsReport(&self->stats, &self->lastReport);
+        frameTimeStatsReset(&self->stats);
+        self->nextReportAt = now + self->reportInterval;
+        CLOG_C_DEBUG(&self->log, "frames:%zu frame time avg:%.2f ms jitter:%.3f ms min:%.2f ms max:%.2f ms",
+                     self->lastReport.frameCount, self->lastReport.averageMs, self->lastReport.jitterMs,
+                     self->lastReport.minMs, self->lastReport.maxMs)
+    }
+}
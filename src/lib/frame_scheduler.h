@@ -0,0 +1,66 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_FRAME_SCHEDULER_H
+#define NIMBLE_BALL_FRAME_SCHEDULER_H
+
+#include "clock.h"
+#include "histogram.h"
+#include <clog/clog.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum NlFrameSchedulerMode {
+    NlFrameSchedulerModeUnlimited,
+    NlFrameSchedulerModeVsync,
+    NlFrameSchedulerModeFixed,
+} NlFrameSchedulerMode;
+
+/// Frame time statistics over one report interval
+typedef struct NlFrameTimeReport {
+    size_t frameCount;
+    double averageMs;
+    double jitterMs;
+    double minMs;
+    double maxMs;
+} NlFrameTimeReport;
+
+typedef struct NlFrameTimeStats {
+    size_t count;
+    double mean;
+    double sumOfSquaredDeltas;
+    NlClockMicros min;
+    NlClockMicros max;
+} NlFrameTimeStats;
+
+/// Paces the main loop. Fixed mode sleeps most of the frame and spin-waits the last part to
+/// hit the deadline. Low power mode is meant for menus and never spins. Reduced rate halves the fixed
+/// frame rate to leave CPU time for the simulation.
+typedef struct NlFrameScheduler {
+    NlFrameSchedulerMode mode;
+    NlClockMicros frameDuration;
+    NlClockMicros lowPowerFrameDuration;
+    NlClockMicros spinDuration;
+    bool isLowPower;
+    bool isReducedRate;
+    bool isRecordingFrameTimes;
+    bool wasRecordingFrameTimes;
+    NlClockMicros nextFrameAt;
+    NlClockMicros lastFrameAt;
+    NlFrameTimeStats stats;
+    NlClockMicros reportInterval;
+    NlClockMicros nextReportAt;
+    NlFrameTimeReport lastReport;
+    NlHistogram frameTimes;
+    Clog log;
+} NlFrameScheduler;
+
+void nlFrameSchedulerInit(NlFrameScheduler* self, NlFrameSchedulerMode mode, size_t targetFps, size_t lowPowerFps,
+                          Clog log);
+void nlFrameSchedulerSetLowPower(NlFrameScheduler* self, bool isLowPower);
+void nlFrameSchedulerSetReducedRate(NlFrameScheduler* self, bool isReducedRate);
+void nlFrameSchedulerSetRecordFrameTimes(NlFrameScheduler* self, bool isRecordingFrameTimes);
+void nlFrameSchedulerWaitForNextFrame(NlFrameScheduler* self);
+
+#endif
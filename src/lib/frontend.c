@@ -3,6 +3,7 @@
  *  Licensed under the MIT License. See LICENSE in the project root for license information.
  *--------------------------------------------------------------------------------------------*/
 #include "frontend.h"
+#include "thread_log.h"
 #include <clog/clog.h>
 #include <sdl-render/gamepad.h>
 
@@ -31,7 +32,7 @@ void nlFrontendHandleInput(NlFrontend* self, SrGamepad* gamepad)
         return;
     }
 
-    CLOG_VERBOSE("pressed verticalAxis: %d", verticalAxis)
+    NL_LOG_VERBOSE("pressed verticalAxis: %d", verticalAxis)
 
     if (verticalAxis == 1) {
         switch (self->mainMenuSelect) {
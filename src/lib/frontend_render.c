@@ -4,11 +4,13 @@
  *--------------------------------------------------------------------------------------------*/
 #include "frontend_render.h"
 #include "frontend.h"
+#include "text_cache.h"
 
-void nlFrontendRenderInit(NlFrontendRender* self, SrWindow* window, SrFont font)
+void nlFrontendRenderInit(NlFrontendRender* self, SrWindow* window, SrFont font, NlTextCache* textCache)
 {
     self->window = window;
     self->font = font;
+    self->textCache = textCache;
 
     self->defaultColor.g = 0x33;
     self->defaultColor.b = 0x44;
@@ -28,14 +30,14 @@ static SDL_Color selectColor(NlFrontendRender* render, bool isSelected)
 
 static void renderMainMenu(NlFrontendRender* self, const NlFrontend* frontend)
 {
-    srFontRenderAndCopy(&self->font, "Join LAN", 220, 230,
-                        selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectJoin));
-    srFontRenderAndCopy(&self->font, "Host LAN", 220, 190,
-                        selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectHost));
-    srFontRenderAndCopy(&self->font, "Join Online", 220, 150,
-                        selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectJoinOnline));
-    srFontRenderAndCopy(&self->font, "Host Online", 220, 110,
-                        selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectHostOnline));
+    nlTextCacheRender(self->textCache, &self->font, "Join LAN", 220, 230,
+                      selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectJoin));
+    nlTextCacheRender(self->textCache, &self->font, "Host LAN", 220, 190,
+                      selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectHost));
+    nlTextCacheRender(self->textCache, &self->font, "Join Online", 220, 150,
+                      selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectJoinOnline));
+    nlTextCacheRender(self->textCache, &self->font, "Host Online", 220, 110,
+                      selectColor(self, frontend->mainMenuSelect == NlFrontendMenuSelectHostOnline));
 }
 
 void nlFrontendRenderUpdate(NlFrontendRender* self, const NlFrontend* frontend)
@@ -9,15 +9,17 @@
 #include <sdl-render/window.h>
 
 struct NlFrontend;
+struct NlTextCache;
 
 typedef struct NlFrontendRender {
     SrWindow* window;
     SDL_Color defaultColor;
     SDL_Color selectedColor;
     SrFont font;
+    struct NlTextCache* textCache;
 } NlFrontendRender;
 
-void nlFrontendRenderInit(NlFrontendRender* self, SrWindow* window, SrFont font);
+void nlFrontendRenderInit(NlFrontendRender* self, SrWindow* window, SrFont font, struct NlTextCache* textCache);
 void nlFrontendRenderUpdate(NlFrontendRender* self, const struct NlFrontend* frontend);
 
 #endif
@@ -0,0 +1,111 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "histogram.h"
+#include "thread_log.h"
+#include <tiny-libc/tiny_libc.h>
+
+static const uint64_t nlHistogramHalfSubBucketCount = NL_HISTOGRAM_SUB_BUCKET_COUNT / 2;
+
+static unsigned int mostSignificantBit(uint64_t value)
+{
+#if defined __GNUC__
+    return 63U - (unsigned int) __builtin_clzll(value);
+#else
+    unsigned int bit = 0U;
+    while (value >>= 1U) {
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/// Values below the sub bucket count map to themselves. Larger values keep their
+/// NL_HISTOGRAM_SUB_BUCKET_BITS most significant bits, shifted by how many bits were dropped.
+static size_t bucketIndex(uint64_t value)
+{
+    if (value < NL_HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (size_t) value;
+    }
+
+    unsigned int shift = mostSignificantBit(value) - NL_HISTOGRAM_SUB_BUCKET_BITS + 1U;
+    return (size_t) (shift * nlHistogramHalfSubBucketCount + (value >> shift));
+}
+
+/// @return the value in the middle of the bucket, at most half a bucket width from any value that maps to it
+static uint64_t bucketMiddleValue(size_t index)
+{
+    if (index < NL_HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (uint64_t) index;
+    }
+
+    uint64_t shift = index / nlHistogramHalfSubBucketCount - 1U;
+    uint64_t subBucket = index - shift * nlHistogramHalfSubBucketCount;
+
+    return (subBucket << shift) + (((uint64_t) 1U << shift) >> 1U);
+}
+
+void nlHistogramInit(NlHistogram* self)
+{
+    tc_mem_clear_type(self);
+}
+
+void nlHistogramRecord(NlHistogram* self, uint64_t value)
+{
+    self->counts[bucketIndex(value)]++;
+    self->totalCount++;
+    if (value > self->max) {
+        self->max = value;
+    }
+}
+
+/// Finds the value that the given percentage of all recorded values are at or below
+/// @param self histogram
+/// @param percentile 0 to 100
+/// @return value, or zero if nothing has been recorded
+uint64_t nlHistogramValueAtPercentile(const NlHistogram* self, double percentile)
+{
+    if (self->totalCount == 0U) {
+        return 0U;
+    }
+
+    uint64_t targetCount = (uint64_t) (percentile / 100.0 * (double) self->totalCount + 0.5);
+    if (targetCount == 0U) {
+        targetCount = 1U;
+    }
+
+    uint64_t count = 0U;
+    for (size_t i = 0U; i < NL_HISTOGRAM_BUCKET_COUNT; ++i) {
+        count += self->counts[i];
+        if (count >= targetCount) {
+            uint64_t value = bucketMiddleValue(i);
+            return value < self->max ? value : self->max;
+        }
+    }
+
+    return self->max;
+}
+
+void nlHistogramReport(const NlHistogram* self, NlHistogramReport* report)
+{
+    report->count = self->totalCount;
+    report->p50 = nlHistogramValueAtPercentile(self, 50.0);
+    report->p95 = nlHistogramValueAtPercentile(self, 95.0);
+    report->p99 = nlHistogramValueAtPercentile(self, 99.0);
+    report->max = self->max;
+}
+
+/// Logs the count, p50, p95, p99 and max
+/// @param self histogram
+/// @param name what was recorded
+/// @param unit unit of the values
+/// @param log log
+void nlHistogramLog(const NlHistogram* self, const char* name, const char* unit, Clog* log)
+{
+    NlHistogramReport report;
+    nlHistogramReport(self, &report);
+    NL_LOG_C_INFO(log, "%s (%s) count:%llu p50:%llu p95:%llu p99:%llu max:%llu", name, unit,
+                  (unsigned long long) report.count, (unsigned long long) report.p50, (unsigned long long) report.p95,
+                  (unsigned long long) report.p99, (unsigned long long) report.max)
+}
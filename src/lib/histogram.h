@@ -0,0 +1,40 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_HISTOGRAM_H
+#define NIMBLE_BALL_HISTOGRAM_H
+
+#include <clog/clog.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_HISTOGRAM_SUB_BUCKET_BITS (5)
+#define NL_HISTOGRAM_SUB_BUCKET_COUNT (1 << NL_HISTOGRAM_SUB_BUCKET_BITS)
+#define NL_HISTOGRAM_BUCKET_COUNT ((64 - NL_HISTOGRAM_SUB_BUCKET_BITS + 2) * (NL_HISTOGRAM_SUB_BUCKET_COUNT / 2))
+
+typedef struct NlHistogramReport {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p95;
+    uint64_t p99;
+    uint64_t max;
+} NlHistogramReport;
+
+/// Log-linear (HDR style) histogram of unsigned values. Values below NL_HISTOGRAM_SUB_BUCKET_COUNT are exact.
+/// A larger value shares a bucket that is at most 1/16 (6.25%) of its lowest value wide, and is reported as the
+/// middle of the bucket, so within about 3%. Uses the same memory no matter how many values are recorded,
+/// so it can run for a complete session. Not thread safe.
+typedef struct NlHistogram {
+    uint64_t counts[NL_HISTOGRAM_BUCKET_COUNT];
+    uint64_t totalCount;
+    uint64_t max;
+} NlHistogram;
+
+void nlHistogramInit(NlHistogram* self);
+void nlHistogramRecord(NlHistogram* self, uint64_t value);
+uint64_t nlHistogramValueAtPercentile(const NlHistogram* self, double percentile);
+void nlHistogramReport(const NlHistogram* self, NlHistogramReport* report);
+void nlHistogramLog(const NlHistogram* self, const char* name, const char* unit, Clog* log);
+
+#endif
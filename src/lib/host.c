@@ -0,0 +1,155 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "host.h"
+#include "thread_log.h"
+#include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
+#include <nimble-engine-client/client.h>
+
+/// Fills in the host setup with the values used for LAN games
+/// @param self host setup
+/// @param applicationVersion version reported to joining clients
+/// @param allocator allocator
+/// @param allocatorWithFree allocator with free
+void nlAppHostSetupInit(NlAppHostSetup* self, NimbleSerializeVersion applicationVersion,
+                        struct ImprintAllocator* allocator, struct ImprintAllocatorWithFree* allocatorWithFree)
+{
+    self->allocator = allocator;
+    self->allocatorWithFree = allocatorWithFree;
+    self->applicationVersion = applicationVersion;
+    self->maxConnectionCount = 4U;
+    self->maxParticipantCount = 2U;
+    self->maxParticipantCountForEachConnection = 1U;
+    self->maxWaitingForReconnectTicks = 62U * 20U;
+}
+
+/// Initializes a multi datagram transport stack
+/// @param multi transport stack
+/// @param mode which transport stack to use
+/// @param allocator allocator
+/// @param allocatorWithFree allocator with free
+static void initializeTransportStackMulti(TransportStackMulti* multi, TransportStackMode mode,
+                                          struct ImprintAllocator* allocator,
+                                          struct ImprintAllocatorWithFree* allocatorWithFree)
+{
+    Clog multiLog;
+    multiLog.config = &g_clog;
+    multiLog.constantPrefix = "multi";
+
+    transportStackMultiInit(multi, allocator, allocatorWithFree, mode, multiLog);
+}
+
+/// Initializes a nimble server with an empty game on any multi transport
+/// @param server nimble server
+/// @param multiTransport transport the server receives from and sends to
+/// @param setup host setup
+/// @param log log
+/// @return negative on error
+int nlAppHostInitServer(NimbleServer* server, DatagramTransportMulti multiTransport, const NlAppHostSetup* setup,
+                        Clog log)
+{
+    Clog serverLog;
+    serverLog.config = &g_clog;
+    serverLog.constantPrefix = "NimbleServer";
+
+    NimbleServerSetup serverSetup;
+    serverSetup.maxSingleParticipantStepOctetCount = sizeof(NlPlayerInput);
+    serverSetup.maxParticipantCount = setup->maxParticipantCount;
+    serverSetup.maxConnectionCount = setup->maxConnectionCount;
+    serverSetup.maxParticipantCountForEachConnection = setup->maxParticipantCountForEachConnection;
+    serverSetup.maxWaitingForReconnectTicks = setup->maxWaitingForReconnectTicks;
+    serverSetup.maxGameStateOctetCount = sizeof(NlGame);
+    serverSetup.memory = setup->allocator;
+    serverSetup.blobAllocator = setup->allocatorWithFree;
+    serverSetup.applicationVersion = setup->applicationVersion;
+    serverSetup.now = monotonicTimeMsNow();
+    serverSetup.log = serverLog;
+    serverSetup.multiTransport = multiTransport;
+    int errorCode = nimbleServerInit(server, serverSetup);
+    if (errorCode < 0) {
+        NL_LOG_C_ERROR(&log, "could not initialize nimble server %d", errorCode)
+        return errorCode;
+    }
+    NL_LOG_C_INFO(&log, "nimble server is initialized")
+
+    NlGame initialServerState;
+    nlGameInit(&initialServerState);
+    // We just add a completely empty game. But it could be setup
+    // with specific rules or game mode or similar
+    // Since the whole game is blittable structs with no pointers, we can just cast it to an (uint8_t*)
+    StepId stepId = 0xcafeU;
+    nimbleServerReInitWithGame(server, (const uint8_t*) &initialServerState, sizeof(initialServerState), stepId,
+                               monotonicTimeMsNow());
+
+    NL_LOG_C_INFO(&log, "nimble server has initial game state. octet count: %zu", server->game.latestState.octetCount)
+
+    return 0;
+}
+
+/// Initializes the nimble server on the previously setup multi transport
+/// @param self host
+/// @param setup host setup
+/// @return negative on error
+static int startHostingOnMultiTransport(NlAppHost* self, const NlAppHostSetup* setup)
+{
+    NL_LOG_C_INFO(&self->log, "wrapped udp server to handle connections")
+
+    return nlAppHostInitServer(&self->nimbleServer, self->multiTransport.multiTransport, setup, self->log);
+}
+
+/// Initializes a multi transport, listens on it and starts a nimble server on top of it
+/// @param self host
+/// @param hostname hostname to listen on. Empty string for any interface
+/// @param port port to listen on
+/// @param transportStackMode which transport stack to use
+/// @param setup host setup
+/// @return negative on error
+int nlAppHostInit(NlAppHost* self, const char* hostname, uint16_t port, TransportStackMode transportStackMode,
+                  const NlAppHostSetup* setup)
+{
+    self->log.config = &g_clog;
+    self->log.constantPrefix = "Host";
+
+    initializeTransportStackMulti(&self->multiTransport, transportStackMode, setup->allocator,
+                                  setup->allocatorWithFree);
+    transportStackMultiListen(&self->multiTransport, hostname, port);
+
+    return startHostingOnMultiTransport(self, setup);
+}
+
+/// Updates the transport stack and the nimble server
+/// @param self host
+/// @param now current monotonic time
+void nlAppHostUpdate(NlAppHost* self, MonotonicTimeMs now)
+{
+    transportStackMultiUpdate(&self->multiTransport);
+    nimbleServerUpdate(&self->nimbleServer, now);
+}
+
+/// Checks if the nimble server needs a new game state from the application
+/// @param self host
+/// @return true if a game state must be provided
+bool nlAppHostMustProvideGameState(const NlAppHost* self)
+{
+    return nimbleServerMustProvideGameState(&self->nimbleServer);
+}
+
+/// Sets the authoritative state that the engine client has simulated to the nimble server
+/// @param self host
+/// @param client a synced nimble engine client
+void nlAppHostProvideGameStateFromClient(NlAppHost* self, const NimbleEngineClient* client)
+{
+    nlAppHostServerProvideGameStateFromClient(&self->nimbleServer, client);
+}
+
+/// Sets the authoritative state that the engine client has simulated to any nimble server
+/// @param server nimble server
+/// @param client a synced nimble engine client
+void nlAppHostServerProvideGameStateFromClient(NimbleServer* server, const NimbleEngineClient* client)
+{
+    StepId outStepId;
+    TransmuteState authoritativeState = assentGetState(&client->rectify.authoritative, &outStepId);
+    CLOG_ASSERT(authoritativeState.octetSize == sizeof(NlGame), "illegal authoritative state")
+    nimbleServerSetGameState(server, authoritativeState.state, authoritativeState.octetSize, outStepId);
+}
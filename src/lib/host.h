@@ -0,0 +1,42 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_HOST_H
+#define NIMBLE_BALL_HOST_H
+
+#include <monotonic-time/monotonic_time.h>
+#include <nimble-server/server.h>
+#include <transport-stack/multi.h>
+
+struct NimbleEngineClient;
+
+typedef struct NlAppHostSetup {
+    struct ImprintAllocator* allocator;
+    struct ImprintAllocatorWithFree* allocatorWithFree;
+    NimbleSerializeVersion applicationVersion;
+    size_t maxConnectionCount;
+    size_t maxParticipantCount;
+    size_t maxParticipantCountForEachConnection;
+    size_t maxWaitingForReconnectTicks;
+} NlAppHostSetup;
+
+/// Nimble server and transport stack
+typedef struct NlAppHost {
+    NimbleServer nimbleServer;
+    TransportStackMulti multiTransport;
+    Clog log;
+} NlAppHost;
+
+void nlAppHostSetupInit(NlAppHostSetup* self, NimbleSerializeVersion applicationVersion,
+                        struct ImprintAllocator* allocator, struct ImprintAllocatorWithFree* allocatorWithFree);
+int nlAppHostInitServer(NimbleServer* server, DatagramTransportMulti multiTransport, const NlAppHostSetup* setup,
+                        Clog log);
+int nlAppHostInit(NlAppHost* self, const char* hostname, uint16_t port, TransportStackMode transportStackMode,
+                  const NlAppHostSetup* setup);
+void nlAppHostUpdate(NlAppHost* self, MonotonicTimeMs now);
+bool nlAppHostMustProvideGameState(const NlAppHost* self);
+void nlAppHostProvideGameStateFromClient(NlAppHost* self, const struct NimbleEngineClient* client);
+void nlAppHostServerProvideGameStateFromClient(NimbleServer* server, const struct NimbleEngineClient* client);
+
+#endif
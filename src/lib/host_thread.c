@@ -0,0 +1,122 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "host_thread.h"
+#include "host.h"
+#include "thread_log.h"
+#include "tick_scheduler.h"
+#include "trace.h"
+#include <nimble-engine-client/client.h>
+
+static void hostThreadProvideGameStateIfAvailable(NlHostThread* self)
+{
+    if (!nlTripleBufferConsume(&self->gameStateMailbox)) {
+        return;
+    }
+
+    const NlHostGameState* offered = (const NlHostGameState*) nlTripleBufferReadSlot(&self->gameStateMailbox);
+    // An offer can be published just after the previous request was fulfilled, never go back in time
+    if (self->hasProvidedGameState && offered->stepId <= self->lastProvidedStepId) {
+        return;
+    }
+    self->hasProvidedGameState = true;
+    self->lastProvidedStepId = offered->stepId;
+    nimbleServerSetGameState(&self->host->nimbleServer, &offered->game, sizeof(offered->game), offered->stepId);
+    atomic_store_explicit(&self->wantsGameState, false, memory_order_release);
+}
+
+static void hostThreadRun(void* _self)
+{
+    NlHostThread* self = (NlHostThread*) _self;
+
+    NL_TRACE_THREAD_NAME("host")
+
+    NlTickScheduler tickScheduler;
+    nlTickSchedulerInit(&tickScheduler, self->tickDuration, nlClockNowMicros());
+
+    while (atomic_load_explicit(&self->isRunning, memory_order_acquire)) {
+        nlTickSchedulerWaitForNextTick(&tickScheduler);
+        NlClockMicros tickStartedAt = nlClockNowMicros();
+        // The nimble server steps on wall clock time, so a late tick is only run once
+        if (nlTickSchedulerTicksDue(&tickScheduler, tickStartedAt) == 0U) {
+            continue;
+        }
+
+        NL_TRACE_BEGIN("hostTick")
+        hostThreadProvideGameStateIfAvailable(self);
+
+        nlAppHostUpdate(self->host, monotonicTimeMsNow());
+
+        if (nlAppHostMustProvideGameState(self->host)) {
+            atomic_store_explicit(&self->wantsGameState, true, memory_order_release);
+        }
+        NL_TRACE_END()
+
+        NlClockMicros tickDuration = nlClockNowMicros() - tickStartedAt;
+        if (tickDuration > atomic_load_explicit(&self->maxTickDurationMicros, memory_order_relaxed)) {
+            atomic_store_explicit(&self->maxTickDurationMicros, tickDuration, memory_order_relaxed);
+        }
+    }
+}
+
+/// Starts ticking an already initialized host on a separate thread
+/// @param self host thread
+/// @param host initialized host. Must not be used by the calling thread until nlHostThreadStop()
+/// @param tickDuration duration between host updates in microseconds
+/// @return negative on error
+int nlHostThreadStart(NlHostThread* self, NlAppHost* host, NlClockMicros tickDuration)
+{
+    self->host = host;
+    self->tickDuration = tickDuration;
+    atomic_init(&self->isRunning, true);
+    atomic_init(&self->wantsGameState, false);
+    atomic_init(&self->maxTickDurationMicros, 0U);
+    self->hasProvidedGameState = false;
+    self->lastProvidedStepId = 0;
+    nlTripleBufferInit(&self->gameStateMailbox, self->gameStateSlots, sizeof(self->gameStateSlots[0]));
+
+    int result = nlThreadCreate(&self->thread, hostThreadRun, self);
+    if (result < 0) {
+        NL_LOG_C_ERROR(&host->log, "could not start host thread")
+        return result;
+    }
+
+    NL_LOG_C_INFO(&host->log, "host is running on its own thread. tick duration %d us", (int) tickDuration)
+
+    return 0;
+}
+
+/// Stops and joins the host thread
+/// @param self host thread
+void nlHostThreadStop(NlHostThread* self)
+{
+    atomic_store_explicit(&self->isRunning, false, memory_order_release);
+    nlThreadJoin(&self->thread);
+
+    NL_LOG_C_INFO(&self->host->log, "host thread stopped. longest tick %d us",
+                  (int) atomic_load(&self->maxTickDurationMicros))
+}
+
+/// Checks if the nimble server on the host thread has asked for a game state
+/// @param self host thread
+/// @return true if a game state should be offered
+bool nlHostThreadWantsGameState(const NlHostThread* self)
+{
+    return atomic_load_explicit(&self->wantsGameState, memory_order_acquire);
+}
+
+/// Copies the authoritative state of a synced client into the mailbox. Only call from one thread.
+/// @param self host thread
+/// @param client a synced nimble engine client
+void nlHostThreadOfferGameStateFromClient(NlHostThread* self, const NimbleEngineClient* client)
+{
+    StepId outStepId;
+    TransmuteState authoritativeState = assentGetState(&client->rectify.authoritative, &outStepId);
+    CLOG_ASSERT(authoritativeState.octetSize == sizeof(NlGame), "illegal authoritative state")
+
+    NlHostGameState* slot = (NlHostGameState*) nlTripleBufferWriteSlot(&self->gameStateMailbox);
+    slot->stepId = outStepId;
+    tc_memcpy_octets(&slot->game, authoritativeState.state, sizeof(slot->game));
+    nlTripleBufferPublish(&self->gameStateMailbox);
+}
@@ -0,0 +1,43 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_HOST_THREAD_H
+#define NIMBLE_BALL_HOST_THREAD_H
+
+#include "clock.h"
+#include "thread.h"
+#include "triple_buffer.h"
+#include <nimble-ball-simulation/nimble_ball_simulation.h>
+#include <nimble-steps/steps.h>
+
+struct NlAppHost;
+struct NimbleEngineClient;
+
+typedef struct NlHostGameState {
+    StepId stepId;
+    NlGame game;
+} NlHostGameState;
+
+/// Runs a NlAppHost on a dedicated thread at a fixed tick rate.
+/// After start, the host must only be touched from the host thread, the game state
+/// requested by the nimble server is handed over through a triple buffer mailbox.
+typedef struct NlHostThread {
+    struct NlAppHost* host;
+    NlThread thread;
+    NlClockMicros tickDuration;
+    atomic_bool isRunning;
+    atomic_bool wantsGameState;
+    atomic_uint_fast64_t maxTickDurationMicros;
+    bool hasProvidedGameState;
+    StepId lastProvidedStepId;
+    NlTripleBuffer gameStateMailbox;
+    NlHostGameState gameStateSlots[3];
+} NlHostThread;
+
+int nlHostThreadStart(NlHostThread* self, struct NlAppHost* host, NlClockMicros tickDuration);
+void nlHostThreadStop(NlHostThread* self);
+bool nlHostThreadWantsGameState(const NlHostThread* self);
+void nlHostThreadOfferGameStateFromClient(NlHostThread* self, const struct NimbleEngineClient* client);
+
+#endif
@@ -0,0 +1,143 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "hud.h"
+#include <clog/clog.h>
+#include <string.h>
+
+static int createTarget(NlHud* self)
+{
+    self->target = SDL_CreateTexture(self->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, self->width,
+                                     self->height);
+    if (self->target == 0) {
+        CLOG_WARN("could not create hud render target %d x %d", self->width, self->height)
+        return -1;
+    }
+    SDL_SetTextureBlendMode(self->target, SDL_BLENDMODE_BLEND);
+    self->isDirty = true;
+
+    return 0;
+}
+
+/// Called by SDL when an event is pushed, possibly from another thread
+static int watchRenderEvents(void* _self, SDL_Event* event)
+{
+    NlHud* self = (NlHud*) _self;
+    if (event->type == SDL_RENDER_TARGETS_RESET || event->type == SDL_RENDER_DEVICE_RESET) {
+        atomic_store(&self->isTargetLost, true);
+    }
+    return 0;
+}
+
+/// Creates the offscreen target the layers are rendered into
+/// @param self hud
+/// @param renderer renderer
+/// @param width width of the target, same as the logical width of the window
+/// @param height height of the target, same as the logical height of the window
+/// @return negative on error
+int nlHudInit(NlHud* self, SDL_Renderer* renderer, int width, int height)
+{
+    self->renderer = renderer;
+    self->width = width;
+    self->height = height;
+    self->layerCount = 0U;
+    self->stateOctetCount = 0U;
+    self->isDirty = true;
+    self->redrawCount = 0U;
+    atomic_init(&self->isTargetLost, false);
+
+    if (createTarget(self) < 0) {
+        return -1;
+    }
+    SDL_AddEventWatch(watchRenderEvents, self);
+
+    return 0;
+}
+
+void nlHudDestroy(NlHud* self)
+{
+    if (self->target != 0) {
+        SDL_DelEventWatch(watchRenderEvents, self);
+        SDL_DestroyTexture(self->target);
+        self->target = 0;
+    }
+}
+
+/// Adds a layer. Layers are rendered in the order they are added.
+/// @param self hud
+/// @param name name of the layer, for debugging
+/// @param renderFn renders the layer
+/// @param layerSelf passed to renderFn
+/// @param stateOctetCount size of the state. Must not contain uninitialized padding
+/// @return layer index to use with nlHudSetLayerState()
+size_t nlHudAddLayer(NlHud* self, const char* name, NlHudLayerRenderFn renderFn, void* layerSelf,
+                     size_t stateOctetCount)
+{
+    CLOG_ASSERT(self->layerCount < NL_HUD_MAX_LAYERS, "too many hud layers")
+    CLOG_ASSERT(self->stateOctetCount + stateOctetCount <= NL_HUD_STATE_CAPACITY, "out of hud state memory")
+
+    NlHudLayer* layer = &self->layers[self->layerCount];
+    layer->name = name;
+    layer->renderFn = renderFn;
+    layer->self = layerSelf;
+    layer->state = &self->stateOctets[self->stateOctetCount];
+    layer->stateOctetCount = stateOctetCount;
+    tc_memset_octets(layer->state, 0, stateOctetCount);
+
+    self->stateOctetCount += stateOctetCount;
+    self->isDirty = true;
+
+    return self->layerCount++;
+}
+
+/// Hands the layer its state for this frame. The hud is marked for redraw only if it differs
+/// from the previous one.
+/// @param self hud
+/// @param layerIndex index returned from nlHudAddLayer()
+/// @param state the complete state needed to render the layer
+void nlHudSetLayerState(NlHud* self, size_t layerIndex, const void* state)
+{
+    NlHudLayer* layer = &self->layers[layerIndex];
+    if (memcmp(layer->state, state, layer->stateOctetCount) == 0) {
+        return;
+    }
+
+    tc_memcpy_octets(layer->state, state, layer->stateOctetCount);
+    self->isDirty = true;
+}
+
+/// Redraws the offscreen target if any layer has changed and copies it to the current render target
+/// @param self hud
+void nlHudRender(NlHud* self)
+{
+    if (self->target == 0) {
+        return;
+    }
+
+    if (atomic_exchange(&self->isTargetLost, false)) {
+        SDL_DestroyTexture(self->target);
+        if (createTarget(self) < 0) {
+            SDL_DelEventWatch(watchRenderEvents, self);
+            return;
+        }
+    }
+
+    if (self->isDirty) {
+        SDL_Texture* previousTarget = SDL_GetRenderTarget(self->renderer);
+        SDL_SetRenderTarget(self->renderer, self->target);
+        SDL_SetRenderDrawColor(self->renderer, 0, 0, 0, 0);
+        SDL_RenderClear(self->renderer);
+
+        for (size_t i = 0U; i < self->layerCount; ++i) {
+            const NlHudLayer* layer = &self->layers[i];
+            layer->renderFn(layer->self, layer->state);
+        }
+
+        SDL_SetRenderTarget(self->renderer, previousTarget);
+        self->isDirty = false;
+        self->redrawCount++;
+    }
+
+    SDL_RenderCopy(self->renderer, self->target, 0, 0);
+}
@@ -0,0 +1,52 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_HUD_H
+#define NIMBLE_BALL_HUD_H
+
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_HUD_MAX_LAYERS (8)
+#define NL_HUD_STATE_CAPACITY (8 * 1024)
+
+/// Renders a layer from a copy of the state it was last given
+typedef void (*NlHudLayerRenderFn)(void* self, const void* state);
+
+typedef struct NlHudLayer {
+    const char* name;
+    NlHudLayerRenderFn renderFn;
+    void* self;
+    uint8_t* state;
+    size_t stateOctetCount;
+} NlHudLayer;
+
+/// Composites overlay layers into an offscreen target. The target is only redrawn when the state of
+/// a layer has changed, otherwise the frame costs a single copy no matter how many layers there are.
+/// The target is recreated and redrawn when the renderer reports that render targets were lost.
+typedef struct NlHud {
+    SDL_Renderer* renderer;
+    SDL_Texture* target;
+    atomic_bool isTargetLost;
+    int width;
+    int height;
+    NlHudLayer layers[NL_HUD_MAX_LAYERS];
+    size_t layerCount;
+    uint8_t stateOctets[NL_HUD_STATE_CAPACITY];
+    size_t stateOctetCount;
+    bool isDirty;
+    size_t redrawCount;
+} NlHud;
+
+int nlHudInit(NlHud* self, SDL_Renderer* renderer, int width, int height);
+void nlHudDestroy(NlHud* self);
+size_t nlHudAddLayer(NlHud* self, const char* name, NlHudLayerRenderFn renderFn, void* layerSelf,
+                     size_t stateOctetCount);
+void nlHudSetLayerState(NlHud* self, size_t layerIndex, const void* state);
+void nlHudRender(NlHud* self);
+
+#endif
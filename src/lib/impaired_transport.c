@@ -0,0 +1,478 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "impaired_transport.h"
+#include <clog/clog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tiny-libc/tiny_libc.h>
+
+/// Reads a profile file, see NlImpairmentProfile for the format
+/// @param self profile
+/// @param filename text file
+/// @return negative on error
+int nlImpairmentProfileLoad(NlImpairmentProfile* self, const char* filename)
+{
+    tc_mem_clear_type(self);
+
+    FILE* file = fopen(filename, "r");
+    if (file == 0) {
+        CLOG_WARN("could not open impairment profile '%s'", filename)
+        return -1;
+    }
+
+    NlImpairmentStep current;
+    tc_mem_clear_type(&current);
+    current.lossBurst = 1U;
+
+    char line[256];
+    size_t lineNumber = 0U;
+    int result = 0;
+    while (fgets(line, sizeof(line), file) != 0) {
+        lineNumber++;
+        char* comment = strchr(line, '#');
+        if (comment != 0) {
+            *comment = 0;
+        }
+
+        char* token = strtok(line, " \t\r\n");
+        if (token == 0) {
+            continue;
+        }
+
+        NlClockMicros startsAt = (NlClockMicros) (strtod(token, 0) * 1000000.0);
+        if (self->stepCount > 0U && startsAt < self->steps[self->stepCount - 1].startsAt) {
+            CLOG_WARN("impairment profile '%s':%zu steps must be in time order", filename, lineNumber)
+            result = -2;
+            break;
+        }
+
+        bool isStep = true;
+        while ((token = strtok(0, " \t\r\n")) != 0) {
+            char* value = strchr(token, '=');
+            if (strcmp(token, "loop") == 0) {
+                self->loopAt = startsAt;
+                isStep = false;
+                continue;
+            }
+            if (value == 0) {
+                result = -3;
+                break;
+            }
+            *value++ = 0;
+            double number = strtod(value, 0);
+            if (strcmp(token, "latency") == 0) {
+                current.latency = (NlClockMicros) (number * 1000.0);
+            } else if (strcmp(token, "jitter") == 0) {
+                current.jitter = (NlClockMicros) (number * 1000.0);
+            } else if (strcmp(token, "loss") == 0) {
+                current.lossPerMille = (uint32_t) (number * 10.0);
+            } else if (strcmp(token, "burst") == 0) {
+                current.lossBurst = number >= 1.0 ? (size_t) number : 1U;
+            } else if (strcmp(token, "reorder") == 0) {
+                current.reorderPerMille = (uint32_t) (number * 10.0);
+            } else if (strcmp(token, "bandwidth") == 0) {
+                current.bandwidth = (size_t) (number * 1000.0 / 8.0);
+            } else {
+                result = -3;
+                break;
+            }
+        }
+        if (result < 0) {
+            CLOG_WARN("impairment profile '%s':%zu unknown setting '%s'", filename, lineNumber, token)
+            break;
+        }
+
+        if (!isStep) {
+            continue;
+        }
+        if (self->stepCount == NL_IMPAIRMENT_MAX_STEPS) {
+            CLOG_WARN("impairment profile '%s' has more than %d steps", filename, NL_IMPAIRMENT_MAX_STEPS)
+            result = -4;
+            break;
+        }
+        current.startsAt = startsAt;
+        self->steps[self->stepCount++] = current;
+    }
+
+    fclose(file);
+
+    return result;
+}
+
+static uint32_t nextRandom(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static const NlImpairmentStep* currentStep(const NlImpairment* self, NlClockMicros now)
+{
+    static const NlImpairmentStep unimpaired = {0U, 0U, 0U, 0U, 1U, 0U, 0U};
+    const NlImpairmentProfile* profile = self->profile;
+
+    NlClockMicros time = now - self->startedAt;
+    if (profile->loopAt > 0U) {
+        time %= profile->loopAt;
+    }
+
+    const NlImpairmentStep* step = &unimpaired;
+    for (size_t i = 0U; i < profile->stepCount && profile->steps[i].startsAt <= time; ++i) {
+        step = &profile->steps[i];
+    }
+
+    return step;
+}
+
+static void linkReset(NlImpairmentLink* self, uint32_t seed, size_t index)
+{
+    // Every connection has its own sequence. The first one uses the seed of the direction as it is.
+    uint32_t random = seed ^ (uint32_t) index * 0x85ebca6bU;
+    self->random = random != 0U ? random : 1U;
+    self->linkFreeAt = 0U;
+    self->burstLeft = 0U;
+}
+
+static void laneReset(NlImpairmentLane* self, uint32_t seed)
+{
+    self->seed = seed;
+    self->count = 0U;
+    self->pushedCount = 0U;
+    for (size_t i = 0U; i < self->capacity; ++i) {
+        self->freeSlots[i] = self->capacity - 1U - i;
+    }
+    for (size_t i = 0U; i < self->linkCount; ++i) {
+        linkReset(&self->links[i], seed, i);
+    }
+}
+
+static void laneInit(NlImpairmentLane* self, size_t capacity, size_t linkCount)
+{
+    self->datagrams = (NlImpairedDatagram*) tc_malloc(sizeof(NlImpairedDatagram) * capacity);
+    self->entries = (NlImpairedDatagramEntry*) tc_malloc(sizeof(NlImpairedDatagramEntry) * capacity);
+    self->freeSlots = (size_t*) tc_malloc(sizeof(size_t) * capacity);
+    self->capacity = capacity;
+    self->links = (NlImpairmentLink*) tc_malloc(sizeof(NlImpairmentLink) * linkCount);
+    self->linkCount = linkCount;
+    self->passedCount = 0U;
+    self->droppedCount = 0U;
+    self->reorderedCount = 0U;
+}
+
+static void laneDestroy(NlImpairmentLane* self)
+{
+    tc_free(self->datagrams);
+    tc_free(self->entries);
+    tc_free(self->freeSlots);
+    tc_free(self->links);
+    self->datagrams = 0;
+    self->entries = 0;
+    self->freeSlots = 0;
+    self->links = 0;
+}
+
+static NlImpairmentLink* laneLink(NlImpairmentLane* self, int connectionId)
+{
+    // Connection ids beyond the link count share links, the datagrams are still delivered
+    return &self->links[(size_t) connectionId % self->linkCount];
+}
+
+/// Datagrams with the same delivery time keep the order they were pushed in
+static bool isEarlier(const NlImpairedDatagramEntry* a, const NlImpairedDatagramEntry* b)
+{
+    return a->deliverAt < b->deliverAt || (a->deliverAt == b->deliverAt && a->sequence < b->sequence);
+}
+
+static void laneSiftUp(NlImpairmentLane* self, size_t index)
+{
+    NlImpairedDatagramEntry entry = self->entries[index];
+    while (index > 0U) {
+        size_t parent = (index - 1U) / 2U;
+        if (!isEarlier(&entry, &self->entries[parent])) {
+            break;
+        }
+        self->entries[index] = self->entries[parent];
+        index = parent;
+    }
+    self->entries[index] = entry;
+}
+
+static void laneSiftDown(NlImpairmentLane* self, size_t index)
+{
+    NlImpairedDatagramEntry entry = self->entries[index];
+    for (;;) {
+        size_t child = index * 2U + 1U;
+        if (child >= self->count) {
+            break;
+        }
+        if (child + 1U < self->count && isEarlier(&self->entries[child + 1U], &self->entries[child])) {
+            child++;
+        }
+        if (!isEarlier(&self->entries[child], &entry)) {
+            break;
+        }
+        self->entries[index] = self->entries[child];
+        index = child;
+    }
+    self->entries[index] = entry;
+}
+
+/// Decides if and when the datagram is delivered
+static void lanePush(NlImpairmentLane* self, NlImpairment* impairment, NlClockMicros now, int connectionId,
+                     const uint8_t* octets, size_t octetCount)
+{
+    NlImpairmentLink* link = laneLink(self, connectionId);
+    const NlImpairmentStep* step = currentStep(impairment, now);
+    uint32_t lossRandom = nextRandom(&link->random);
+    uint32_t jitterRandom = nextRandom(&link->random);
+    uint32_t reorderRandom = nextRandom(&link->random);
+
+    if (link->burstLeft > 0U) {
+        link->burstLeft--;
+        self->droppedCount++;
+        return;
+    }
+
+    if (step->lossPerMille > 0U && lossRandom % 1000U < step->lossPerMille) {
+        link->burstLeft = step->lossBurst - 1U;
+        self->droppedCount++;
+        return;
+    }
+
+    if (self->count == self->capacity || octetCount > NL_DATAGRAM_MAX_OCTET_COUNT) {
+        self->droppedCount++;
+        return;
+    }
+
+    NlClockMicros delay = step->latency;
+    if (step->jitter > 0U) {
+        delay += jitterRandom % (step->jitter + 1U);
+    }
+    if (step->reorderPerMille > 0U && reorderRandom % 1000U < step->reorderPerMille) {
+        // Held back long enough for the following datagrams to overtake it
+        delay += step->jitter + 5000U;
+        self->reorderedCount++;
+    }
+
+    if (step->bandwidth > 0U) {
+        NlClockMicros sendAt = link->linkFreeAt > now ? link->linkFreeAt : now;
+        link->linkFreeAt = sendAt + (NlClockMicros) octetCount * 1000000U / step->bandwidth;
+        delay += link->linkFreeAt - now;
+    }
+
+    size_t slot = self->freeSlots[self->capacity - self->count - 1U];
+    NlImpairedDatagram* datagram = &self->datagrams[slot];
+    datagram->connectionId = connectionId;
+    datagram->octetCount = octetCount;
+    tc_memcpy_octets(datagram->octets, octets, octetCount);
+
+    size_t index = self->count++;
+    self->entries[index].deliverAt = now + delay;
+    self->entries[index].sequence = self->pushedCount++;
+    self->entries[index].slot = slot;
+    laneSiftUp(self, index);
+}
+
+/// Removes the datagram with the earliest delivery time, if that time has passed
+/// @return octet count, zero if no datagram is due
+static int lanePopDue(NlImpairmentLane* self, NlClockMicros now, int* connectionId, uint8_t* target,
+                      size_t maxTargetOctetCount)
+{
+    if (self->count == 0U || self->entries[0].deliverAt > now) {
+        return 0;
+    }
+
+    size_t slot = self->entries[0].slot;
+    self->entries[0] = self->entries[--self->count];
+    if (self->count > 0U) {
+        laneSiftDown(self, 0U);
+    }
+    self->freeSlots[self->capacity - self->count - 1U] = slot;
+
+    const NlImpairedDatagram* datagram = &self->datagrams[slot];
+    if (datagram->octetCount > maxTargetOctetCount) {
+        return -1;
+    }
+    *connectionId = datagram->connectionId;
+    tc_memcpy_octets(target, datagram->octets, datagram->octetCount);
+    self->passedCount++;
+
+    return (int) datagram->octetCount;
+}
+
+/// Starts the profile from the beginning with the original random sequences
+static void impairmentStart(NlImpairment* self)
+{
+    self->startedAt = nlClockNowMicros();
+    laneReset(&self->outgoing, self->seed);
+    laneReset(&self->incoming, self->seed ^ 0x9e3779b9U);
+}
+
+static void impairmentInit(NlImpairment* self, const NlImpairmentProfile* profile, uint32_t seed,
+                           size_t laneCapacity, size_t connectionCount)
+{
+    self->profile = profile;
+    self->seed = seed;
+    laneInit(&self->outgoing, laneCapacity, connectionCount);
+    laneInit(&self->incoming, laneCapacity, connectionCount);
+    impairmentStart(self);
+}
+
+static void impairmentDestroy(NlImpairment* self)
+{
+    laneDestroy(&self->outgoing);
+    laneDestroy(&self->incoming);
+}
+
+static void flushOutgoing(NlImpairedTransport* self, NlClockMicros now)
+{
+    uint8_t datagram[NL_DATAGRAM_MAX_OCTET_COUNT];
+    int connectionId;
+    int octetCount;
+    while ((octetCount = lanePopDue(&self->impairment.outgoing, now, &connectionId, datagram, sizeof(datagram))) >
+           0) {
+        datagramTransportSend(&self->inner, datagram, (size_t) octetCount);
+    }
+}
+
+static int impairedSend(void* _self, const uint8_t* data, size_t octetCount)
+{
+    NlImpairedTransport* self = (NlImpairedTransport*) _self;
+    NlClockMicros now = nlClockNowMicros();
+
+    lanePush(&self->impairment.outgoing, &self->impairment, now, 0, data, octetCount);
+    flushOutgoing(self, now);
+
+    return 0;
+}
+
+static ssize_t impairedReceive(void* _self, uint8_t* data, size_t maxOctetCount)
+{
+    NlImpairedTransport* self = (NlImpairedTransport*) _self;
+    NlClockMicros now = nlClockNowMicros();
+
+    // Delayed datagrams must go out even if nothing new is sent
+    flushOutgoing(self, now);
+
+    uint8_t datagram[NL_DATAGRAM_MAX_OCTET_COUNT];
+    ssize_t receivedOctetCount;
+    while ((receivedOctetCount = datagramTransportReceive(&self->inner, datagram, sizeof(datagram))) > 0) {
+        lanePush(&self->impairment.incoming, &self->impairment, now, 0, datagram, (size_t) receivedOctetCount);
+    }
+
+    int connectionId;
+    return lanePopDue(&self->impairment.incoming, now, &connectionId, data, maxOctetCount);
+}
+
+/// Wraps a datagram transport. Use self->transport instead of the inner transport after this call.
+/// @param self impaired transport
+/// @param inner transport to forward to
+/// @param profile network conditions over time, must outlive the transport
+/// @param seed random seed for loss, jitter and reordering
+void nlImpairedTransportInit(NlImpairedTransport* self, DatagramTransport inner, const NlImpairmentProfile* profile,
+                             uint32_t seed)
+{
+    self->inner = inner;
+    self->transport.self = self;
+    self->transport.send = impairedSend;
+    self->transport.receive = impairedReceive;
+    impairmentInit(&self->impairment, profile, seed, NL_IMPAIRMENT_LANE_CAPACITY, 1U);
+}
+
+/// Switches to a new inner transport, e.g. for a new session. Datagrams that were delayed for the old transport are
+/// dropped and the profile and random sequences start over.
+/// @param self impaired transport
+/// @param inner transport to forward to
+void nlImpairedTransportRestart(NlImpairedTransport* self, DatagramTransport inner)
+{
+    self->inner = inner;
+    impairmentStart(&self->impairment);
+}
+
+void nlImpairedTransportDestroy(NlImpairedTransport* self)
+{
+    impairmentDestroy(&self->impairment);
+}
+
+static void flushOutgoingMulti(NlImpairedTransportMulti* self, NlClockMicros now)
+{
+    uint8_t datagram[NL_DATAGRAM_MAX_OCTET_COUNT];
+    int connectionId;
+    int octetCount;
+    while ((octetCount = lanePopDue(&self->impairment.outgoing, now, &connectionId, datagram, sizeof(datagram))) >
+           0) {
+        datagramTransportMultiSendTo(&self->inner, connectionId, datagram, (size_t) octetCount);
+    }
+}
+
+static int impairedSendTo(void* _self, int connectionId, const uint8_t* data, size_t octetCount)
+{
+    NlImpairedTransportMulti* self = (NlImpairedTransportMulti*) _self;
+    NlClockMicros now = nlClockNowMicros();
+
+    lanePush(&self->impairment.outgoing, &self->impairment, now, connectionId, data, octetCount);
+    flushOutgoingMulti(self, now);
+
+    return 0;
+}
+
+static int impairedReceiveFrom(void* _self, int* connectionId, uint8_t* data, size_t maxOctetCount)
+{
+    NlImpairedTransportMulti* self = (NlImpairedTransportMulti*) _self;
+    NlClockMicros now = nlClockNowMicros();
+
+    flushOutgoingMulti(self, now);
+
+    uint8_t datagram[NL_DATAGRAM_MAX_OCTET_COUNT];
+    int receivedConnectionId;
+    int receivedOctetCount;
+    while ((receivedOctetCount = datagramTransportMultiReceiveFrom(&self->inner, &receivedConnectionId, datagram,
+                                                                   sizeof(datagram))) > 0) {
+        lanePush(&self->impairment.incoming, &self->impairment, now, receivedConnectionId, datagram,
+                 (size_t) receivedOctetCount);
+    }
+
+    return lanePopDue(&self->impairment.incoming, now, connectionId, data, maxOctetCount);
+}
+
+/// Wraps a multi datagram transport. Use self->multiTransport instead of the inner transport after this call.
+/// @param self impaired transport
+/// @param inner transport to forward to
+/// @param profile network conditions over time, must outlive the transport
+/// @param seed random seed for loss, jitter and reordering
+void nlImpairedTransportMultiInit(NlImpairedTransportMulti* self, DatagramTransportMulti inner,
+                                  const NlImpairmentProfile* profile, uint32_t seed)
+{
+    self->inner = inner;
+    self->multiTransport.self = self;
+    self->multiTransport.sendTo = impairedSendTo;
+    self->multiTransport.receiveFrom = impairedReceiveFrom;
+    impairmentInit(&self->impairment, profile, seed, NL_IMPAIRMENT_MULTI_LANE_CAPACITY,
+                   NL_IMPAIRMENT_MULTI_MAX_CONNECTIONS);
+}
+
+/// Starts the links of a connection id over, e.g. when the id is given to a new connection. The random sequences
+/// start from the seed again, so a new connection sees the same conditions no matter which id it gets.
+/// Datagrams that are already delayed are still delivered.
+/// @param self impaired transport
+/// @param connectionId connection id
+void nlImpairedTransportMultiResetConnection(NlImpairedTransportMulti* self, int connectionId)
+{
+    if (connectionId < 0) {
+        return;
+    }
+    size_t index = (size_t) connectionId % NL_IMPAIRMENT_MULTI_MAX_CONNECTIONS;
+    linkReset(&self->impairment.outgoing.links[index], self->impairment.outgoing.seed, index);
+    linkReset(&self->impairment.incoming.links[index], self->impairment.incoming.seed, index);
+}
+
+void nlImpairedTransportMultiDestroy(NlImpairedTransportMulti* self)
+{
+    impairmentDestroy(&self->impairment);
+}
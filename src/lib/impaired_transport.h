@@ -0,0 +1,117 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_IMPAIRED_TRANSPORT_H
+#define NIMBLE_BALL_IMPAIRED_TRANSPORT_H
+
+#include "clock.h"
+#include "datagram_queue.h"
+#include <datagram-transport/multi.h>
+#include <datagram-transport/transport.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_IMPAIRMENT_MAX_STEPS (32)
+#define NL_IMPAIRMENT_LANE_CAPACITY (128)
+#define NL_IMPAIRMENT_MULTI_LANE_CAPACITY (1024)
+#define NL_IMPAIRMENT_MULTI_MAX_CONNECTIONS (1024)
+
+/// Network conditions from a point in time until the next step
+typedef struct NlImpairmentStep {
+    NlClockMicros startsAt;
+    NlClockMicros latency;
+    NlClockMicros jitter;
+    uint32_t lossPerMille;
+    size_t lossBurst;
+    uint32_t reorderPerMille;
+    size_t bandwidth;
+} NlImpairmentStep;
+
+/// Time-scripted network conditions. Loaded from a text file with one step for each line:
+/// `<seconds> [latency=<ms>] [jitter=<ms>] [loss=<percent>] [burst=<datagrams>] [reorder=<percent>]
+/// [bandwidth=<kbit/s>]`. Values that are left out are kept from the previous step. A line with
+/// `<seconds> loop` starts over from the first step at that time. `#` starts a comment.
+typedef struct NlImpairmentProfile {
+    NlImpairmentStep steps[NL_IMPAIRMENT_MAX_STEPS];
+    size_t stepCount;
+    NlClockMicros loopAt;
+} NlImpairmentProfile;
+
+typedef struct NlImpairedDatagram {
+    int connectionId;
+    size_t octetCount;
+    uint8_t octets[NL_DATAGRAM_MAX_OCTET_COUNT];
+} NlImpairedDatagram;
+
+/// Heap entry, the datagram itself stays in its slot
+typedef struct NlImpairedDatagramEntry {
+    NlClockMicros deliverAt;
+    uint64_t sequence;
+    size_t slot;
+} NlImpairedDatagramEntry;
+
+/// The simulated link of one connection in one direction
+typedef struct NlImpairmentLink {
+    uint32_t random;
+    NlClockMicros linkFreeAt;
+    size_t burstLeft;
+} NlImpairmentLink;
+
+/// Datagrams in one direction that are waiting for their delivery time, in a binary heap ordered by delivery time
+/// and then by the order they were pushed in. Each connection has its own link, so the loss bursts, bandwidth and
+/// random sequence of one connection are not affected by the traffic of the others.
+typedef struct NlImpairmentLane {
+    NlImpairedDatagram* datagrams;
+    NlImpairedDatagramEntry* entries;
+    size_t* freeSlots;
+    size_t capacity;
+    size_t count;
+    uint64_t pushedCount;
+    NlImpairmentLink* links;
+    size_t linkCount;
+    uint32_t seed;
+    size_t passedCount;
+    size_t droppedCount;
+    size_t reorderedCount;
+} NlImpairmentLane;
+
+/// Applies a profile to both directions. Each direction of each connection has its own random sequence and consumes
+/// the same amount of it for every datagram, so the same seed and profile give the same drop, jitter and reorder
+/// decisions for the same sequence of datagrams on a connection, regardless of how sends, receives and the
+/// other connections interleave.
+typedef struct NlImpairment {
+    const NlImpairmentProfile* profile;
+    uint32_t seed;
+    NlClockMicros startedAt;
+    NlImpairmentLane outgoing;
+    NlImpairmentLane incoming;
+} NlImpairment;
+
+/// Impairs a single datagram transport, e.g. the client side of a transport stack
+typedef struct NlImpairedTransport {
+    DatagramTransport inner;
+    DatagramTransport transport;
+    NlImpairment impairment;
+} NlImpairedTransport;
+
+/// Impairs a multi datagram transport, e.g. the listening side of a transport stack
+typedef struct NlImpairedTransportMulti {
+    DatagramTransportMulti inner;
+    DatagramTransportMulti multiTransport;
+    NlImpairment impairment;
+} NlImpairedTransportMulti;
+
+int nlImpairmentProfileLoad(NlImpairmentProfile* self, const char* filename);
+
+void nlImpairedTransportInit(NlImpairedTransport* self, DatagramTransport inner, const NlImpairmentProfile* profile,
+                             uint32_t seed);
+void nlImpairedTransportRestart(NlImpairedTransport* self, DatagramTransport inner);
+void nlImpairedTransportDestroy(NlImpairedTransport* self);
+void nlImpairedTransportMultiInit(NlImpairedTransportMulti* self, DatagramTransportMulti inner,
+                                  const NlImpairmentProfile* profile, uint32_t seed);
+void nlImpairedTransportMultiResetConnection(NlImpairedTransportMulti* self, int connectionId);
+void nlImpairedTransportMultiDestroy(NlImpairedTransportMulti* self);
+
+#endif
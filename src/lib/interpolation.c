@@ -0,0 +1,103 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "interpolation.h"
+
+/// Initializes the interpolator
+/// @param self interpolator
+/// @param expectedTickDuration simulation tick duration to use until it has been measured
+void nlInterpolatorInit(NlInterpolator* self, NlClockMicros expectedTickDuration)
+{
+    self->tickDuration = expectedTickDuration;
+    self->teleportDistance = 64.0f;
+    nlInterpolatorReset(self);
+}
+
+/// Forgets the received states, for example when leaving a game
+/// @param self interpolator
+void nlInterpolatorReset(NlInterpolator* self)
+{
+    self->hasPrevious = false;
+    self->hasCurrent = false;
+    self->currentTickId = 0;
+    self->currentReceivedAt = 0;
+}
+
+static NlVec2 lerpPosition(NlVec2 from, NlVec2 to, float alpha, float teleportDistance)
+{
+    NlVec2 delta;
+    delta.x = to.x - from.x;
+    delta.y = to.y - from.y;
+    // Kick-offs and respawns move things instantly, those should not be smoothed
+    if (delta.x * delta.x + delta.y * delta.y > teleportDistance * teleportDistance) {
+        return to;
+    }
+
+    NlVec2 result;
+    result.x = from.x + delta.x * alpha;
+    result.y = from.y + delta.y * alpha;
+    return result;
+}
+
+static void receive(NlInterpolator* self, const NlGame* predicted, StepId tickId, NlClockMicros now)
+{
+    if (self->hasCurrent && tickId > self->currentTickId) {
+        // Smooth the measured duration so a late frame does not cause a visible jump
+        NlClockMicros measured = (now - self->currentReceivedAt) / (NlClockMicros) (tickId - self->currentTickId);
+        self->tickDuration = (self->tickDuration * 7U + measured) / 8U;
+
+        self->previous = self->current;
+        self->hasPrevious = true;
+    } else if (!self->hasCurrent || tickId < self->currentTickId) {
+        self->hasPrevious = false;
+    }
+
+    self->current = *predicted;
+    self->currentTickId = tickId;
+    self->currentReceivedAt = now;
+    self->hasCurrent = true;
+}
+
+/// Returns the game with the avatar and ball positions interpolated between the two latest predicted ticks
+/// @param self interpolator
+/// @param predicted the latest predicted game state
+/// @param tickId tick id of the predicted state
+/// @param now render time
+/// @return the game state to render
+const NlGame* nlInterpolatorUpdate(NlInterpolator* self, const NlGame* predicted, StepId tickId, NlClockMicros now)
+{
+    if (!self->hasCurrent || tickId != self->currentTickId) {
+        receive(self, predicted, tickId, now);
+    } else {
+        // The prediction can be corrected without the tick id changing
+        self->current = *predicted;
+    }
+
+    if (!self->hasPrevious || self->tickDuration == 0U) {
+        return &self->current;
+    }
+
+    float alpha = (float) (now - self->currentReceivedAt) / (float) self->tickDuration;
+    if (alpha >= 1.0f) {
+        return &self->current;
+    }
+
+    self->interpolated = self->current;
+
+    size_t avatarCount = self->current.avatars.avatarCount;
+    if (self->previous.avatars.avatarCount < avatarCount) {
+        avatarCount = self->previous.avatars.avatarCount;
+    }
+    for (size_t i = 0U; i < avatarCount; ++i) {
+        self->interpolated.avatars.avatars[i].circle.center = lerpPosition(
+            self->previous.avatars.avatars[i].circle.center, self->current.avatars.avatars[i].circle.center, alpha,
+            self->teleportDistance);
+    }
+
+    self->interpolated.ball.circle.center = lerpPosition(self->previous.ball.circle.center,
+                                                         self->current.ball.circle.center, alpha,
+                                                         self->teleportDistance);
+
+    return &self->interpolated;
+}
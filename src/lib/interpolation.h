@@ -0,0 +1,31 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_INTERPOLATION_H
+#define NIMBLE_BALL_INTERPOLATION_H
+
+#include "clock.h"
+#include <nimble-ball-simulation/nimble_ball_simulation.h>
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+
+/// Keeps the last two predicted states and blends avatar and ball positions between them, so the
+/// render can run at a higher rate than the simulation. Presents the game one tick behind.
+typedef struct NlInterpolator {
+    NlGame previous;
+    NlGame current;
+    NlGame interpolated;
+    bool hasPrevious;
+    bool hasCurrent;
+    StepId currentTickId;
+    NlClockMicros currentReceivedAt;
+    NlClockMicros tickDuration;
+    float teleportDistance;
+} NlInterpolator;
+
+void nlInterpolatorInit(NlInterpolator* self, NlClockMicros expectedTickDuration);
+void nlInterpolatorReset(NlInterpolator* self);
+const NlGame* nlInterpolatorUpdate(NlInterpolator* self, const NlGame* predicted, StepId tickId, NlClockMicros now);
+
+#endif
@@ -5,6 +5,7 @@
 #include "lagometer_render.h"
 #include <lagometer/lagometer.h>
 #include <sdl-render/rect.h>
+#include <tiny-libc/tiny_libc.h>
 
 void nlLagometerRenderInit(NlLagometerRender* self, SrWindow* window, SrFont font, SrRects* rectsRender)
 {
@@ -13,63 +14,80 @@ void nlLagometerRenderInit(NlLagometerRender* self, SrWindow* window, SrFont fon
     self->rectsRender = rectsRender;
 
     Uint8 alpha = 68;
-    self->receivedColor.r = 0x33;
-    self->receivedColor.g = 0xee;
-    self->receivedColor.b = 0xcc;
-    self->receivedColor.a = alpha;
-
-    self->droppedColor.r = 0xff;
-    self->droppedColor.g = 0x22;
-    self->droppedColor.b = 0x11;
-    self->droppedColor.a = alpha;
-
-    self->latencyHighColor.r = 0xff;
-    self->latencyHighColor.g = 0xee;
-    self->latencyHighColor.b = 0x11;
-    self->latencyHighColor.a = alpha;
-
-    self->backgroundColor.r = 0x22;
-    self->backgroundColor.g = 0x33;
-    self->backgroundColor.b = 0xee;
-    self->backgroundColor.a = alpha;
+    NlBarBatches* barBatches = &self->barBatches;
+    nlBarBatchesInit(barBatches, rectsRender, NlLagometerBarTypeCount);
+    nlBarBatchesSetColor(barBatches, NlLagometerBarTypeReceived, 0x33, 0xee, 0xcc, alpha);
+    nlBarBatchesSetColor(barBatches, NlLagometerBarTypeDropped, 0xff, 0x22, 0x11, alpha);
+    nlBarBatchesSetColor(barBatches, NlLagometerBarTypeLatencyHigh, 0xff, 0xee, 0x11, alpha);
+    nlBarBatchesSetBackgroundColor(barBatches, 0x22, 0x33, 0xee, alpha);
 }
 
-void nlLagometerRenderUpdate(NlLagometerRender* self, const Lagometer* lagometer)
+static const int nlLagometerBarWidth = 2;
+static const int nlLagometerFullBarHeight = 200;
+
+/// Turns the newest packets of the lagometer into the bars that are drawn for them
+/// @param lagometer lagometer
+/// @param bars target bars
+void nlLagometerRenderBars(const Lagometer* lagometer, NlLagometerBars* bars)
 {
-    const int barWidth = 2;
-    const int fullBarHeight = 200;
-    int fullLagometerWidth = (int) lagometer->packets.capacity * barWidth;
-    int xOffset = self->rectsRender->width - fullLagometerWidth - 20;
     const int maxLatencyMs = 270;
-    const float factor = (float) fullBarHeight / (float) maxLatencyMs;
-    int yOffset = fullBarHeight + 10;
+    const float factor = (float) nlLagometerFullBarHeight / (float) maxLatencyMs;
 
-    SDL_Color backgroundColor = self->backgroundColor;
-    SDL_SetRenderDrawColor(self->rectsRender->renderer, backgroundColor.r, backgroundColor.g, backgroundColor.b,
-                           backgroundColor.a);
-    srRectsFillRect(self->rectsRender, xOffset, yOffset - fullBarHeight - 2, fullLagometerWidth, fullBarHeight + 2);
+    // Only the newest packets fit, skip the oldest ones
+    size_t packetCount = lagometer->packets.count;
+    size_t skippedCount = 0U;
+    if (packetCount > NL_LAGOMETER_RENDER_MAX_BARS) {
+        skippedCount = packetCount - NL_LAGOMETER_RENDER_MAX_BARS;
+        packetCount = NL_LAGOMETER_RENDER_MAX_BARS;
+    }
 
-    for (size_t i = 0U; i < lagometer->packets.count; ++i) {
-        size_t index = (lagometer->packets.readIndex + i) % lagometer->packets.capacity;
+    for (size_t i = 0U; i < packetCount; ++i) {
+        size_t index = (lagometer->packets.readIndex + skippedCount + i) % lagometer->packets.capacity;
         const LagometerPacket* packet = &lagometer->packets.packets[index];
-        int x = (int) i * barWidth + xOffset;
-        int y = yOffset - fullBarHeight;
 
         int latencyHeight = (int) ((float) packet->latencyMs * factor);
-        SDL_Color color = self->receivedColor;
+        NlLagometerBarType type = NlLagometerBarTypeReceived;
         if (packet->status == LagometerPacketStatusDropped) {
-            latencyHeight = fullBarHeight;
-            color = self->droppedColor;
+            latencyHeight = nlLagometerFullBarHeight;
+            type = NlLagometerBarTypeDropped;
         }
         if (packet->latencyMs > 110U) {
-            color = self->latencyHighColor;
+            type = NlLagometerBarTypeLatencyHigh;
         }
 
-        if (latencyHeight > fullBarHeight) {
-            latencyHeight = fullBarHeight;
+        if (latencyHeight > nlLagometerFullBarHeight) {
+            latencyHeight = nlLagometerFullBarHeight;
         }
 
-        SDL_SetRenderDrawColor(self->rectsRender->renderer, color.r, color.g, color.b, color.a);
-        srRectsFillRect(self->rectsRender, x, y, barWidth, latencyHeight);
+        bars->bars[i].type = (uint8_t) type;
+        bars->bars[i].height = (uint8_t) latencyHeight;
+    }
+    // Bars that are not used are cleared, so equal bars compare equal
+    tc_mem_clear_type_n(&bars->bars[packetCount], NL_LAGOMETER_RENDER_MAX_BARS - packetCount);
+    bars->count = packetCount;
+    bars->capacity = lagometer->packets.capacity;
+}
+
+/// Renders the lagometer bars with one background fill and one batched fill for each bar color,
+/// no matter how many packets the lagometer holds.
+/// @param self lagometer render
+/// @param bars bars from nlLagometerRenderBars()
+void nlLagometerRenderUpdate(NlLagometerRender* self, const NlLagometerBars* bars)
+{
+    int fullLagometerWidth = (int) bars->capacity * nlLagometerBarWidth;
+    int xOffset = self->rectsRender->width - fullLagometerWidth - 20;
+    int yOffset = nlLagometerFullBarHeight + 10;
+
+    NlBarBatches* barBatches = &self->barBatches;
+    nlBarBatchesFillBackground(barBatches, xOffset, yOffset - nlLagometerFullBarHeight - 2, fullLagometerWidth,
+                               nlLagometerFullBarHeight + 2);
+
+    nlBarBatchesClear(barBatches);
+    for (size_t i = 0U; i < bars->count; ++i) {
+        const NlLagometerBar* bar = &bars->bars[i];
+        int x = (int) i * nlLagometerBarWidth + xOffset;
+        int y = yOffset - nlLagometerFullBarHeight;
+        nlBarBatchesAdd(barBatches, bar->type, x, y, nlLagometerBarWidth, bar->height);
     }
+    nlBarBatchesSubmit(barBatches);
 }
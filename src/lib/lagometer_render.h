@@ -5,23 +5,46 @@
 #ifndef NIMBLE_BALL_LAGOMETER_RENDER_H
 #define NIMBLE_BALL_LAGOMETER_RENDER_H
 
+#include "bar_batch.h"
 #include <sdl-render/font.h>
 #include <sdl-render/window.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct SrRects;
 struct Lagometer;
 
+#define NL_LAGOMETER_RENDER_MAX_BARS (256)
+
+typedef enum NlLagometerBarType {
+   NlLagometerBarTypeReceived,
+   NlLagometerBarTypeLatencyHigh,
+   NlLagometerBarTypeDropped,
+   NlLagometerBarTypeCount,
+} NlLagometerBarType;
+
+/// A bar as it is drawn. Only holds what is drawn, so it can be compared to find out if the lagometer changed.
+typedef struct NlLagometerBar {
+   uint8_t type;
+   uint8_t height;
+} NlLagometerBar;
+
+/// The newest packets of a lagometer as bars, oldest first
+typedef struct NlLagometerBars {
+   NlLagometerBar bars[NL_LAGOMETER_RENDER_MAX_BARS];
+   size_t count;
+   size_t capacity;
+} NlLagometerBars;
+
 typedef struct NlLagometerRender {
    SrWindow* window;
-   SDL_Color receivedColor;
-   SDL_Color latencyHighColor;
-   SDL_Color droppedColor;
-   SDL_Color backgroundColor;
    SrFont font;
    struct SrRects* rectsRender;
+   NlBarBatches barBatches;
 } NlLagometerRender;
 
 void nlLagometerRenderInit(NlLagometerRender* self, SrWindow* window, SrFont font, struct SrRects* rectsRender);
-void nlLagometerRenderUpdate(NlLagometerRender* self, const struct Lagometer* lagometer);
+void nlLagometerRenderBars(const struct Lagometer* lagometer, NlLagometerBars* bars);
+void nlLagometerRenderUpdate(NlLagometerRender* self, const NlLagometerBars* bars);
 
 #endif
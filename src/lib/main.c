@@ -2,26 +2,54 @@
  *  Copyright (c) Peter Bjorklund. All rights reserved.
  *  Licensed under the MIT License. See LICENSE in the project root for license information.
  *--------------------------------------------------------------------------------------------*/
+#include "async_log.h"
+#include "engine_client.h"
 #include "frontend.h"
+#include "frame_scheduler.h"
 #include "frontend_render.h"
+#include "histogram.h"
+#include "host.h"
+#include "host_thread.h"
+#include "hud.h"
+#include "impaired_transport.h"
+#include "interpolation.h"
 #include "lagometer_render.h"
+#include "metrics.h"
+#include "misprediction.h"
+#include "misprediction_render.h"
 #include "network_icons_render.h"
+#include "prediction_cache.h"
+#include "prediction_governor.h"
+#include "thread.h"
+#include "recording.h"
+#include "session_memory.h"
+#include "state_check.h"
+#include "state_hash.h"
+#include "text_cache.h"
+#include "thread_log.h"
+#include "tick_scheduler.h"
+#include "trace.h"
+#include "triple_buffer.h"
 #include <clog/console.h>
 #include <cpu-bound-simulator/simulator.h>
 #include <imprint/default_setup.h>
+#include <lagometer/lagometer.h>
 #include <nimble-ball-presentation/audio.h>
 #include <nimble-ball-presentation/render.h>
 #include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
 #include <nimble-engine-client/client.h>
-#include <nimble-server/participant_connection.h>
-#include <nimble-server/server.h>
-#include <transport-stack/multi.h>
+#include <stdlib.h>
+#include <string.h>
 #include <transport-stack/single.h>
 
 static const size_t gameRelayPort = 27003U;
 static const char* gameRelayHost = "127.0.0.1";
 // static const char* gameRelayDevHost = "gamerelay.dev";
 
+#if defined NL_TRACE_ENABLED
+static const char* nlTraceFilename = "nimble-ball-trace.json";
+#endif
+
 clog_config g_clog;
 
 char g_clog_temp_str[CLOG_TEMP_STR_SIZE];
@@ -45,54 +73,136 @@ typedef enum NlAppPhase {
 /// Shared resources
 typedef struct NlApp {
     NlAppPhase phase;
-    ImprintAllocator* allocator;
-    ImprintAllocatorWithFree* allocatorWithFree;
+    NlSessionMemory hostSession;
+    NlSessionMemory clientSession;
     Clog log;
     NlSimulationVm authoritative;
     NlSimulationVm predicted;
     NlFrontend frontend;
     bool nimbleServerIsStarted;
+    bool useHostThread;
+    NlHostThread hostThread;
+    bool isRecording;
+    NlRecorder recorder;
+    NlRecordingVm recordingAuthoritative;
+    NlSimulationVm stateCheckShadow;
+    NlStateCheckVm stateCheck;
+    bool usePredictionCache;
+    NlPredictionCache predictionCache;
+    bool usePredictionGovernor;
+    NlPredictionGovernor predictionGovernor;
+    NlMispredictionTracker mispredictionTracker;
     CpuBoundSimulator cpuBoundSimulator;
 } NlApp;
 
-/// Nimble server and transport stack
-typedef struct NlAppHost {
-    NimbleServer nimbleServer;
-    TransportStackMulti multiTransport;
-    Clog log;
-} NlAppHost;
+/// Everything the network side needs from the render side for an update
+typedef struct NlAppNetworkInput {
+    SrGamepad gamepads[2];
+    SrFunctionKeys functionKeys;
+    size_t localPlayerCount;
+    uint8_t participantIds[NLR_MAX_LOCAL_PLAYERS];
+    int selectedTeamIndices[NLR_MAX_LOCAL_PLAYERS];
+} NlAppNetworkInput;
+
+/// Everything the render side needs from the network side to present a frame
+typedef struct NlAppRenderSnapshot {
+    bool hasGame;
+    NlGame authoritative;
+    NlGame predicted;
+    NlRenderStats renderStats;
+    size_t localParticipantCount;
+    uint8_t localParticipantIds[NLR_MAX_LOCAL_PLAYERS];
+    NlFrontend frontend;
+    NlNetworkIconsState iconsState;
+    NlLagometerBars lagometerBars;
+    NlMispredictionBars mispredictionBars;
+    bool isPredictionOverBudget;
+} NlAppRenderSnapshot;
 
 /// Nimble client, transport stack and presentation
 typedef struct NlAppClient {
     SrGamepad gamepads[2];
     SrFunctionKeys functionKeys;
+    NlAppNetworkInput networkInput;
+    SrFunctionKeys networkFunctionKeysPressedLast;
+    NlAppRenderSnapshot renderSnapshot;
+    bool useInterpolation;
+    NlInterpolator interpolator;
     SrWindow window;
     NlRender inGame;
+    NlTextCache textCache;
     NlFrontendRender frontendRender;
     NlLagometerRender lagometerRender;
+    NlMispredictionRender mispredictionRender;
+    bool isMispredictionOverlayVisible;
     NlNetworkIconsRender networkIconsRender;
+    NlHud hud;
+    size_t lagometerLayer;
+    size_t mispredictionLayer;
+    size_t frontendLayer;
+    size_t networkIconsLayer;
     StatsIntPerSecond renderFps;
+    NlFrameScheduler frameScheduler;
     SrAudio mixer;
     NlAudio audio;
     TransportStackSingle singleTransport;
+    bool isImpaired;
+    NlImpairedTransport impairedTransport;
+    uint8_t discardedDatagram[1200];
     ImprintAllocator* allocator;
     ImprintAllocatorWithFree* allocatorWithFree;
     NimbleEngineClient nimbleEngineClient;
+    NlHistogram latencyHistogram;
+    NlHistogram authoritativeBufferHistogram;
+    size_t droppedPacketCount;
+    size_t overwrittenPacketCount;
+    size_t lagometerWriteIndex;
+    size_t lagometerCount;
     Clog log;
     SrFunctionKeys functionKeysPressedLast;
     bool hasSavedSecret;
     NimbleSerializeParticipantConnectionSecret savedSecret;
+    NlRecorder* recorder;
 } NlAppClient;
 
-/// Initializes the nimble server on the previously setup multi transport
+/// Stops the host, if started, and releases all memory allocated for it
+/// @param app application
+static void endHostSession(NlApp* app)
+{
+    if (app->nimbleServerIsStarted && app->useHostThread) {
+        nlHostThreadStop(&app->hostThread);
+    }
+    app->nimbleServerIsStarted = false;
+    nlSessionMemoryEnd(&app->hostSession);
+}
+
+/// Leaves the game and releases all memory allocated for the client and the host
+/// @param app application
+/// @param client app client
+static void endSessions(NlApp* app, NlAppClient* client)
+{
+    if (app->clientSession.isActive) {
+        nimbleEngineClientRequestDisconnect(&client->nimbleEngineClient);
+        // Give the client a chance to send the disconnect before its memory is gone
+        nimbleEngineClientUpdate(&client->nimbleEngineClient);
+        nlSessionMemoryEnd(&app->clientSession);
+    }
+    endHostSession(app);
+}
+
+/// Initializes the nimble server on a multi transport that listens on the specified port
 /// @param self appHost
 /// @param app Application
-static void startHostingOnMultiTransport(NlAppHost* self, NlApp* app)
+/// @param hostname hostname to listen on
+/// @param port port to listen on
+/// @param transportStackMode which transport stack to use
+static void startHostingOnMultiTransport(NlAppHost* self, NlApp* app, const char* hostname, uint16_t port,
+                                         TransportStackMode transportStackMode)
 {
     app->phase = NlAppPhaseNetwork;
     app->frontend.phase = NlFrontendPhaseHosting;
 
-    CLOG_INFO("wrapped udp server to handle connections")
+    endHostSession(app);
 
     NimbleSerializeVersion serverReportTransmuteVmVersion = {
         app->authoritative.transmuteVm.version.major,
@@ -100,43 +210,28 @@ static void startHostingOnMultiTransport(NlAppHost* self, NlApp* app)
         app->authoritative.transmuteVm.version.patch,
     };
 
-    const size_t maxConnectionCount = 4U;
-    const size_t maxParticipantCount = 2; // maxConnectionCount * 2U;
-    const size_t maxSingleParticipantStepOctetCount = sizeof(NlPlayerInput);
-
-    Clog serverLog;
-    serverLog.config = &g_clog;
-    serverLog.constantPrefix = "NimbleServer";
-
-    NimbleServerSetup serverSetup;
-    serverSetup.maxSingleParticipantStepOctetCount = maxSingleParticipantStepOctetCount;
-    serverSetup.maxParticipantCount = maxParticipantCount;
-    serverSetup.maxConnectionCount = maxConnectionCount;
-    serverSetup.maxParticipantCountForEachConnection = 1;
-    serverSetup.maxWaitingForReconnectTicks = 62 * 20;
-    serverSetup.maxGameStateOctetCount = sizeof(NlGame);
-    serverSetup.memory = app->allocator;
-    serverSetup.blobAllocator = app->allocatorWithFree;
-    serverSetup.applicationVersion = serverReportTransmuteVmVersion;
-    serverSetup.now = monotonicTimeMsNow();
-    serverSetup.log = serverLog;
-    serverSetup.multiTransport = self->multiTransport.multiTransport;
-    int errorCode = nimbleServerInit(&self->nimbleServer, serverSetup);
+    // The host has its own session memory, the allocators are not thread safe if it runs on the host thread
+    nlSessionMemoryBegin(&app->hostSession);
+
+    NlAppHostSetup hostSetup;
+    nlAppHostSetupInit(&hostSetup, serverReportTransmuteVmVersion, &app->hostSession.setup.tagAllocator.info,
+                       &app->hostSession.setup.slabAllocator.info);
+    int errorCode = nlAppHostInit(self, hostname, port, transportStackMode, &hostSetup);
+    nlSessionMemoryAccount(&app->hostSession, "host");
     if (errorCode < 0) {
-        CLOG_ERROR("could not initialize nimble server %d", errorCode)
+        NL_LOG_ERROR("could not start hosting %d", errorCode)
+        nlSessionMemoryEnd(&app->hostSession);
+        return;
     }
-    CLOG_INFO("nimble server is initialized")
 
-    NlGame initialServerState;
-    nlGameInit(&initialServerState);
-    // We just add a completely empty game. But it could be setup
-    // with specific rules or game mode or similar
-    // Since the whole game is blittable structs with no pointers, we can just cast it to an (uint8_t*)
-    StepId stepId = 0xcafeU;
-    nimbleServerReInitWithGame(&self->nimbleServer, (const uint8_t*) &initialServerState, sizeof(initialServerState),
-                               stepId, monotonicTimeMsNow());
+    if (app->useHostThread) {
+        const NlClockMicros hostTickDuration = 4000U;
+        if (nlHostThreadStart(&app->hostThread, self, hostTickDuration) < 0) {
+            nlSessionMemoryEnd(&app->hostSession);
+            return;
+        }
+    }
 
-    CLOG_INFO("nimble server has initial game state. octet count: %zu", self->nimbleServer.game.latestState.octetCount)
     app->nimbleServerIsStarted = true;
 }
 
@@ -148,51 +243,42 @@ static const int useLocalPlayerCount = 1;
 /// @param app application
 static void startJoiningOnClientTransport(NlAppClient* self, NlApp* app)
 {
-    CLOG_DEBUG("start joining")
+    NL_LOG_DEBUG("start joining")
     app->phase = NlAppPhaseNetwork;
     app->frontend.phase = NlFrontendPhaseJoining;
 
-    CLOG_DEBUG("client datagram transport is set")
-
-    NimbleSerializeVersion clientReportTransmuteVmVersion = {
-        app->authoritative.transmuteVm.version.major,
-        app->authoritative.transmuteVm.version.minor,
-        app->authoritative.transmuteVm.version.patch,
-    };
+    NL_LOG_DEBUG("client datagram transport is set")
 
-    NimbleEngineClientSetup setup;
-    setup.memory = app->allocator;
-    setup.blobMemory = app->allocatorWithFree;
-    setup.transport = self->singleTransport.singleTransport;
-
-    setup.authoritative = app->authoritative.transmuteVm;
-    setup.predicted = app->predicted.transmuteVm;
-    setup.maximumSingleParticipantStepOctetCount = sizeof(NlPlayerInput);
-    setup.maximumParticipantCount = 8;
-    setup.applicationVersion = clientReportTransmuteVmVersion;
-    setup.maxTicksFromAuthoritative = 10U;
-    setup.wantsDebugStream = true;
-
-    Clog nimbleEngineClientLog;
-    nimbleEngineClientLog.config = &g_clog;
-    nimbleEngineClientLog.constantPrefix = "NimbleEngineClient";
-
-    setup.log = nimbleEngineClientLog;
-    nimbleEngineClientInit(&self->nimbleEngineClient, setup);
+    nlStateCheckVmReset(&app->stateCheck);
+    // The new engine client starts with an empty lagometer
+    self->lagometerWriteIndex = 0U;
+    self->lagometerCount = 0U;
+    nlPredictionGovernorReset(&app->predictionGovernor);
+    nlMispredictionTrackerReset(&app->mispredictionTracker);
+    if (app->usePredictionCache) {
+        nlPredictionCacheReset(&app->predictionCache);
+    }
 
-    CLOG_DEBUG("nimble client is setup with transport")
+    DatagramTransport transport = self->singleTransport.singleTransport;
+    if (self->isImpaired) {
+        nlImpairedTransportRestart(&self->impairedTransport, transport);
+        transport = self->impairedTransport.transport;
+    }
 
-    NimbleEngineClientGameJoinOptions joinOptions;
-    joinOptions.playerCount = useLocalPlayerCount;
-    joinOptions.players[0].localIndex = 99;
-    joinOptions.players[1].localIndex = 42;
-    joinOptions.useSecret = self->hasSavedSecret;
-    joinOptions.secret = self->savedSecret;
-    nimbleEngineClientRequestJoin(&self->nimbleEngineClient, joinOptions);
+    NlEngineClientSetup setup;
+    nlEngineClientSetupInit(&setup, transport, &app->stateCheck.transmuteVm, &app->mispredictionTracker.transmuteVm,
+                            &app->clientSession.setup.tagAllocator.info,
+                            &app->clientSession.setup.slabAllocator.info);
+    setup.localPlayerCount = useLocalPlayerCount;
+    if (app->usePredictionGovernor) {
+        setup.maxTicksFromAuthoritative = app->predictionGovernor.stats.ticksFromAuthoritative;
+    }
+    setup.useSecret = self->hasSavedSecret;
+    setup.secret = self->savedSecret;
+    nlEngineClientStartJoining(&self->nimbleEngineClient, &setup);
+    nlSessionMemoryAccount(&app->clientSession, "nimbleEngineClient");
 
     // self->nimbleEngineClient.isHostingLocally = app->nimbleServerIsStarted;
-
-    CLOG_DEBUG("nimble client is trying to join / rejoin server")
 }
 
 /*
@@ -226,47 +312,23 @@ static int startJoinOnline(NlApp* app, NlAppClient* client)
 }
 */
 
-/// Initializes a multi datagram transport stack
-/// Used by the server
-/// @param multi transport stack
-/// @param mode which transport stack to use
-/// @param allocator allocator
-/// @param allocatorWithFree allocator with free
-static void initializeTransportStackMulti(TransportStackMulti* multi, TransportStackMode mode,
-                                          struct ImprintAllocator* allocator,
-                                          struct ImprintAllocatorWithFree* allocatorWithFree)
-{
-    Clog multiLog;
-    multiLog.config = &g_clog;
-    multiLog.constantPrefix = "multi";
-
-    transportStackMultiInit(multi, allocator, allocatorWithFree, mode, multiLog);
-}
-
 /// Initializes a single datagram transport stack
-/// Used by the client only
+/// Used by the client only. Begins a new client session, everything allocated for the
+/// client from here on is released when the session ends.
 /// @param single single transport stack
 /// @param mode wich mode
-/// @param allocator allocator
-/// @param allocatorWithFree allocatorWithFree
+/// @param session client session memory
 static void initializeTransportStackSingle(TransportStackSingle* single, TransportStackMode mode,
-                                           struct ImprintAllocator* allocator,
-                                           struct ImprintAllocatorWithFree* allocatorWithFree)
+                                           NlSessionMemory* session)
 {
     Clog singleLog;
     singleLog.config = &g_clog;
     singleLog.constantPrefix = "single";
 
-    transportStackSingleInit(single, allocator, allocatorWithFree, mode, singleLog);
-}
-
-static void initializeConnectMultiAndHost(NlApp* app, NlAppHost* host, const char* hostname, uint16_t port,
-                                          TransportStackMode transportStackMode, struct ImprintAllocator* allocator,
-                                          struct ImprintAllocatorWithFree* allocatorWithFree)
-{
-    initializeTransportStackMulti(&host->multiTransport, transportStackMode, allocator, allocatorWithFree);
-    transportStackMultiListen(&host->multiTransport, hostname, port);
-    startHostingOnMultiTransport(host, app);
+    nlSessionMemoryBegin(session);
+    transportStackSingleInit(single, &session->setup.tagAllocator.info, &session->setup.slabAllocator.info, mode,
+                             singleLog);
+    nlSessionMemoryAccount(session, "transportStackSingle");
 }
 
 /// Handles menu selection when not actively trying to create, play or join a game
@@ -277,18 +339,15 @@ static void updateFrontendInIdle(NlApp* app, NlAppHost* host, NlAppClient* clien
 {
     switch (app->frontend.mainMenuSelected) {
         case NlFrontendMenuSelectJoin:
-            CLOG_DEBUG("Join a LAN game")
-            initializeTransportStackSingle(&client->singleTransport, TransportStackModeLocalUdp, app->allocator,
-                                           app->allocatorWithFree);
+            NL_LOG_DEBUG("Join a LAN game")
+            initializeTransportStackSingle(&client->singleTransport, TransportStackModeLocalUdp, &app->clientSession);
             transportStackSingleConnect(&client->singleTransport, gameRelayHost, gameRelayPort);
             startJoiningOnClientTransport(client, app);
             break;
         case NlFrontendMenuSelectHost:
-            CLOG_DEBUG("Host a LAN game")
-            initializeConnectMultiAndHost(app, host, "", gameRelayPort, TransportStackModeLocalUdp, app->allocator,
-                                          app->allocatorWithFree);
-            initializeTransportStackSingle(&client->singleTransport, TransportStackModeLocalUdp, app->allocator,
-                                           app->allocatorWithFree);
+            NL_LOG_DEBUG("Host a LAN game")
+            startHostingOnMultiTransport(host, app, "", (uint16_t) gameRelayPort, TransportStackModeLocalUdp);
+            initializeTransportStackSingle(&client->singleTransport, TransportStackModeLocalUdp, &app->clientSession);
             transportStackSingleConnect(&client->singleTransport, gameRelayHost, gameRelayPort);
             startJoiningOnClientTransport(client, app);
             break;
@@ -297,19 +356,16 @@ static void updateFrontendInIdle(NlApp* app, NlAppHost* host, NlAppClient* clien
             break;
             /*
         case NlFrontendMenuSelectHostOnline:
-            CLOG_DEBUG("Host Online")
-            initializeConnectMultiAndHost(app, host, gameRelayDevHost, gameRelayPort, TransportStackModeConclave,
-                                          app->allocator, app->allocatorWithFree);
+            NL_LOG_DEBUG("Host Online")
+            initializeConnectMultiAndHost(app, host, gameRelayDevHost, gameRelayPort, TransportStackModeConclave);
             startHostOnline(app, host);
 
-            initializeTransportStackSingle(&client->singleTransport, TransportStackModeConclave, app->allocator,
-                                           app->allocatorWithFree);
+            initializeTransportStackSingle(&client->singleTransport, TransportStackModeConclave, &app->clientSession);
             transportStackSingleConnect(&client->singleTransport, gameRelayDevHost, gameRelayPort);
             break;
         case NlFrontendMenuSelectJoinOnline:
-            CLOG_DEBUG("Join an Online game")
-            initializeTransportStackSingle(&client->singleTransport, TransportStackModeConclave, app->allocator,
-                                           app->allocatorWithFree);
+            NL_LOG_DEBUG("Join an Online game")
+            initializeTransportStackSingle(&client->singleTransport, TransportStackModeConclave, &app->clientSession);
             transportStackSingleConnect(&client->singleTransport, gameRelayDevHost, gameRelayPort);
             startJoiningOnClientTransport(client, app);
             startJoinOnline(app, client);
@@ -321,6 +377,21 @@ static void updateFrontendInIdle(NlApp* app, NlAppHost* host, NlAppClient* clien
     app->frontend.mainMenuSelected = NlFrontendMenuSelectUnknown;
 }
 
+/// Finds the team the local player has selected in the render
+/// @param input network input
+/// @param participantId participant id of the local player
+/// @return selected team index or NL_TEAM_UNDEFINED
+static int findSelectedTeamIndex(const NlAppNetworkInput* input, uint8_t participantId)
+{
+    for (size_t i = 0U; i < input->localPlayerCount; ++i) {
+        if (input->participantIds[i] == participantId) {
+            return input->selectedTeamIndices[i];
+        }
+    }
+
+    return NL_TEAM_UNDEFINED;
+}
+
 /// Adds predicted input to the nimble engine client
 /// @param client
 static void addPredictedInput(NlAppClient* client)
@@ -335,16 +406,17 @@ static void addPredictedInput(NlAppClient* client)
     const NlGame* authoritative = (const NlGame*) authoritativeState.state;
     for (size_t i = 0U; i < useLocalPlayerCount; ++i) {
         participantId[i] = client->nimbleEngineClient.nimbleClient.client.localParticipantLookup[i].participantId;
-        NlrLocalPlayer* renderLocalPlayer = nlRenderFindLocalPlayerFromParticipantId(&client->inGame, participantId[i]);
+        int selectedTeamIndex = findSelectedTeamIndex(&client->networkInput, participantId[i]);
         const NlPlayer* simulationPlayer = nlGameFindSimulationPlayerFromParticipantId(authoritative, participantId[i]);
-        if (simulationPlayer != 0 && simulationPlayer->phase == NlPlayerPhaseSelectTeam && renderLocalPlayer != NULL &&
-            renderLocalPlayer->selectedTeamIndex != NL_TEAM_UNDEFINED) {
+        if (simulationPlayer != 0 && simulationPlayer->phase == NlPlayerPhaseSelectTeam &&
+            selectedTeamIndex != NL_TEAM_UNDEFINED) {
             inputs[i].inputType = NlPlayerInputTypeSelectTeam;
-            inputs[i].input.selectTeam.preferredTeamToJoin = (uint8_t) renderLocalPlayer->selectedTeamIndex;
+            inputs[i].input.selectTeam.preferredTeamToJoin = (uint8_t) selectedTeamIndex;
             tc_snprintf(inputs[i].input.selectTeam.playerName, 32, "player %d", participantId[i]);
-            CLOG_INFO("sent selected team %d '%s' %zu", inputs[i].input.selectTeam.preferredTeamToJoin, inputs[i].input.selectTeam.playerName, sizeof(inputs[i]))
+            NL_LOG_INFO("sent selected team %d '%s' %zu", inputs[i].input.selectTeam.preferredTeamToJoin,
+                        inputs[i].input.selectTeam.playerName, sizeof(inputs[i]))
         } else {
-            inputs[i] = gamepadToPlayerInput(&client->gamepads[0]);
+            inputs[i] = gamepadToPlayerInput(&client->networkInput.gamepads[0]);
         }
         participantInputs[i].input = &inputs[i];
         participantInputs[i].octetSize = sizeof(inputs[i]);
@@ -356,34 +428,98 @@ static void addPredictedInput(NlAppClient* client)
     transmuteInput.participantInputs = participantInputs;
     transmuteInput.participantCount = useLocalPlayerCount;
 
+    if (client->recorder != 0) {
+        nlRecorderWriteInput(client->recorder, NlRecordTypePredictedInput, &transmuteInput);
+    }
+
     nimbleEngineClientAddPredictedInput(&client->nimbleEngineClient, &transmuteInput);
 }
 
-/// Sets the locally simulated game state to the local nimble server
+/// Update host
 /// @param host
 /// @param client
-static void setGameStateToHost(NlAppHost* host, NlAppClient* client)
+static void updateHost(NlAppHost* host, NlAppClient* client)
 {
-    StepId outStepId;
-    TransmuteState authoritativeState = assentGetState(&client->nimbleEngineClient.rectify.authoritative, &outStepId);
-    CLOG_ASSERT(authoritativeState.octetSize == sizeof(NlGame), "illegal authoritative state")
-    nimbleServerSetGameState(&host->nimbleServer, authoritativeState.state, authoritativeState.octetSize, outStepId);
+    NL_TRACE_BEGIN("updateHost")
+    nlAppHostUpdate(host, monotonicTimeMsNow());
+
+    if (client->nimbleEngineClient.phase == NimbleEngineClientPhaseSynced && nlAppHostMustProvideGameState(host)) {
+        nlAppHostProvideGameStateFromClient(host, &client->nimbleEngineClient);
+    }
+    NL_TRACE_END()
 }
 
-/// Update host
-/// @param host
-/// @param client
-static void updateHost(NlAppHost* host, NlAppClient* client)
+/// Lets the prediction governor resize the prediction window from what the last update cost
+/// @param app application
+/// @param client app client
+static void governPrediction(NlApp* app, NlAppClient* client)
 {
-    transportStackMultiUpdate(&host->multiTransport);
-    nimbleServerUpdate(&host->nimbleServer, monotonicTimeMsNow());
+    NimbleGameState authoritativeState;
+    NimbleGameState predictedState;
+    if (nimbleEngineClientGetGameStates(&client->nimbleEngineClient, &authoritativeState, &predictedState) < 0) {
+        return;
+    }
 
-    if (client->nimbleEngineClient.phase == NimbleEngineClientPhaseSynced &&
-        nimbleServerMustProvideGameState(&host->nimbleServer)) {
-        setGameStateToHost(host, client);
+    size_t lagTicks = predictedState.tickId > authoritativeState.tickId
+                          ? (size_t) (predictedState.tickId - authoritativeState.tickId)
+                          : 0U;
+
+    client->nimbleEngineClient.maxTicksFromAuthoritative = nlPredictionGovernorUpdate(&app->predictionGovernor,
+                                                                                      lagTicks);
+}
+
+/// Records the packets that were added to the lagometer since the last update.
+/// The lagometer only keeps the latest packets, the histograms keep the whole session. This runs after every client
+/// update, so packets are only overwritten before they are recorded if more than the lagometer capacity arrive in a
+/// single update.
+/// @param client app client
+static void recordLagometerPackets(NlAppClient* client)
+{
+    const LagometerPackets* packets = &client->nimbleEngineClient.nimbleClient.client.lagometer.packets;
+    size_t unreadCount = (packets->writeIndex + packets->capacity - client->lagometerWriteIndex) % packets->capacity;
+
+    // While the ring fills up, its count shows how many packets were added. More than the unread ones means that
+    // the ring wrapped past the read position: every packet in it is new, and at least the unread ones were
+    // overwritten. A full ring can not show this, it only tells the added count modulo the capacity.
+    if (packets->count > client->lagometerCount + unreadCount) {
+        client->overwrittenPacketCount += unreadCount;
+        client->lagometerWriteIndex = packets->readIndex;
+        unreadCount = packets->count;
+    }
+    client->lagometerCount = packets->count;
+
+    for (size_t i = 0U; i < unreadCount; ++i) {
+        const LagometerPacket* packet = &packets->packets[client->lagometerWriteIndex];
+        if (packet->status == LagometerPacketStatusDropped) {
+            client->droppedPacketCount++;
+        } else {
+            nlHistogramRecord(&client->latencyHistogram, packet->latencyMs);
+        }
+        client->lagometerWriteIndex = (client->lagometerWriteIndex + 1U) % packets->capacity;
+    }
+}
+
+/// Records the authoritative buffer depth
+/// @param client app client
+static void recordAuthoritativeBufferDepth(NlAppClient* client)
+{
+    NimbleEngineClientStats stats;
+    if (nimbleEngineClientGetStats(&client->nimbleEngineClient, &stats) >= 0) {
+        int depth = stats.authoritativeBufferDeltaStat;
+        nlHistogramRecord(&client->authoritativeBufferHistogram, depth > 0 ? (uint64_t) depth : 0U);
     }
 }
 
+/// Logs the session long network histograms
+/// @param client app client
+static void logNetworkHistograms(NlAppClient* client)
+{
+    nlHistogramLog(&client->latencyHistogram, "latency", "ms", &client->log);
+    NL_LOG_C_INFO(&client->log, "dropped packets: %zu, overwritten in the lagometer before they were recorded: %zu",
+                  client->droppedPacketCount, client->overwrittenPacketCount)
+    nlHistogramLog(&client->authoritativeBufferHistogram, "authoritative buffer depth", "steps", &client->log);
+}
+
 /// Update nimble engine client and, if hosting, the nimble engine server
 /// @param app
 /// @param host
@@ -392,10 +528,22 @@ static void updateInNetwork(NlApp* app, NlAppHost* host, NlAppClient* client)
 {
     cpuBoundSimulatorUpdate(&app->cpuBoundSimulator);
 
+    NL_TRACE_BEGIN("transportStackSingleUpdate")
     transportStackSingleUpdate(&client->singleTransport);
+    NL_TRACE_END()
 
     if (transportStackSingleIsConnected(&client->singleTransport)) {
+        NL_TRACE_BEGIN("nimbleEngineClientUpdate")
         nimbleEngineClientUpdate(&client->nimbleEngineClient);
+        NL_TRACE_END()
+        recordLagometerPackets(client);
+        if (app->usePredictionGovernor && client->nimbleEngineClient.phase == NimbleEngineClientPhaseSynced) {
+            governPrediction(app, client);
+        }
+        if (client->nimbleEngineClient.phase == NimbleEngineClientPhaseSynced) {
+            recordAuthoritativeBufferDepth(client);
+            nlMispredictionTrackerUpdate(&app->mispredictionTracker);
+        }
         if (client->nimbleEngineClient.phase == NimbleEngineClientPhaseSynced &&
             client->nimbleEngineClient.nimbleClient.client.localParticipantCount > 0 &&
             nimbleEngineClientMustAddPredictedInput(&client->nimbleEngineClient)) {
@@ -408,37 +556,101 @@ static void updateInNetwork(NlApp* app, NlAppHost* host, NlAppClient* client)
         }
 
     } else {
-        uint8_t buf[1200];
-        datagramTransportReceive(&client->singleTransport.singleTransport, buf, 1200);
+        // Drain everything that arrived before the connection was established, not one datagram each frame
+        while (datagramTransportReceive(&client->singleTransport.singleTransport, client->discardedDatagram,
+                                        sizeof(client->discardedDatagram)) > 0) {
+        }
     }
 
     if (client->nimbleEngineClient.nimbleClient.client.joinParticipantPhase ==
         NimbleJoiningStateOutOfParticipantSlots) {
-        CLOG_INFO("Out of participant slots!")
+        NL_LOG_INFO("Out of participant slots!")
     }
 
     if (app->nimbleServerIsStarted) {
-        updateHost(host, client);
+        if (app->useHostThread) {
+            if (client->nimbleEngineClient.phase == NimbleEngineClientPhaseSynced &&
+                nlHostThreadWantsGameState(&app->hostThread)) {
+                nlHostThreadOfferGameStateFromClient(&app->hostThread, &client->nimbleEngineClient);
+            }
+        } else {
+            updateHost(host, client);
+        }
     }
 
     // Hack to go back to main menu
-    if (client->gamepads[0].menu && app->frontend.phase == NlFrontendPhaseInGame) {
+    if (client->networkInput.gamepads[0].menu && app->frontend.phase == NlFrontendPhaseInGame) {
         app->frontend.phase = NlFrontendPhaseMainMenu;
         app->phase = NlAppPhaseIdle;
         app->frontend.mainMenuSelected = NlFrontendMenuSelectUnknown;
         app->frontend.mainMenuSelect = NlFrontendMenuSelectHost;
-        nimbleEngineClientRequestDisconnect(&client->nimbleEngineClient);
+        endSessions(app, client);
     }
 }
 
-/// Presents the authoritative and predicted state (if available) and the front end.
+typedef struct NlAppLagometerLayerState {
+    bool isVisible;
+    NlLagometerBars bars;
+} NlAppLagometerLayerState;
+
+static void renderLagometerLayer(void* self, const void* _state)
+{
+    const NlAppLagometerLayerState* state = (const NlAppLagometerLayerState*) _state;
+    if (state->isVisible) {
+        nlLagometerRenderUpdate((NlLagometerRender*) self, &state->bars);
+    }
+}
+
+typedef struct NlAppMispredictionLayerState {
+    bool isVisible;
+    NlMispredictionBars bars;
+} NlAppMispredictionLayerState;
+
+static void renderMispredictionLayer(void* self, const void* _state)
+{
+    const NlAppMispredictionLayerState* state = (const NlAppMispredictionLayerState*) _state;
+    if (state->isVisible) {
+        nlMispredictionRenderUpdate((NlMispredictionRender*) self, &state->bars);
+    }
+}
+
+static void renderFrontendLayer(void* self, const void* state)
+{
+    nlFrontendRenderUpdate((NlFrontendRender*) self, (const NlFrontend*) state);
+}
+
+static void renderNetworkIconsLayer(void* self, const void* state)
+{
+    nlNetworkIconsRenderUpdate((NlNetworkIconsRender*) self, *(const NlNetworkIconsState*) state);
+}
+
+/// Registers the overlays as hud layers, they are only redrawn when their state changes
+/// @param client
+static void initializeHud(NlAppClient* client)
+{
+    nlHudInit(&client->hud, client->window.renderer, client->inGame.rectangleRender.width,
+              client->inGame.rectangleRender.height);
+    client->lagometerLayer = nlHudAddLayer(&client->hud, "lagometer", renderLagometerLayer, &client->lagometerRender,
+                                           sizeof(NlAppLagometerLayerState));
+    client->mispredictionLayer = nlHudAddLayer(&client->hud, "misprediction", renderMispredictionLayer,
+                                               &client->mispredictionRender, sizeof(NlAppMispredictionLayerState));
+    client->frontendLayer = nlHudAddLayer(&client->hud, "frontend", renderFrontendLayer, &client->frontendRender,
+                                          sizeof(NlFrontend));
+    client->networkIconsLayer = nlHudAddLayer(&client->hud, "networkIcons", renderNetworkIconsLayer,
+                                              &client->networkIconsRender, sizeof(NlNetworkIconsState));
+}
+
+/// Copies everything the render side needs to present a frame, so it can be handed over to another thread
 /// @param app
 /// @param client
-static void presentPredictedAndAuthoritativeStatesAndFrontend(const NlApp* app, NlAppClient* client)
+/// @param snapshot target snapshot
+static void captureRenderSnapshot(const NlApp* app, NlAppClient* client, NlAppRenderSnapshot* snapshot)
 {
-    NlRenderStats renderStats;
-    const NlGame* authoritative;
-    const NlGame* predicted;
+    // The hud compares layer states octet by octet, so padding must be cleared
+    tc_mem_clear_type(snapshot);
+
+    NlRenderStats* renderStats = &snapshot->renderStats;
+    const NimbleClient* nimbleClient = &client->nimbleEngineClient.nimbleClient.client;
 
     if (app->phase == NlAppPhaseNetwork && client->nimbleEngineClient.phase == NimbleEngineClientPhaseSynced) {
         NimbleGameState authoritativeState;
@@ -446,67 +658,263 @@ static void presentPredictedAndAuthoritativeStatesAndFrontend(const NlApp* app,
 
         nimbleEngineClientGetGameStates(&client->nimbleEngineClient, &authoritativeState, &predictedState);
 
-        renderStats.authoritativeTickId = authoritativeState.tickId;
-        renderStats.predictedTickId = predictedState.tickId;
-
-        authoritative = (const NlGame*) authoritativeState.state.state;
-        predicted = (const NlGame*) predictedState.state.state;
+        renderStats->authoritativeTickId = authoritativeState.tickId;
+        renderStats->predictedTickId = predictedState.tickId;
 
         CLOG_ASSERT(authoritativeState.state.octetSize == sizeof(NlGame), "internal error, wrong auth state size");
         CLOG_ASSERT(predictedState.state.octetSize == sizeof(NlGame), "internal error, wrong state size");
 
+        tc_memcpy_octets(&snapshot->authoritative, authoritativeState.state.state, sizeof(NlGame));
+        tc_memcpy_octets(&snapshot->predicted, predictedState.state.state, sizeof(NlGame));
+        snapshot->hasGame = true;
+
         NimbleEngineClientStats stats;
         nimbleEngineClientGetStats(&client->nimbleEngineClient, &stats);
 
-        renderStats.authoritativeStepsInBuffer = stats.authoritativeBufferDeltaStat;
-    } else {
-        authoritative = 0;
-        predicted = 0;
-
-        renderStats.predictedTickId = 0;
-        renderStats.authoritativeTickId = 0;
-        renderStats.authoritativeStepsInBuffer = 0;
-    }
-
-    renderStats.renderFps = client->renderFps.avg;
-    renderStats.latencyMs = client->nimbleEngineClient.nimbleClient.client.latencyMsStat.avg;
+        renderStats->authoritativeStepsInBuffer = stats.authoritativeBufferDeltaStat;
 
-    srWindowRenderPrepare(&client->window, 0x115511);
-    if (authoritative != NULL && predicted != NULL) {
-        nlAudioUpdate(&client->audio, authoritative, predicted, 0, 0U);
-        uint8_t localParticipantIds[4];
-        const NimbleClient* nimbleClient = &client->nimbleEngineClient.nimbleClient.client;
+        snapshot->localParticipantCount = nimbleClient->localParticipantCount;
         for (size_t i = 0; i < nimbleClient->localParticipantCount; ++i) {
-            localParticipantIds[i] = nimbleClient->localParticipantLookup[i].participantId;
+            snapshot->localParticipantIds[i] = nimbleClient->localParticipantLookup[i].participantId;
         }
-        nlRenderFeedInput(&client->inGame, client->gamepads, predicted, localParticipantIds,
-                          nimbleClient->localParticipantCount);
 
-        nlRenderUpdate(&client->inGame, authoritative, predicted, localParticipantIds,
-                       nimbleClient->localParticipantCount, renderStats);
-        nlLagometerRenderUpdate(&client->lagometerRender, &client->nimbleEngineClient.nimbleClient.client.lagometer);
+        nlLagometerRenderBars(&nimbleClient->lagometer, &snapshot->lagometerBars);
+        NlMispredictionGraph mispredictionGraph;
+        nlMispredictionTrackerGraph(&app->mispredictionTracker, &mispredictionGraph);
+        nlMispredictionRenderBars(&mispredictionGraph, &snapshot->mispredictionBars);
     }
 
-    nlFrontendRenderUpdate(&client->frontendRender, &app->frontend);
+    renderStats->latencyMs = nimbleClient->latencyMsStat.avg;
 
-    NlNetworkIconsState iconsState;
-    iconsState.authoritativeTimeIntervalWarning = client->nimbleEngineClient.detectedGapInAuthoritativeSteps
-                                                      .isOrWasTrue;
-    iconsState.droppedDatagram = client->nimbleEngineClient.nimbleClient.client.quality.droppingDatagramWarning
-                                     .isOrWasTrue;
-    iconsState.disconnectInfo = NlNetworkIconsDisconnectInfoNone;
+    tc_memcpy_octets(&snapshot->frontend, &app->frontend, sizeof(NlFrontend));
+
+    NlNetworkIconsState* iconsState = &snapshot->iconsState;
+    iconsState->authoritativeTimeIntervalWarning = client->nimbleEngineClient.detectedGapInAuthoritativeSteps
+                                                       .isOrWasTrue;
+    iconsState->droppedDatagram = nimbleClient->quality.droppingDatagramWarning.isOrWasTrue;
+    iconsState->nondeterministic = app->stateCheck.mismatchCount > 0U;
+    iconsState->disconnectInfo = NlNetworkIconsDisconnectInfoNone;
     if (client->nimbleEngineClient.nimbleClient.state == NimbleClientRealizeStateDisconnected) {
-        iconsState.disconnectInfo = NlNetworkIconsDisconnectDisconnected;
+        iconsState->disconnectInfo = NlNetworkIconsDisconnectDisconnected;
     } else {
-        bool impending = client->nimbleEngineClient.nimbleClient.client.quality.impendingDisconnectWarning.isOrWasTrue |
+        bool impending = nimbleClient->quality.impendingDisconnectWarning.isOrWasTrue |
                          client->nimbleEngineClient.bigGapInAuthoritativeSteps.isOrWasTrue;
         if (impending) {
-            iconsState.disconnectInfo = NlNetworkIconsDisconnectImpending;
+            iconsState->disconnectInfo = NlNetworkIconsDisconnectImpending;
         }
     }
-    nlNetworkIconsRenderUpdate(&client->networkIconsRender, iconsState);
 
+    snapshot->isPredictionOverBudget = app->usePredictionGovernor && app->predictionGovernor.stats.isOverBudget;
+}
+
+/// Copies the gamepads and the team selections made in the render, so they can be handed over to another thread
+/// @param client
+/// @param snapshot the snapshot that was presented last
+/// @param input target input
+static void captureNetworkInput(NlAppClient* client, const NlAppRenderSnapshot* snapshot, NlAppNetworkInput* input)
+{
+    input->gamepads[0] = client->gamepads[0];
+    input->gamepads[1] = client->gamepads[1];
+    input->functionKeys = client->functionKeys;
+
+    input->localPlayerCount = snapshot->localParticipantCount;
+    for (size_t i = 0U; i < snapshot->localParticipantCount; ++i) {
+        uint8_t participantId = snapshot->localParticipantIds[i];
+        const NlrLocalPlayer* renderLocalPlayer = nlRenderFindLocalPlayerFromParticipantId(&client->inGame,
+                                                                                           participantId);
+        input->participantIds[i] = participantId;
+        input->selectedTeamIndices[i] = renderLocalPlayer != NULL ? renderLocalPlayer->selectedTeamIndex
+                                                                  : NL_TEAM_UNDEFINED;
+    }
+}
+
+/// Handles the function keys that change the transport, on the side that owns the transport
+/// @param app
+/// @param client
+static void handleNetworkFunctionKeys(NlApp* app, NlAppClient* client)
+{
+    const SrFunctionKeys* pressedLast = &client->networkFunctionKeysPressedLast;
+    const SrFunctionKeys* pressed = &client->networkInput.functionKeys;
+    // The transport only exists while the client session is active
+    bool hasTransport = app->clientSession.isActive;
+
+    if (hasTransport && !pressedLast->functionKeys[SR_KEY_F3] && pressed->functionKeys[SR_KEY_F3]) {
+        TransportStackInternetSimulationMode
+            newMode = (TransportStackInternetSimulationMode) (((int) client->singleTransport.lowerLevel
+                                                                   .internetSimulationMode +
+                                                               1) %
+                                                              3);
+
+        transportStackSingleSetInternetSimulationMode(&client->singleTransport, newMode);
+        NL_LOG_NOTICE("internet simulation mode: %d", newMode)
+    }
+
+    if (hasTransport && !pressedLast->functionKeys[SR_KEY_F4] && pressed->functionKeys[SR_KEY_F4]) {
+        hazyDatagramTransportDebugDiscardIncoming(&client->singleTransport.lowerLevel.hazyTransport);
+        NL_LOG_NOTICE("stopping incoming hazy transport")
+    }
+
+    if (!pressedLast->functionKeys[SR_KEY_F6] && pressed->functionKeys[SR_KEY_F6]) {
+        logNetworkHistograms(client);
+        nlMispredictionTrackerLog(&app->mispredictionTracker);
+    }
+
+    client->networkFunctionKeysPressedLast = *pressed;
+}
+
+/// Runs the frontend logic, the nimble engine client and, if hosting, the nimble engine server
+/// @param app
+/// @param host
+/// @param client
+static void updateNetwork(NlApp* app, NlAppHost* host, NlAppClient* client)
+{
+    handleNetworkFunctionKeys(app, client);
+
+    nlFrontendHandleInput(&app->frontend, &client->networkInput.gamepads[0]);
+    switch (app->phase) {
+        case NlAppPhaseIdle:
+            updateFrontendInIdle(app, host, client);
+            break;
+
+        case NlAppPhaseNetwork: {
+            updateInNetwork(app, host, client);
+        } break;
+    }
+}
+
+/// Presents the authoritative and predicted state (if available) and the front end.
+/// @param client
+/// @param snapshot what to present
+static void presentRenderSnapshot(NlAppClient* client, const NlAppRenderSnapshot* snapshot)
+{
+    NlRenderStats renderStats = snapshot->renderStats;
+    renderStats.renderFps = client->renderFps.avg;
+
+    nlTextCacheNextFrame(&client->textCache);
+    srWindowRenderPrepare(&client->window, 0x115511);
+    if (snapshot->hasGame) {
+        const NlGame* predicted = &snapshot->predicted;
+        if (client->useInterpolation) {
+            predicted = nlInterpolatorUpdate(&client->interpolator, predicted, snapshot->renderStats.predictedTickId,
+                                             nlClockNowMicros());
+        }
+
+        NL_TRACE_BEGIN("nlAudioUpdate")
+        nlAudioUpdate(&client->audio, &snapshot->authoritative, &snapshot->predicted, 0, 0U);
+        NL_TRACE_END()
+        nlRenderFeedInput(&client->inGame, client->gamepads, predicted, snapshot->localParticipantIds,
+                          snapshot->localParticipantCount);
+
+        NL_TRACE_BEGIN("nlRenderUpdate")
+        nlRenderUpdate(&client->inGame, &snapshot->authoritative, predicted, snapshot->localParticipantIds,
+                       snapshot->localParticipantCount, renderStats);
+        NL_TRACE_END()
+    } else if (client->useInterpolation) {
+        nlInterpolatorReset(&client->interpolator);
+    }
+
+    NlAppLagometerLayerState lagometerState;
+    tc_mem_clear_type(&lagometerState);
+    lagometerState.isVisible = snapshot->hasGame;
+    if (lagometerState.isVisible) {
+        lagometerState.bars = snapshot->lagometerBars;
+    }
+    nlHudSetLayerState(&client->hud, client->lagometerLayer, &lagometerState);
+
+    NlAppMispredictionLayerState mispredictionState;
+    tc_mem_clear_type(&mispredictionState);
+    mispredictionState.isVisible = snapshot->hasGame && client->isMispredictionOverlayVisible;
+    if (mispredictionState.isVisible) {
+        mispredictionState.bars = snapshot->mispredictionBars;
+    }
+    nlHudSetLayerState(&client->hud, client->mispredictionLayer, &mispredictionState);
+
+    // The virtual gamepad and the confirmed selection are not drawn, they would only cause redraws
+    NlFrontend frontendState = snapshot->frontend;
+    tc_mem_clear_type(&frontendState.virtualGamepad);
+    frontendState.mainMenuSelected = NlFrontendMenuSelectUnknown;
+    nlHudSetLayerState(&client->hud, client->frontendLayer, &frontendState);
+    nlHudSetLayerState(&client->hud, client->networkIconsLayer, &snapshot->iconsState);
+
+    NL_TRACE_BEGIN("nlHudRender")
+    nlHudRender(&client->hud);
+    NL_TRACE_END()
+
+    NL_TRACE_BEGIN("srWindowRenderPresent")
     srWindowRenderPresent(&client->window);
+    NL_TRACE_END()
+}
+
+/// Metrics published from the presented snapshot, so they are only touched by the main thread
+typedef struct NlAppMetrics {
+    NlMetrics metrics;
+    NlMetricsEndpoint endpoint;
+    size_t renderFps;
+    size_t frameTimeAverage;
+    size_t frameTimeJitter;
+    size_t latency;
+    size_t authoritativeBufferDelta;
+    size_t droppingDatagrams;
+    size_t impendingDisconnect;
+    size_t nondeterministic;
+    size_t predictionOverBudget;
+} NlAppMetrics;
+
+/// Registers the client metrics and starts serving them
+/// @param self app metrics
+/// @param path Unix socket path
+/// @param log log
+/// @return negative on error
+static int appMetricsInit(NlAppMetrics* self, const char* path, Clog log)
+{
+    NlMetrics* metrics = &self->metrics;
+    nlMetricsInit(metrics);
+    self->renderFps = nlMetricsRegister(metrics, "nimble_ball_render_fps", "Presented frames per second",
+                                        NlMetricTypeGauge);
+    self->frameTimeAverage = nlMetricsRegister(metrics, "nimble_ball_frame_time_average_us",
+                                               "Average frame time during the last second", NlMetricTypeGauge);
+    self->frameTimeJitter = nlMetricsRegister(metrics, "nimble_ball_frame_time_jitter_us",
+                                              "Frame time standard deviation during the last second",
+                                              NlMetricTypeGauge);
+    self->latency = nlMetricsRegister(metrics, "nimble_ball_latency_ms", "Average round trip time to the host",
+                                      NlMetricTypeGauge);
+    self->authoritativeBufferDelta = nlMetricsRegister(metrics, "nimble_ball_authoritative_buffer_delta",
+                                                       "Authoritative steps received but not yet simulated",
+                                                       NlMetricTypeGauge);
+    self->droppingDatagrams = nlMetricsRegister(metrics, "nimble_ball_dropping_datagrams",
+                                                "1 if datagrams are or were recently dropped", NlMetricTypeGauge);
+    self->impendingDisconnect = nlMetricsRegister(metrics, "nimble_ball_impending_disconnect",
+                                                  "1 if disconnected or about to be", NlMetricTypeGauge);
+    self->nondeterministic = nlMetricsRegister(metrics, "nimble_ball_nondeterministic",
+                                               "1 if the determinism self-check of the local simulation has failed",
+                                               NlMetricTypeGauge);
+    self->predictionOverBudget = nlMetricsRegister(metrics, "nimble_ball_prediction_over_budget",
+                                                   "1 if the prediction window can not cover the lag within budget",
+                                                   NlMetricTypeGauge);
+
+    return nlMetricsEndpointInit(&self->endpoint, path, log);
+}
+
+/// Publishes the presented snapshot and answers pending scrapes
+/// @param self app metrics
+/// @param client app client
+/// @param snapshot the snapshot that was presented last
+static void appMetricsUpdate(NlAppMetrics* self, const NlAppClient* client, const NlAppRenderSnapshot* snapshot)
+{
+    NlMetrics* metrics = &self->metrics;
+    const NlFrameTimeReport* frameTimes = &client->frameScheduler.lastReport;
+    nlMetricsSet(metrics, self->renderFps, client->renderFps.avg);
+    nlMetricsSet(metrics, self->frameTimeAverage, (int64_t) (frameTimes->averageMs * 1000.0));
+    nlMetricsSet(metrics, self->frameTimeJitter, (int64_t) (frameTimes->jitterMs * 1000.0));
+    nlMetricsSet(metrics, self->latency, snapshot->renderStats.latencyMs);
+    nlMetricsSet(metrics, self->authoritativeBufferDelta, snapshot->renderStats.authoritativeStepsInBuffer);
+    nlMetricsSet(metrics, self->droppingDatagrams, snapshot->iconsState.droppedDatagram);
+    nlMetricsSet(metrics, self->impendingDisconnect,
+                 snapshot->iconsState.disconnectInfo != NlNetworkIconsDisconnectInfoNone);
+    nlMetricsSet(metrics, self->nondeterministic, snapshot->iconsState.nondeterministic);
+    nlMetricsSet(metrics, self->predictionOverBudget, snapshot->isPredictionOverBudget);
+
+    nlMetricsEndpointUpdate(&self->endpoint, metrics);
 }
 
 /// Polls the gamepad and handle special function buttons
@@ -515,7 +923,9 @@ static void presentPredictedAndAuthoritativeStatesAndFrontend(const NlApp* app,
 /// @return true if the app should continue to run, false otherwise
 static bool pollInputAndHandleSpecialButtons(NlAppClient* client)
 {
+    NL_TRACE_BEGIN("srGamepadPoll")
     int wantsToQuit = srGamepadPoll(client->gamepads, maxLocalPlayerCount, &client->functionKeys);
+    NL_TRACE_END()
     if (wantsToQuit == 1) {
         return false;
     }
@@ -530,49 +940,254 @@ static bool pollInputAndHandleSpecialButtons(NlAppClient* client)
         }
     }
 
-    if (!client->functionKeysPressedLast.functionKeys[SR_KEY_F3] && client->functionKeys.functionKeys[SR_KEY_F3]) {
-        TransportStackInternetSimulationMode
-            newMode = (TransportStackInternetSimulationMode) (((int) client->singleTransport.lowerLevel
-                                                                   .internetSimulationMode +
-                                                               1) %
-                                                              3);
+    if (!client->functionKeysPressedLast.functionKeys[SR_KEY_F6] && client->functionKeys.functionKeys[SR_KEY_F6]) {
+        nlHistogramLog(&client->frameScheduler.frameTimes, "frame time", "us", &client->log);
+    }
 
-        transportStackSingleSetInternetSimulationMode(&client->singleTransport, newMode);
-        CLOG_NOTICE("internet simulation mode: %d", newMode)
+    if (!client->functionKeysPressedLast.functionKeys[SR_KEY_F7] && client->functionKeys.functionKeys[SR_KEY_F7]) {
+        client->isMispredictionOverlayVisible = !client->isMispredictionOverlayVisible;
     }
 
-    if (!client->functionKeysPressedLast.functionKeys[SR_KEY_F4] && client->functionKeys.functionKeys[SR_KEY_F4]) {
-        hazyDatagramTransportDebugDiscardIncoming(&client->singleTransport.lowerLevel.hazyTransport);
-        CLOG_NOTICE("stopping incoming hazy transport")
+#if defined NL_TRACE_ENABLED
+    if (!client->functionKeysPressedLast.functionKeys[SR_KEY_F5] && client->functionKeys.functionKeys[SR_KEY_F5]) {
+        NL_TRACE_WRITE(nlTraceFilename)
+        CLOG_NOTICE("wrote trace to '%s'", nlTraceFilename)
     }
+#endif
 
     client->functionKeysPressedLast = client->functionKeys;
 
     return true;
 }
 
-int main(int argc, char* argv[])
+/// Runs the frontend logic, networking and prediction on its own thread, so a slow present on the
+/// main (render) thread does not delay input sampling or datagram processing
+typedef struct NlAppNetworkThread {
+    NlApp* app;
+    NlAppHost* host;
+    NlAppClient* client;
+    NlClockMicros tickDuration;
+    NlThread thread;
+    atomic_bool isRunning;
+    NlTripleBuffer inputMailbox;
+    NlAppNetworkInput inputSlots[3];
+    NlTripleBuffer snapshotMailbox;
+    NlAppRenderSnapshot snapshotSlots[3];
+} NlAppNetworkThread;
+
+static void networkThreadRun(void* _self)
+{
+    NlAppNetworkThread* self = (NlAppNetworkThread*) _self;
+    NlAppClient* client = self->client;
+
+    NL_TRACE_THREAD_NAME("network")
+
+    NlTickScheduler tickScheduler;
+    nlTickSchedulerInit(&tickScheduler, self->tickDuration, nlClockNowMicros());
+
+    while (atomic_load_explicit(&self->isRunning, memory_order_acquire)) {
+        nlTickSchedulerWaitForNextTick(&tickScheduler);
+        if (nlTickSchedulerTicksDue(&tickScheduler, nlClockNowMicros()) == 0U) {
+            continue;
+        }
+
+        NL_TRACE_BEGIN("networkUpdate")
+        if (nlTripleBufferConsume(&self->inputMailbox)) {
+            client->networkInput = *(const NlAppNetworkInput*) nlTripleBufferReadSlot(&self->inputMailbox);
+        }
+
+        updateNetwork(self->app, self->host, client);
+
+        NlAppRenderSnapshot* snapshot = (NlAppRenderSnapshot*) nlTripleBufferWriteSlot(&self->snapshotMailbox);
+        captureRenderSnapshot(self->app, client, snapshot);
+        nlTripleBufferPublish(&self->snapshotMailbox);
+        NL_TRACE_END()
+    }
+}
+
+/// Starts the network thread. The app, host and client (except the presentation) must not be used by the
+/// calling thread until networkThreadStop()
+/// @param self network thread
+/// @param app application
+/// @param host host
+/// @param client client
+/// @param tickDuration duration between network updates in microseconds
+/// @return negative on error
+static int networkThreadStart(NlAppNetworkThread* self, NlApp* app, NlAppHost* host, NlAppClient* client,
+                              NlClockMicros tickDuration)
+{
+    self->app = app;
+    self->host = host;
+    self->client = client;
+    self->tickDuration = tickDuration;
+    nlTripleBufferInit(&self->inputMailbox, self->inputSlots, sizeof(self->inputSlots[0]));
+    nlTripleBufferInit(&self->snapshotMailbox, self->snapshotSlots, sizeof(self->snapshotSlots[0]));
+    atomic_store(&self->isRunning, true);
+
+    if (nlThreadCreate(&self->thread, networkThreadRun, self) < 0) {
+        CLOG_ERROR("could not start network thread")
+        return -1;
+    }
+
+    return 0;
+}
+
+static void networkThreadStop(NlAppNetworkThread* self)
 {
-    (void) argc;
-    (void) argv;
+    atomic_store_explicit(&self->isRunning, false, memory_order_release);
+    nlThreadJoin(&self->thread);
+}
+
+typedef struct NlAppOptions {
+    bool useHostThread;
+    bool useNetworkThread;
+    bool useInterpolation;
+    const char* recordFilename;
+    size_t recordHashInterval;
+    size_t stateCheckInterval;
+    NlFrameSchedulerMode frameSchedulerMode;
+    size_t targetFps;
+    size_t menuFps;
+    bool usePredictionCache;
+    NlClockMicros predictionBudget;
+    bool reduceRenderOverBudget;
+    const char* logFilename;
+    const char* metricsSocketPath;
+    const char* impairmentFilename;
+    uint32_t impairmentSeed;
+} NlAppOptions;
+
+/// Parses the command line options
+/// `--host-thread` runs the host on its own fixed rate thread instead of once every rendered frame
+/// `--network-thread` runs the frontend logic, networking and prediction on its own thread and only renders on the
+/// main thread
+/// `--interpolate` renders the avatars and ball interpolated between the two latest predicted ticks
+/// `--frame-mode fixed|vsync|unlimited` selects how the main loop is paced
+/// `--fps <fps>` frame rate in fixed mode
+/// `--menu-fps <fps>` frame rate while in the main menu
+/// `--record <filename>` records the authoritative steps and predicted inputs of the session
+/// `--record-hash-interval <steps>` how often the state hash is recorded. Zero only records it at the end
+/// `--state-check-interval <ticks>` how often the determinism self-check re-simulates an authoritative tick locally.
+/// A debugging aid, zero (default) turns it off
+/// `--prediction-budget-us <micros>` how long re-prediction may take for each update. The prediction window is
+/// adjusted to stay within it. Zero (default) keeps the fixed window
+/// `--reduce-render-over-budget` halves the frame rate while the prediction window does not cover the lag
+/// `--no-prediction-cache` re-simulates every predicted tick after a rollback, even when nothing was mispredicted
+/// `--log-file <filename>` writes logging as binary records from a background thread instead of to the console
+/// `--metrics-socket <path>` serves live metrics in the Prometheus text format on a Unix socket
+/// `--impairment <filename>` applies a scripted network impairment profile to the client transport
+/// `--impairment-seed <seed>` seed for the loss, jitter and reordering of the impairment profile
+/// @param options
+/// @param argc
+/// @param argv
+static void parseOptions(NlAppOptions* options, int argc, char* argv[])
+{
+    options->useHostThread = false;
+    options->useNetworkThread = false;
+    options->useInterpolation = false;
+    options->recordFilename = 0;
+    options->recordHashInterval = 60U;
+    options->stateCheckInterval = 0U;
+    options->frameSchedulerMode = NlFrameSchedulerModeFixed;
+    options->targetFps = 120U;
+    options->menuFps = 30U;
+    options->usePredictionCache = true;
+    options->predictionBudget = 0U;
+    options->reduceRenderOverBudget = false;
+    options->logFilename = 0;
+    options->metricsSocketPath = 0;
+    options->impairmentFilename = 0;
+    options->impairmentSeed = 1U;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        if (strcmp(name, "--host-thread") == 0) {
+            options->useHostThread = true;
+        } else if (strcmp(name, "--network-thread") == 0) {
+            options->useNetworkThread = true;
+        } else if (strcmp(name, "--interpolate") == 0) {
+            options->useInterpolation = true;
+        } else if (strcmp(name, "--frame-mode") == 0) {
+            ++i;
+            if (strcmp(value, "vsync") == 0) {
+                options->frameSchedulerMode = NlFrameSchedulerModeVsync;
+            } else if (strcmp(value, "unlimited") == 0) {
+                options->frameSchedulerMode = NlFrameSchedulerModeUnlimited;
+            } else {
+                options->frameSchedulerMode = NlFrameSchedulerModeFixed;
+            }
+        } else if (strcmp(name, "--record") == 0) {
+            ++i;
+            options->recordFilename = value;
+        } else if (strcmp(name, "--record-hash-interval") == 0) {
+            ++i;
+            options->recordHashInterval = (size_t) strtol(value, 0, 10);
+        } else if (strcmp(name, "--state-check-interval") == 0) {
+            ++i;
+            options->stateCheckInterval = (size_t) strtol(value, 0, 10);
+        } else if (strcmp(name, "--fps") == 0) {
+            ++i;
+            options->targetFps = (size_t) strtol(value, 0, 10);
+        } else if (strcmp(name, "--menu-fps") == 0) {
+            ++i;
+            options->menuFps = (size_t) strtol(value, 0, 10);
+        } else if (strcmp(name, "--prediction-budget-us") == 0) {
+            ++i;
+            options->predictionBudget = (NlClockMicros) strtol(value, 0, 10);
+        } else if (strcmp(name, "--no-prediction-cache") == 0) {
+            options->usePredictionCache = false;
+        } else if (strcmp(name, "--reduce-render-over-budget") == 0) {
+            options->reduceRenderOverBudget = true;
+        } else if (strcmp(name, "--log-file") == 0) {
+            ++i;
+            options->logFilename = value;
+        } else if (strcmp(name, "--metrics-socket") == 0) {
+            ++i;
+            options->metricsSocketPath = value;
+        } else if (strcmp(name, "--impairment") == 0) {
+            ++i;
+            options->impairmentFilename = value;
+        } else if (strcmp(name, "--impairment-seed") == 0) {
+            ++i;
+            options->impairmentSeed = (uint32_t) strtoul(value, 0, 10);
+        } else {
+            CLOG_WARN("unknown option '%s'", name)
+        }
+    }
+}
 
+int main(int argc, char* argv[])
+{
     g_clog.log = clog_console;
     g_clog.level = CLOG_TYPE_DEBUG;
 
     CLOG_VERBOSE("Nimble Ball start!")
 
-    ImprintDefaultSetup imprintDefaultSetup;
-    imprintDefaultSetupInit(&imprintDefaultSetup, 5 * 1024 * 1024);
-
     // App Initialization
     NlApp app;
     nlFrontendInit(&app.frontend);
     app.phase = NlAppPhaseIdle;
     app.nimbleServerIsStarted = false;
-    app.allocator = &imprintDefaultSetup.tagAllocator.info;
-    app.allocatorWithFree = &imprintDefaultSetup.slabAllocator.info;
     app.log.config = &g_clog;
     app.log.constantPrefix = "App";
+    nlSessionMemoryInit(&app.hostSession, "host", 5 * 1024 * 1024, app.log);
+    nlSessionMemoryInit(&app.clientSession, "client", 5 * 1024 * 1024, app.log);
+
+    NlAppOptions options;
+    parseOptions(&options, argc, argv);
+    app.useHostThread = options.useHostThread;
+
+    bool isLoggingToFile = false;
+    if (options.logFilename != 0) {
+        if (nlAsyncLogStart(options.logFilename) < 0) {
+            CLOG_WARN("could not open log file '%s'", options.logFilename)
+        } else {
+            // Only the backend changes, the log level stays as configured
+            g_clog.log = nlAsyncLogClog;
+            isLoggingToFile = true;
+        }
+    }
 
     CpuBoundSimulatorSetup setup;
 
@@ -590,48 +1205,244 @@ int main(int argc, char* argv[])
     predictedLog.config = &g_clog;
     nlSimulationVmInit(&app.predicted, predictedLog);
 
+    app.isRecording = false;
+    if (options.recordFilename != 0) {
+        NlRecordingHeader recordingHeader;
+        recordingHeader.version = app.authoritative.transmuteVm.version;
+        recordingHeader.stateOctetCount = sizeof(NlGame);
+        Clog recorderLog;
+        recorderLog.constantPrefix = "Recorder";
+        recorderLog.config = &g_clog;
+        if (nlRecorderInit(&app.recorder, options.recordFilename, recordingHeader, recorderLog) >= 0) {
+            // The replay starts from the same default game, so the first state is only a small delta
+            static NlGame defaultGame;
+            nlGameInit(&defaultGame);
+            TransmuteState baseline;
+            baseline.state = &defaultGame;
+            baseline.octetSize = sizeof(defaultGame);
+            nlRecorderSetBaseline(&app.recorder, &baseline);
+            nlRecordingVmInit(&app.recordingAuthoritative, &app.authoritative.transmuteVm, &app.recorder,
+                              options.recordHashInterval);
+            app.isRecording = true;
+        }
+    }
+
+    Clog stateCheckLog;
+    stateCheckLog.constantPrefix = "StateCheck";
+    stateCheckLog.config = &g_clog;
+    nlSimulationVmInit(&app.stateCheckShadow, stateCheckLog);
+    TransmuteVm* authoritativeVm = app.isRecording ? &app.recordingAuthoritative.transmuteVm
+                                                   : &app.authoritative.transmuteVm;
+    nlStateCheckVmInit(&app.stateCheck, authoritativeVm, &app.stateCheckShadow.transmuteVm,
+                       options.stateCheckInterval, stateCheckLog);
+
+    Clog predictionGovernorLog;
+    predictionGovernorLog.constantPrefix = "PredictionGovernor";
+    predictionGovernorLog.config = &g_clog;
+    NlPredictionGovernorSetup predictionGovernorSetup;
+    nlPredictionGovernorSetupInit(&predictionGovernorSetup);
+    predictionGovernorSetup.predictionBudget = options.predictionBudget;
+    nlPredictionGovernorInit(&app.predictionGovernor, &app.predicted.transmuteVm, &predictionGovernorSetup,
+                             predictionGovernorLog);
+    app.usePredictionGovernor = options.predictionBudget > 0U;
+    TransmuteVm* predictedVm = app.usePredictionGovernor ? &app.predictionGovernor.transmuteVm
+                                                         : &app.predicted.transmuteVm;
+
+    // Outside of the governor, so it only measures ticks that are simulated and still budgets for a full re-prediction
+    app.usePredictionCache = options.usePredictionCache;
+    if (app.usePredictionCache) {
+        Clog predictionCacheLog;
+        predictionCacheLog.constantPrefix = "PredictionCache";
+        predictionCacheLog.config = &g_clog;
+        nlPredictionCacheInit(&app.predictionCache, predictedVm, predictionCacheLog);
+        predictedVm = &app.predictionCache.transmuteVm;
+    }
+
+    Clog mispredictionLog;
+    mispredictionLog.constantPrefix = "Misprediction";
+    mispredictionLog.config = &g_clog;
+    nlMispredictionTrackerInit(&app.mispredictionTracker, predictedVm, mispredictionLog);
+    if (app.usePredictionCache) {
+        // The tracker is outside of the cache, it sees the skipped ticks too
+        nlMispredictionTrackerSetSkippedTickCounter(&app.mispredictionTracker, &app.predictionCache.skippedTickCount);
+    }
+
     // Client Initialization
     NlAppClient client;
     client.hasSavedSecret = false;
     client.savedSecret = 0;
+    client.recorder = app.isRecording ? &app.recorder : 0;
     srGamepadInit(&client.gamepads[0]);
     srGamepadInit(&client.gamepads[1]);
     srFunctionKeysInit(&client.functionKeysPressedLast);
     srFunctionKeysInit(&client.functionKeys);
+    srGamepadInit(&client.networkInput.gamepads[0]);
+    srGamepadInit(&client.networkInput.gamepads[1]);
+    srFunctionKeysInit(&client.networkInput.functionKeys);
+    srFunctionKeysInit(&client.networkFunctionKeysPressedLast);
+    client.networkInput.localPlayerCount = 0U;
+    nlHistogramInit(&client.latencyHistogram);
+    nlHistogramInit(&client.authoritativeBufferHistogram);
+    client.droppedPacketCount = 0U;
+    client.overwrittenPacketCount = 0U;
+    client.lagometerWriteIndex = 0U;
+    client.lagometerCount = 0U;
+    client.useInterpolation = options.useInterpolation;
+
+    static NlImpairmentProfile impairmentProfile;
+    client.isImpaired = options.impairmentFilename != 0 &&
+                        nlImpairmentProfileLoad(&impairmentProfile, options.impairmentFilename) >= 0;
+    if (client.isImpaired) {
+        // The client transport is only set up when joining, it is handed over in nlImpairedTransportRestart()
+        DatagramTransport noTransport;
+        tc_mem_clear_type(&noTransport);
+        nlImpairedTransportInit(&client.impairedTransport, noTransport, &impairmentProfile, options.impairmentSeed);
+    }
+    nlInterpolatorInit(&client.interpolator, 16000U);
 
     statsIntPerSecondInit(&client.renderFps, monotonicTimeMsNow(), 1000);
     srWindowInit(&client.window, 640, 360, "nimble ball");
     srAudioInit(&client.mixer);
     nlAudioInit(&client.audio, &client.mixer);
     nlRenderInit(&client.inGame, client.window.renderer);
-    nlFrontendRenderInit(&client.frontendRender, &client.window, client.inGame.font);
+    nlTextCacheInit(&client.textCache, client.window.renderer);
+    nlFrontendRenderInit(&client.frontendRender, &client.window, client.inGame.font, &client.textCache);
     nlLagometerRenderInit(&client.lagometerRender, &client.window, client.inGame.font, &client.inGame.rectangleRender);
+    nlMispredictionRenderInit(&client.mispredictionRender, &client.inGame.rectangleRender);
+    client.isMispredictionOverlayVisible = false;
     nlNetworkIconsRenderInit(&client.networkIconsRender, &client.inGame.spriteRender,
                              client.inGame.jerseySprite[0].texture);
+    initializeHud(&client);
     client.log = app.log;
 
+    Clog frameSchedulerLog;
+    frameSchedulerLog.config = &g_clog;
+    frameSchedulerLog.constantPrefix = "FrameScheduler";
+    nlFrameSchedulerInit(&client.frameScheduler, options.frameSchedulerMode, options.targetFps, options.menuFps,
+                         frameSchedulerLog);
+    if (options.frameSchedulerMode == NlFrameSchedulerModeVsync) {
+        SDL_RenderSetVSync(client.window.renderer, 1);
+    }
+
+    static NlAppMetrics appMetrics;
+    bool useMetrics = options.metricsSocketPath != 0 &&
+                      appMetricsInit(&appMetrics, options.metricsSocketPath, app.log) >= 0;
+
     // Host Initialization
     NlAppHost host;
 
+    NL_TRACE_THREAD_NAME("main")
+
+    captureRenderSnapshot(&app, &client, &client.renderSnapshot);
+    const NlAppRenderSnapshot* snapshot = &client.renderSnapshot;
+
+    static NlAppNetworkThread networkThread;
+    bool useNetworkThread = options.useNetworkThread;
+    if (useNetworkThread) {
+        const NlClockMicros networkTickDuration = 2000U;
+        if (networkThreadStart(&networkThread, &app, &host, &client, networkTickDuration) < 0) {
+            useNetworkThread = false;
+        }
+    }
+
+    NL_TRACE_BEGIN("frame")
     while (pollInputAndHandleSpecialButtons(&client)) {
-        nlFrontendHandleInput(&app.frontend, &client.gamepads[0]);
-        switch (app.phase) {
-            case NlAppPhaseIdle:
-                updateFrontendInIdle(&app, &host, &client);
-                break;
-
-            case NlAppPhaseNetwork: {
-                updateInNetwork(&app, &host, &client);
-            } break;
+        if (useNetworkThread) {
+            captureNetworkInput(&client, snapshot,
+                                (NlAppNetworkInput*) nlTripleBufferWriteSlot(&networkThread.inputMailbox));
+            nlTripleBufferPublish(&networkThread.inputMailbox);
+            // Keeps presenting the previous snapshot until a newer one has been published
+            if (nlTripleBufferConsume(&networkThread.snapshotMailbox)) {
+                snapshot = (const NlAppRenderSnapshot*) nlTripleBufferReadSlot(&networkThread.snapshotMailbox);
+            }
+        } else {
+            captureNetworkInput(&client, &client.renderSnapshot, &client.networkInput);
+            updateNetwork(&app, &host, &client);
+            captureRenderSnapshot(&app, &client, &client.renderSnapshot);
         }
 
-        presentPredictedAndAuthoritativeStatesAndFrontend(&app, &client);
+        presentRenderSnapshot(&client, snapshot);
 
         statsIntPerSecondAdd(&client.renderFps, 1);
         statsIntPerSecondUpdate(&client.renderFps, monotonicTimeMsNow());
+
+        if (useMetrics) {
+            appMetricsUpdate(&appMetrics, &client, snapshot);
+        }
+
+        nlFrameSchedulerSetLowPower(&client.frameScheduler, snapshot->frontend.phase == NlFrontendPhaseMainMenu);
+        nlFrameSchedulerSetRecordFrameTimes(&client.frameScheduler, snapshot->frontend.phase == NlFrontendPhaseInGame);
+        nlFrameSchedulerSetReducedRate(&client.frameScheduler,
+                                       options.reduceRenderOverBudget && snapshot->isPredictionOverBudget);
+        NL_TRACE_BEGIN("waitForNextFrame")
+        nlFrameSchedulerWaitForNextFrame(&client.frameScheduler);
+        NL_TRACE_END()
+
+        NL_TRACE_END()
+        NL_TRACE_BEGIN("frame")
+    }
+    NL_TRACE_END()
+
+    if (useNetworkThread) {
+        networkThreadStop(&networkThread);
+    }
+
+    endSessions(&app, &client);
+    if (app.stateCheck.checkInterval > 0U) {
+        CLOG_C_INFO(&app.log, "determinism self-check: %zu ticks, %zu checks, %zu mismatches",
+                    app.stateCheck.tickCount, app.stateCheck.checkCount, app.stateCheck.mismatchCount)
+    }
+    if (app.usePredictionGovernor) {
+        const NlPredictionGovernorStats* governorStats = &app.predictionGovernor.stats;
+        CLOG_C_INFO(&app.log, "prediction window %zu ticks, tick cost %d us, %zu adjustments, %zu updates over budget",
+                    governorStats->ticksFromAuthoritative, (int) governorStats->tickCost,
+                    governorStats->adjustmentCount, governorStats->overBudgetUpdateCount)
+    }
+    if (app.usePredictionCache) {
+        const NlPredictionCache* cache = &app.predictionCache;
+        CLOG_C_INFO(&app.log, "prediction cache: %zu ticks simulated, %zu skipped, %zu of %zu rollbacks matched",
+                    cache->simulatedTickCount, cache->skippedTickCount, cache->matchingRollbackCount,
+                    cache->rollbackCount)
+        nlPredictionCacheDestroy(&app.predictionCache);
+    }
+    logNetworkHistograms(&client);
+    nlMispredictionTrackerLog(&app.mispredictionTracker);
+    nlHistogramLog(&client.frameScheduler.frameTimes, "frame time", "us", &client.log);
+    nlSessionMemoryLogHighWater(&app.hostSession);
+    nlSessionMemoryLogHighWater(&app.clientSession);
+
+    if (app.isRecording) {
+        TransmuteState finalState = transmuteVmGetState(&app.authoritative.transmuteVm);
+        nlRecorderWriteStateHash(&app.recorder, nlStateHash(finalState.state, finalState.octetSize));
+        nlRecorderClose(&app.recorder);
+    }
+
+    NL_TRACE_WRITE(nlTraceFilename)
+
+    if (useMetrics) {
+        nlMetricsEndpointDestroy(&appMetrics.endpoint);
     }
 
+    if (client.isImpaired) {
+        const NlImpairment* impairment = &client.impairedTransport.impairment;
+        CLOG_C_INFO(&app.log, "impairment out: %zu passed %zu dropped %zu reordered, in: %zu passed %zu dropped %zu "
+                              "reordered",
+                    impairment->outgoing.passedCount, impairment->outgoing.droppedCount,
+                    impairment->outgoing.reorderedCount, impairment->incoming.passedCount,
+                    impairment->incoming.droppedCount, impairment->incoming.reorderedCount)
+        nlImpairedTransportDestroy(&client.impairedTransport);
+    }
+
+    nlHudDestroy(&client.hud);
+    nlTextCacheDestroy(&client.textCache);
     nlRenderClose(&client.inGame);
     srAudioClose(&client.mixer);
     srWindowClose(&client.window);
+
+    if (isLoggingToFile) {
+        g_clog.log = clog_console;
+        size_t droppedCount = nlAsyncLogDroppedCount();
+        nlAsyncLogStop();
+        CLOG_INFO("wrote log to '%s', %zu lines dropped", options.logFilename, droppedCount)
+    }
 }
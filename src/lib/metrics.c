@@ -0,0 +1,286 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "metrics.h"
+#include <tiny-libc/tiny_libc.h>
+
+void nlMetricsInit(NlMetrics* self)
+{
+    self->count = 0U;
+}
+
+/// Adds a metric with a zero value
+/// @param self metrics
+/// @param name Prometheus metric name, e.g. `nimble_ball_latency_ms`
+/// @param help one line description
+/// @param type gauge or counter
+/// @return index to use with nlMetricsSet()
+size_t nlMetricsRegister(NlMetrics* self, const char* name, const char* help, NlMetricType type)
+{
+    CLOG_ASSERT(self->count < NL_METRICS_MAX_COUNT, "too many metrics")
+    NlMetric* metric = &self->metrics[self->count];
+    metric->name = name;
+    metric->help = help;
+    metric->type = type;
+    metric->value = 0;
+
+    return self->count++;
+}
+
+void nlMetricsSet(NlMetrics* self, size_t index, int64_t value)
+{
+    self->metrics[index].value = value;
+}
+
+/// Writes all metrics in the Prometheus text exposition format
+/// @param self metrics
+/// @param target target buffer
+/// @param maxTargetOctetCount capacity of target
+/// @return octet count written, negative if target is too small
+int nlMetricsWritePrometheus(const NlMetrics* self, char* target, size_t maxTargetOctetCount)
+{
+    size_t octetCount = 0U;
+
+    for (size_t i = 0U; i < self->count; ++i) {
+        const NlMetric* metric = &self->metrics[i];
+        int written = tc_snprintf(target + octetCount, maxTargetOctetCount - octetCount,
+                                  "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", metric->name, metric->help, metric->name,
+                                  metric->type == NlMetricTypeCounter ? "counter" : "gauge", metric->name,
+                                  (long long) metric->value);
+        if (written < 0 || (size_t) written >= maxTargetOctetCount - octetCount) {
+            return -1;
+        }
+        octetCount += (size_t) written;
+    }
+
+    return (int) octetCount;
+}
+
+#if defined _WIN32
+
+int nlMetricsEndpointInit(NlMetricsEndpoint* self, const char* path, Clog log)
+{
+    (void) path;
+    self->log = log;
+    self->handle = -1;
+    CLOG_C_WARN(&self->log, "metrics endpoint is not supported on this platform")
+    return -1;
+}
+
+void nlMetricsEndpointUpdate(NlMetricsEndpoint* self, const NlMetrics* metrics)
+{
+    (void) self;
+    (void) metrics;
+}
+
+void nlMetricsEndpointDestroy(NlMetricsEndpoint* self)
+{
+    (void) self;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A scraper that has not sent a request and read the whole response this long after connecting is dropped
+static const NlClockMicros nlMetricsEndpointTimeout = 1000000U;
+
+// A scraper that disconnects early must not raise SIGPIPE. Linux has a flag for each send, macOS and the BSDs a
+// socket option instead (set in nlMetricsEndpointUpdate()).
+#if defined MSG_NOSIGNAL
+#define NL_METRICS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NL_METRICS_SEND_FLAGS 0
+#endif
+
+static int setNonBlocking(int handle)
+{
+    int flags = fcntl(handle, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(handle, F_SETFL, flags | O_NONBLOCK);
+}
+
+/// Listens on a Unix socket. An old socket file at path is removed first.
+/// @param self endpoint
+/// @param path file system path of the socket
+/// @param log log
+/// @return negative on error
+int nlMetricsEndpointInit(NlMetricsEndpoint* self, const char* path, Clog log)
+{
+    self->log = log;
+    self->path = path;
+    self->pendingCount = 0U;
+    self->servedCount = 0U;
+
+    struct sockaddr_un address;
+    tc_mem_clear_type(&address);
+    address.sun_family = AF_UNIX;
+    size_t pathOctetCount = tc_strlen(path);
+    if (pathOctetCount >= sizeof(address.sun_path)) {
+        CLOG_C_WARN(&self->log, "metrics socket path '%s' is too long", path)
+        self->handle = -1;
+        return -1;
+    }
+    tc_memcpy_octets(address.sun_path, path, pathOctetCount + 1U);
+
+    self->handle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (self->handle < 0) {
+        return -2;
+    }
+
+    unlink(path);
+    if (bind(self->handle, (const struct sockaddr*) &address, sizeof(address)) < 0 ||
+        listen(self->handle, NL_METRICS_ENDPOINT_MAX_PENDING) < 0 || setNonBlocking(self->handle) < 0) {
+        CLOG_C_WARN(&self->log, "could not listen on metrics socket '%s' %d", path, errno)
+        close(self->handle);
+        self->handle = -1;
+        return -3;
+    }
+
+    CLOG_C_INFO(&self->log, "serving metrics on '%s'", path)
+
+    return 0;
+}
+
+/// Writes the HTTP response with the current metrics into the buffer of the connection
+/// @return negative if the metrics do not fit
+static int prepareResponse(NlMetricsEndpoint* self, NlMetricsConnection* connection, const NlMetrics* metrics)
+{
+    int bodyOctetCount = nlMetricsWritePrometheus(metrics, self->body, sizeof(self->body));
+    if (bodyOctetCount < 0) {
+        return -1;
+    }
+
+    int headerOctetCount = tc_snprintf(connection->response, sizeof(connection->response),
+                                       "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                       "Content-Length: %d\r\n\r\n",
+                                       bodyOctetCount);
+    if (headerOctetCount < 0 || (size_t) headerOctetCount + (size_t) bodyOctetCount > sizeof(connection->response)) {
+        return -2;
+    }
+    tc_memcpy_octets(connection->response + headerOctetCount, self->body, (size_t) bodyOctetCount);
+
+    connection->isResponding = true;
+    connection->responseOctetCount = (size_t) headerOctetCount + (size_t) bodyOctetCount;
+    connection->sentOctetCount = 0U;
+
+    return 0;
+}
+
+/// Sends as much of the response as the socket buffer takes, without waiting
+/// @return 1 when the whole response is sent, 0 when the rest must wait for a later update, negative if the scraper
+/// is gone
+static int sendResponse(NlMetricsConnection* connection)
+{
+    while (connection->sentOctetCount < connection->responseOctetCount) {
+        ssize_t sentOctetCount = send(connection->handle, connection->response + connection->sentOctetCount,
+                                      connection->responseOctetCount - connection->sentOctetCount,
+                                      NL_METRICS_SEND_FLAGS);
+        if (sentOctetCount < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        connection->sentOctetCount += (size_t) sentOctetCount;
+    }
+
+    return 1;
+}
+
+static void removePending(NlMetricsEndpoint* self, size_t index)
+{
+    close(self->pending[index].handle);
+    self->pending[index] = self->pending[--self->pendingCount];
+}
+
+/// Accepts new scrapers, answers the ones that have sent their request and continues the responses that did not
+/// fit in the socket buffer before. Call once every frame or tick.
+/// @param self endpoint
+/// @param metrics metrics to serve
+void nlMetricsEndpointUpdate(NlMetricsEndpoint* self, const NlMetrics* metrics)
+{
+    if (self->handle < 0) {
+        return;
+    }
+
+    NlClockMicros now = nlClockNowMicros();
+
+    while (self->pendingCount < NL_METRICS_ENDPOINT_MAX_PENDING) {
+        int connection = accept(self->handle, 0, 0);
+        if (connection < 0) {
+            break;
+        }
+        if (setNonBlocking(connection) < 0) {
+            close(connection);
+            continue;
+        }
+#if defined SO_NOSIGPIPE
+        int noSigPipe = 1;
+        setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+        self->pending[self->pendingCount].handle = connection;
+        self->pending[self->pendingCount].acceptedAt = now;
+        self->pending[self->pendingCount].isResponding = false;
+        self->pendingCount++;
+    }
+
+    size_t i = 0U;
+    while (i < self->pendingCount) {
+        NlMetricsConnection* connection = &self->pending[i];
+
+        if (connection->isResponding) {
+            int result = sendResponse(connection);
+            if (result > 0) {
+                self->servedCount++;
+                removePending(self, i);
+                continue;
+            }
+            if (result < 0 || now - connection->acceptedAt > nlMetricsEndpointTimeout) {
+                CLOG_C_NOTICE(&self->log, "scraper went away or did not read the metrics in time")
+                removePending(self, i);
+                continue;
+            }
+            ++i;
+            continue;
+        }
+
+        char request[512];
+        ssize_t requestOctetCount = recv(connection->handle, request, sizeof(request), 0);
+        if (requestOctetCount < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (now - connection->acceptedAt > nlMetricsEndpointTimeout) {
+                removePending(self, i);
+                continue;
+            }
+            ++i;
+            continue;
+        }
+
+        // The request is not parsed, every path gets the metrics. The response is started right away.
+        if (requestOctetCount > 0 && prepareResponse(self, connection, metrics) >= 0) {
+            continue;
+        }
+
+        removePending(self, i);
+    }
+}
+
+void nlMetricsEndpointDestroy(NlMetricsEndpoint* self)
+{
+    if (self->handle < 0) {
+        return;
+    }
+
+    while (self->pendingCount > 0U) {
+        removePending(self, 0U);
+    }
+    close(self->handle);
+    unlink(self->path);
+    self->handle = -1;
+}
+
+#endif
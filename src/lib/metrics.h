@@ -0,0 +1,69 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_METRICS_H
+#define NIMBLE_BALL_METRICS_H
+
+#include "clock.h"
+#include <clog/clog.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_METRICS_MAX_COUNT (32)
+#define NL_METRICS_ENDPOINT_MAX_PENDING (4)
+#define NL_METRICS_ENDPOINT_OCTET_COUNT (8 * 1024)
+
+typedef enum NlMetricType {
+    NlMetricTypeGauge,
+    NlMetricTypeCounter,
+} NlMetricType;
+
+typedef struct NlMetric {
+    const char* name;
+    const char* help;
+    NlMetricType type;
+    int64_t value;
+} NlMetric;
+
+/// Named values that subsystems publish into and that can be written in the Prometheus text format.
+/// Names and help texts must be string literals. Not thread safe, publish and export from the same thread.
+typedef struct NlMetrics {
+    NlMetric metrics[NL_METRICS_MAX_COUNT];
+    size_t count;
+} NlMetrics;
+
+void nlMetricsInit(NlMetrics* self);
+size_t nlMetricsRegister(NlMetrics* self, const char* name, const char* help, NlMetricType type);
+void nlMetricsSet(NlMetrics* self, size_t index, int64_t value);
+int nlMetricsWritePrometheus(const NlMetrics* self, char* target, size_t maxTargetOctetCount);
+
+/// A scraper that has not sent its request yet, or that has not read all of its response yet
+typedef struct NlMetricsConnection {
+    int handle;
+    NlClockMicros acceptedAt;
+    bool isResponding;
+    size_t responseOctetCount;
+    size_t sentOctetCount;
+    char response[NL_METRICS_ENDPOINT_OCTET_COUNT];
+} NlMetricsConnection;
+
+/// Serves the metrics as an HTTP response on a local Unix socket, for example
+/// `curl --unix-socket <path> http://localhost/metrics`. Polled, never blocks: a response that does not fit in the
+/// socket buffer is continued on the following updates.
+typedef struct NlMetricsEndpoint {
+    int handle;
+    const char* path;
+    NlMetricsConnection pending[NL_METRICS_ENDPOINT_MAX_PENDING];
+    size_t pendingCount;
+    size_t servedCount;
+    char body[NL_METRICS_ENDPOINT_OCTET_COUNT];
+    Clog log;
+} NlMetricsEndpoint;
+
+int nlMetricsEndpointInit(NlMetricsEndpoint* self, const char* path, Clog log);
+void nlMetricsEndpointUpdate(NlMetricsEndpoint* self, const NlMetrics* metrics);
+void nlMetricsEndpointDestroy(NlMetricsEndpoint* self);
+
+#endif
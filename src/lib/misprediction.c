@@ -0,0 +1,214 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "misprediction.h"
+#include "thread_log.h"
+#include <math.h>
+#include <tiny-libc/tiny_libc.h>
+
+static uint32_t positionError(NlVec2 predicted, NlVec2 authoritative)
+{
+    float dx = predicted.x - authoritative.x;
+    float dy = predicted.y - authoritative.y;
+    return (uint32_t) (sqrtf(dx * dx + dy * dy) * 100.0f + 0.5f);
+}
+
+static void rememberPredicted(NlMispredictionTracker* self)
+{
+    TransmuteState state = transmuteVmGetState(self->inner);
+    if (state.octetSize != sizeof(NlGame)) {
+        return;
+    }
+    const NlGame* game = (const NlGame*) state.state;
+
+    NlPredictedPositions* positions = &self->predicted[game->tickCount % NL_MISPREDICTION_TICK_CAPACITY];
+    positions->isSet = true;
+    positions->tickCount = game->tickCount;
+    positions->avatarCount = game->avatars.avatarCount;
+    for (size_t i = 0U; i < game->avatars.avatarCount; ++i) {
+        positions->avatars[i] = game->avatars.avatars[i].circle.center;
+    }
+    positions->ball = game->ball.circle.center;
+}
+
+/// Compares the authoritative state with what was predicted for the same tick
+/// @return false if nothing was predicted for the tick
+static bool compareWithPredicted(const NlMispredictionTracker* self, const NlGame* authoritative,
+                                 NlMispredictionSample* sample)
+{
+    const NlPredictedPositions* positions = &self->predicted[authoritative->tickCount %
+                                                             NL_MISPREDICTION_TICK_CAPACITY];
+    if (!positions->isSet || positions->tickCount != authoritative->tickCount) {
+        return false;
+    }
+
+    size_t avatarCount = positions->avatarCount < authoritative->avatars.avatarCount
+                             ? positions->avatarCount
+                             : authoritative->avatars.avatarCount;
+    sample->avatarError = 0U;
+    for (size_t i = 0U; i < avatarCount; ++i) {
+        uint32_t error = positionError(positions->avatars[i], authoritative->avatars.avatars[i].circle.center);
+        if (error > sample->avatarError) {
+            sample->avatarError = error;
+        }
+    }
+    sample->ballError = positionError(positions->ball, authoritative->ball.circle.center);
+
+    return true;
+}
+
+static void mispredictionTick(void* _self, const TransmuteInput* input)
+{
+    NlMispredictionTracker* self = (NlMispredictionTracker*) _self;
+    transmuteVmTick(self->inner, input);
+    if (self->isRollingBack) {
+        self->correction.rollbackTicks++;
+    }
+    rememberPredicted(self);
+}
+
+static TransmuteState mispredictionGetState(const void* _self)
+{
+    const NlMispredictionTracker* self = (const NlMispredictionTracker*) _self;
+    return transmuteVmGetState(self->inner);
+}
+
+static void mispredictionSetState(void* _self, const TransmuteState* state)
+{
+    NlMispredictionTracker* self = (NlMispredictionTracker*) _self;
+
+    // The predicted state is only set when rolling back to the latest authoritative state
+    self->isRollingBack = true;
+    self->correction.rollbackTicks = 0U;
+    self->correction.simulatedTicks = 0U;
+    self->skippedTickCountAtRollback = self->skippedTickCount != 0 ? *self->skippedTickCount : 0U;
+    if (state->octetSize == sizeof(NlGame)) {
+        self->hasCorrection = compareWithPredicted(self, (const NlGame*) state->state, &self->correction);
+    }
+
+    transmuteVmSetState(self->inner, state);
+}
+
+static int mispredictionStateToString(void* _self, const TransmuteState* state, char* target,
+                                      size_t maxTargetOctetSize)
+{
+    NlMispredictionTracker* self = (NlMispredictionTracker*) _self;
+    return self->inner->stateToString(self->inner->vmPointer, state, target, maxTargetOctetSize);
+}
+
+static int mispredictionInputToString(void* _self, const TransmuteParticipantInput* input, char* target,
+                                      size_t maxTargetOctetSize)
+{
+    NlMispredictionTracker* self = (NlMispredictionTracker*) _self;
+    return self->inner->inputToString(self->inner->vmPointer, input, target, maxTargetOctetSize);
+}
+
+/// Wraps the predicted simulation
+/// @param self tracker
+/// @param inner the predicted simulation
+/// @param log log
+void nlMispredictionTrackerInit(NlMispredictionTracker* self, TransmuteVm* inner, Clog log)
+{
+    self->inner = inner;
+    self->skippedTickCount = 0;
+    self->skippedTickCountAtRollback = 0U;
+    self->log = log;
+    self->correctionCount = 0U;
+    self->mispredictionCount = 0U;
+    nlHistogramInit(&self->avatarErrors);
+    nlHistogramInit(&self->ballErrors);
+    nlHistogramInit(&self->rollbackTicks);
+    nlHistogramInit(&self->simulatedTicks);
+    nlMispredictionTrackerReset(self);
+
+    TransmuteVmSetup vmSetup;
+    vmSetup.tickFn = mispredictionTick;
+    vmSetup.getStateFn = mispredictionGetState;
+    vmSetup.setStateFn = mispredictionSetState;
+    vmSetup.stateToString = mispredictionStateToString;
+    vmSetup.inputToString = mispredictionInputToString;
+    vmSetup.version = inner->version;
+
+    transmuteVmInit(&self->transmuteVm, self, vmSetup, inner->log);
+}
+
+/// Counts the ticks a prediction cache below the tracker skips, so they are not counted as simulated
+/// @param self tracker
+/// @param skippedTickCount skipped tick counter of the cache, e.g. NlPredictionCache::skippedTickCount
+void nlMispredictionTrackerSetSkippedTickCounter(NlMispredictionTracker* self, const size_t* skippedTickCount)
+{
+    self->skippedTickCount = skippedTickCount;
+}
+
+/// Forgets the predicted ticks and the latest corrections, for example when joining a new game.
+/// The histograms keep the whole session.
+/// @param self tracker
+void nlMispredictionTrackerReset(NlMispredictionTracker* self)
+{
+    for (size_t i = 0U; i < NL_MISPREDICTION_TICK_CAPACITY; ++i) {
+        self->predicted[i].isSet = false;
+    }
+    self->isRollingBack = false;
+    self->hasCorrection = false;
+    tc_mem_clear_type(&self->correction);
+    self->recentWriteIndex = 0U;
+    self->recentCount = 0U;
+}
+
+/// Call after every engine client update. Records the correction, if the update rolled back the prediction.
+/// @param self tracker
+void nlMispredictionTrackerUpdate(NlMispredictionTracker* self)
+{
+    if (!self->isRollingBack) {
+        return;
+    }
+    self->isRollingBack = false;
+
+    size_t skippedTickCount = self->skippedTickCount != 0 ? *self->skippedTickCount - self->skippedTickCountAtRollback
+                                                           : 0U;
+    self->correction.simulatedTicks = self->correction.rollbackTicks - (uint32_t) skippedTickCount;
+    nlHistogramRecord(&self->rollbackTicks, self->correction.rollbackTicks);
+    nlHistogramRecord(&self->simulatedTicks, self->correction.simulatedTicks);
+    if (!self->hasCorrection) {
+        return;
+    }
+    self->hasCorrection = false;
+
+    self->correctionCount++;
+    if (self->correction.avatarError > 0U || self->correction.ballError > 0U) {
+        self->mispredictionCount++;
+    }
+    nlHistogramRecord(&self->avatarErrors, self->correction.avatarError);
+    nlHistogramRecord(&self->ballErrors, self->correction.ballError);
+
+    self->recent[self->recentWriteIndex] = self->correction;
+    self->recentWriteIndex = (self->recentWriteIndex + 1U) % NL_MISPREDICTION_RECENT_COUNT;
+    if (self->recentCount < NL_MISPREDICTION_RECENT_COUNT) {
+        self->recentCount++;
+    }
+}
+
+/// Copies the latest corrections, oldest first
+/// @param self tracker
+/// @param graph target
+void nlMispredictionTrackerGraph(const NlMispredictionTracker* self, NlMispredictionGraph* graph)
+{
+    size_t readIndex = (self->recentWriteIndex + NL_MISPREDICTION_RECENT_COUNT - self->recentCount) %
+                       NL_MISPREDICTION_RECENT_COUNT;
+    for (size_t i = 0U; i < self->recentCount; ++i) {
+        graph->samples[i] = self->recent[(readIndex + i) % NL_MISPREDICTION_RECENT_COUNT];
+    }
+    graph->count = self->recentCount;
+}
+
+/// Logs the session long histograms
+/// @param self tracker
+void nlMispredictionTrackerLog(NlMispredictionTracker* self)
+{
+    NL_LOG_C_INFO(&self->log, "corrections: %zu mispredicted: %zu", self->correctionCount, self->mispredictionCount)
+    nlHistogramLog(&self->avatarErrors, "avatar position error", "1/100 units", &self->log);
+    nlHistogramLog(&self->ballErrors, "ball position error", "1/100 units", &self->log);
+    nlHistogramLog(&self->rollbackTicks, "rolled back ticks", "ticks", &self->log);
+    nlHistogramLog(&self->simulatedTicks, "re-simulated ticks", "ticks", &self->log);
+}
@@ -0,0 +1,76 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_MISPREDICTION_H
+#define NIMBLE_BALL_MISPREDICTION_H
+
+#include "histogram.h"
+#include <clog/clog.h>
+#include <nimble-ball-simulation/nimble_ball_simulation.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+#define NL_MISPREDICTION_TICK_CAPACITY (64)
+#define NL_MISPREDICTION_RECENT_COUNT (64)
+
+/// Positions predicted for a tick, kept until the authoritative state for the same tick arrives
+typedef struct NlPredictedPositions {
+    bool isSet;
+    uint32_t tickCount;
+    size_t avatarCount;
+    NlVec2 avatars[NL_MAX_AVATARS];
+    NlVec2 ball;
+} NlPredictedPositions;
+
+/// A single correction. Errors are in hundredths of a simulation unit. The rolled back ticks are all ticks that were
+/// predicted again after the rollback, the simulated ticks are the ones of them that were not skipped by a cache.
+typedef struct NlMispredictionSample {
+    uint32_t avatarError;
+    uint32_t ballError;
+    uint32_t rollbackTicks;
+    uint32_t simulatedTicks;
+} NlMispredictionSample;
+
+/// The latest corrections, oldest first
+typedef struct NlMispredictionGraph {
+    NlMispredictionSample samples[NL_MISPREDICTION_RECENT_COUNT];
+    size_t count;
+} NlMispredictionGraph;
+
+/// Wraps the predicted simulation and remembers the avatar and ball positions of every predicted tick.
+/// When the predicted state is rolled back to a newer authoritative state, the positions that were
+/// predicted for that tick are compared to the authoritative ones, and the ticks that are predicted again
+/// after the rollback are counted. When the tracker wraps a prediction cache, the ticks the cache skipped
+/// are read from its counter, so the ticks that were really simulated are counted separately.
+typedef struct NlMispredictionTracker {
+    TransmuteVm transmuteVm;
+    TransmuteVm* inner;
+    const size_t* skippedTickCount;
+    size_t skippedTickCountAtRollback;
+    NlPredictedPositions predicted[NL_MISPREDICTION_TICK_CAPACITY];
+    bool isRollingBack;
+    bool hasCorrection;
+    NlMispredictionSample correction;
+    NlMispredictionSample recent[NL_MISPREDICTION_RECENT_COUNT];
+    size_t recentWriteIndex;
+    size_t recentCount;
+    NlHistogram avatarErrors;
+    NlHistogram ballErrors;
+    NlHistogram rollbackTicks;
+    NlHistogram simulatedTicks;
+    size_t correctionCount;
+    size_t mispredictionCount;
+    Clog log;
+} NlMispredictionTracker;
+
+void nlMispredictionTrackerInit(NlMispredictionTracker* self, TransmuteVm* inner, Clog log);
+void nlMispredictionTrackerSetSkippedTickCounter(NlMispredictionTracker* self, const size_t* skippedTickCount);
+void nlMispredictionTrackerReset(NlMispredictionTracker* self);
+void nlMispredictionTrackerUpdate(NlMispredictionTracker* self);
+void nlMispredictionTrackerGraph(const NlMispredictionTracker* self, NlMispredictionGraph* graph);
+void nlMispredictionTrackerLog(NlMispredictionTracker* self);
+
+#endif
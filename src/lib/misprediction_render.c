@@ -0,0 +1,86 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "misprediction_render.h"
+#include <sdl-render/rect.h>
+#include <tiny-libc/tiny_libc.h>
+
+static const int nlMispredictionBarWidth = 4;
+static const int nlMispredictionFullBarHeight = 100;
+
+void nlMispredictionRenderInit(NlMispredictionRender* self, SrRects* rectsRender)
+{
+    self->rectsRender = rectsRender;
+
+    Uint8 alpha = 68;
+    NlBarBatches* barBatches = &self->barBatches;
+    nlBarBatchesInit(barBatches, rectsRender, NlMispredictionBarTypeCount);
+    nlBarBatchesSetColor(barBatches, NlMispredictionBarTypeExact, 0x33, 0xee, 0xcc, alpha);
+    nlBarBatchesSetColor(barBatches, NlMispredictionBarTypeAvatarError, 0xff, 0x22, 0x11, alpha);
+    nlBarBatchesSetColor(barBatches, NlMispredictionBarTypeBallError, 0xff, 0xee, 0x11, alpha);
+    nlBarBatchesSetColor(barBatches, NlMispredictionBarTypeRollback, 0xff, 0xff, 0xff, 0xcc);
+    nlBarBatchesSetBackgroundColor(barBatches, 0x22, 0x33, 0xee, alpha);
+}
+
+static int clampHeight(uint32_t value, float factor, int fullHeight)
+{
+    int height = (int) ((float) value * factor);
+    return height > fullHeight ? fullHeight : height;
+}
+
+/// Turns the latest corrections into the bars that are drawn for them
+/// @param graph corrections
+/// @param bars target bars
+void nlMispredictionRenderBars(const NlMispredictionGraph* graph, NlMispredictionBars* bars)
+{
+    // A full bar is a position error of 20 units or 25 re-simulated ticks
+    const float errorFactor = (float) nlMispredictionFullBarHeight / 2000.0f;
+    const float rollbackFactor = (float) nlMispredictionFullBarHeight / 25.0f;
+
+    for (size_t i = 0U; i < graph->count; ++i) {
+        const NlMispredictionSample* sample = &graph->samples[i];
+        NlMispredictionBar* bar = &bars->bars[i];
+
+        if (sample->avatarError == 0U && sample->ballError == 0U) {
+            bar->type = NlMispredictionBarTypeExact;
+            bar->height = 2U;
+        } else {
+            bar->type = sample->avatarError >= sample->ballError ? NlMispredictionBarTypeAvatarError
+                                                                 : NlMispredictionBarTypeBallError;
+            uint32_t error = sample->avatarError >= sample->ballError ? sample->avatarError : sample->ballError;
+            int height = clampHeight(error, errorFactor, nlMispredictionFullBarHeight);
+            bar->height = (uint8_t) (height > 2 ? height : 2);
+        }
+
+        bar->rollbackHeight =
+            (uint8_t) clampHeight(sample->simulatedTicks, rollbackFactor, nlMispredictionFullBarHeight);
+    }
+    // Bars that are not used are cleared, so equal bars compare equal
+    tc_mem_clear_type_n(&bars->bars[graph->count], NL_MISPREDICTION_RECENT_COUNT - graph->count);
+    bars->count = graph->count;
+}
+
+/// Renders the latest corrections with one background fill and one batched fill for each bar color.
+/// The graph is placed right above the lagometer.
+/// @param self misprediction render
+/// @param bars bars from nlMispredictionRenderBars()
+void nlMispredictionRenderUpdate(NlMispredictionRender* self, const NlMispredictionBars* bars)
+{
+    const int fullGraphWidth = NL_MISPREDICTION_RECENT_COUNT * nlMispredictionBarWidth;
+    const int xOffset = self->rectsRender->width - fullGraphWidth - 20;
+    const int yOffset = 220;
+
+    NlBarBatches* barBatches = &self->barBatches;
+    nlBarBatchesFillBackground(barBatches, xOffset, yOffset, fullGraphWidth, nlMispredictionFullBarHeight + 2);
+
+    nlBarBatchesClear(barBatches);
+    for (size_t i = 0U; i < bars->count; ++i) {
+        const NlMispredictionBar* bar = &bars->bars[i];
+        int x = (int) i * nlMispredictionBarWidth + xOffset;
+        nlBarBatchesAdd(barBatches, bar->type, x, yOffset, nlMispredictionBarWidth, bar->height);
+        nlBarBatchesAdd(barBatches, NlMispredictionBarTypeRollback, x, yOffset + bar->rollbackHeight,
+                        nlMispredictionBarWidth, 2);
+    }
+    nlBarBatchesSubmit(barBatches);
+}
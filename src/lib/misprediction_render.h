@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_MISPREDICTION_RENDER_H
+#define NIMBLE_BALL_MISPREDICTION_RENDER_H
+
+#include "bar_batch.h"
+#include "misprediction.h"
+#include <stdint.h>
+
+struct SrRects;
+
+typedef enum NlMispredictionBarType {
+    NlMispredictionBarTypeExact,
+    NlMispredictionBarTypeAvatarError,
+    NlMispredictionBarTypeBallError,
+    NlMispredictionBarTypeRollback,
+    NlMispredictionBarTypeCount,
+} NlMispredictionBarType;
+
+/// A correction as it is drawn. Only holds what is drawn, so it can be compared to find out if the graph changed.
+typedef struct NlMispredictionBar {
+    uint8_t type;
+    uint8_t height;
+    uint8_t rollbackHeight;
+} NlMispredictionBar;
+
+/// The latest corrections as bars, oldest first
+typedef struct NlMispredictionBars {
+    NlMispredictionBar bars[NL_MISPREDICTION_RECENT_COUNT];
+    size_t count;
+} NlMispredictionBars;
+
+/// Draws the latest corrections above the lagometer. Each correction is a bar with the largest position error,
+/// and a mark at the height of the number of re-simulated ticks.
+typedef struct NlMispredictionRender {
+    struct SrRects* rectsRender;
+    NlBarBatches barBatches;
+} NlMispredictionRender;
+
+void nlMispredictionRenderInit(NlMispredictionRender* self, struct SrRects* rectsRender);
+void nlMispredictionRenderBars(const NlMispredictionGraph* graph, NlMispredictionBars* bars);
+void nlMispredictionRenderUpdate(NlMispredictionRender* self, const NlMispredictionBars* bars);
+
+#endif
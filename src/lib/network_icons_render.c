@@ -40,6 +40,15 @@ static void setupDisconnectedSprite(SrSprite* sprite, SDL_Texture* texture)
     sprite->texture = texture;
 }
 
+static void setupNondeterministicSprite(SrSprite* sprite, SDL_Texture* texture)
+{
+    sprite->rect.x = 128;
+    sprite->rect.y = 80;
+    sprite->rect.w = 32;
+    sprite->rect.h = 32;
+    sprite->texture = texture;
+}
+
 void nlNetworkIconsRenderInit(NlNetworkIconsRender* self, struct SrSprites* spritesRender, SDL_Texture* texture)
 {
     self->spritesRender = spritesRender;
@@ -47,6 +56,7 @@ void nlNetworkIconsRenderInit(NlNetworkIconsRender* self, struct SrSprites* spri
     setupAuthoritativeTimeIntervalWarningSprite(&self->authoritativeTimeIntervalWarningSprite, texture);
     setupImpendingDisconnectSprite(&self->impendingDisconnectWarningSprite, texture);
     setupDisconnectedSprite(&self->disconnectedSprite, texture);
+    setupNondeterministicSprite(&self->nondeterministicSprite, texture);
 }
 
 void nlNetworkIconsRenderUpdate(NlNetworkIconsRender* self, NlNetworkIconsState state)
@@ -78,4 +88,10 @@ void nlNetworkIconsRenderUpdate(NlNetworkIconsRender* self, NlNetworkIconsState
         case NlNetworkIconsDisconnectInfoNone:
             break;
     }
+
+    y -= 40;
+
+    if (state.nondeterministic) {
+        srSpritesCopyEx(self->spritesRender, &self->nondeterministicSprite, x, y, 0, 1.0f, SDL_ALPHA_OPAQUE);
+    }
 }
@@ -17,6 +17,7 @@ typedef struct NlNetworkIconsRender {
     SrSprite authoritativeTimeIntervalWarningSprite;
     SrSprite impendingDisconnectWarningSprite;
     SrSprite disconnectedSprite;
+    SrSprite nondeterministicSprite;
 } NlNetworkIconsRender;
 
 typedef enum NlNetworkIconsDisconnectInfo {
@@ -26,6 +27,7 @@ typedef enum NlNetworkIconsDisconnectInfo {
 typedef struct NlNetworkIconsState {
     bool droppedDatagram;
     bool authoritativeTimeIntervalWarning;
+    bool nondeterministic;
     NlNetworkIconsDisconnectInfo disconnectInfo;
 } NlNetworkIconsState;
 
@@ -0,0 +1,204 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "prediction_cache.h"
+#include <string.h>
+#include <tiny-libc/tiny_libc.h>
+
+/// Writes all participant inputs to a single octet buffer, so they can be compared with memcmp
+/// @return octet count, or negative if the inputs do not fit
+static int serializeInput(const TransmuteInput* input, uint8_t* target, size_t maxOctetCount)
+{
+    size_t pos = 0U;
+    for (size_t i = 0U; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* participantInput = &input->participantInputs[i];
+        size_t octetCount = 2U + sizeof(participantInput->octetSize) + participantInput->octetSize;
+        if (pos + octetCount > maxOctetCount) {
+            return -1;
+        }
+        target[pos++] = participantInput->participantId;
+        target[pos++] = (uint8_t) participantInput->inputType;
+        tc_memcpy_octets(target + pos, &participantInput->octetSize, sizeof(participantInput->octetSize));
+        pos += sizeof(participantInput->octetSize);
+        if (participantInput->octetSize > 0U) {
+            tc_memcpy_octets(target + pos, participantInput->input, participantInput->octetSize);
+            pos += participantInput->octetSize;
+        }
+    }
+
+    return (int) pos;
+}
+
+static NlPredictionCacheEntry* entryForTick(NlPredictionCache* self, uint32_t tickCount)
+{
+    return &self->entries[tickCount % NL_PREDICTION_CACHE_CAPACITY];
+}
+
+/// Stores a state that did not come from the cache. Entries that were derived from the previous state at the
+/// same tick are orphaned, since their parent serial no longer matches.
+static NlPredictionCacheEntry* storeEntry(NlPredictionCache* self, const NlGame* game, uint32_t parentSerial,
+                                          const uint8_t* input, size_t inputOctetCount)
+{
+    NlPredictionCacheEntry* entry = entryForTick(self, game->tickCount);
+    entry->isSet = true;
+    entry->serial = ++self->nextSerial;
+    entry->parentSerial = parentSerial;
+    entry->game = *game;
+    if (inputOctetCount > 0U) {
+        tc_memcpy_octets(entry->input, input, inputOctetCount);
+    }
+    entry->inputOctetCount = inputOctetCount;
+
+    return entry;
+}
+
+/// Copies the cached state to the simulation, if ticks were skipped since it was last set
+static void catchUpInner(NlPredictionCache* self)
+{
+    if (!self->isInnerBehind) {
+        return;
+    }
+
+    TransmuteState state;
+    state.state = &self->current->game;
+    state.octetSize = sizeof(NlGame);
+    transmuteVmSetState(self->inner, &state);
+    self->isInnerBehind = false;
+}
+
+static void predictionCacheTick(void* _self, const TransmuteInput* input)
+{
+    NlPredictionCache* self = (NlPredictionCache*) _self;
+
+    int inputOctetCount = serializeInput(input, self->input, sizeof(self->input));
+
+    if (self->current != 0 && inputOctetCount >= 0) {
+        const NlPredictionCacheEntry* next = entryForTick(self, self->current->game.tickCount + 1U);
+        if (next->isSet && next->parentSerial == self->current->serial &&
+            next->game.tickCount == self->current->game.tickCount + 1U &&
+            next->inputOctetCount == (size_t) inputOctetCount &&
+            memcmp(next->input, self->input, (size_t) inputOctetCount) == 0) {
+            self->current = next;
+            self->skippedTickCount++;
+            return;
+        }
+    }
+
+    catchUpInner(self);
+
+    transmuteVmTick(self->inner, input);
+    self->simulatedTickCount++;
+
+    TransmuteState state = transmuteVmGetState(self->inner);
+    if (self->current == 0 || inputOctetCount < 0 || state.octetSize != sizeof(NlGame)) {
+        self->current = 0;
+        return;
+    }
+
+    self->current = storeEntry(self, (const NlGame*) state.state, self->current->serial, self->input,
+                               (size_t) inputOctetCount);
+}
+
+static TransmuteState predictionCacheGetState(const void* _self)
+{
+    const NlPredictionCache* self = (const NlPredictionCache*) _self;
+    if (self->isInnerBehind) {
+        TransmuteState state;
+        state.state = &self->current->game;
+        state.octetSize = sizeof(NlGame);
+        return state;
+    }
+
+    return transmuteVmGetState(self->inner);
+}
+
+static void predictionCacheSetState(void* _self, const TransmuteState* state)
+{
+    NlPredictionCache* self = (NlPredictionCache*) _self;
+    self->rollbackCount++;
+
+    if (state->octetSize != sizeof(NlGame)) {
+        self->current = 0;
+        self->isInnerBehind = false;
+        transmuteVmSetState(self->inner, state);
+        return;
+    }
+
+    const NlGame* game = (const NlGame*) state->state;
+    const NlPredictionCacheEntry* entry = entryForTick(self, game->tickCount);
+    // Any difference, even in padding, only means that the ticks are re-simulated as without the cache
+    if (entry->isSet && memcmp(&entry->game, game, sizeof(NlGame)) == 0) {
+        // Predicted correctly so far, the simulation is only brought up to date when a tick differs
+        self->matchingRollbackCount++;
+        self->current = entry;
+        self->isInnerBehind = true;
+        return;
+    }
+
+    self->current = storeEntry(self, game, 0U, 0, 0U);
+    self->isInnerBehind = false;
+    transmuteVmSetState(self->inner, state);
+}
+
+static int predictionCacheStateToString(void* _self, const TransmuteState* state, char* target,
+                                        size_t maxTargetOctetSize)
+{
+    NlPredictionCache* self = (NlPredictionCache*) _self;
+    return self->inner->stateToString(self->inner->vmPointer, state, target, maxTargetOctetSize);
+}
+
+static int predictionCacheInputToString(void* _self, const TransmuteParticipantInput* input, char* target,
+                                        size_t maxTargetOctetSize)
+{
+    NlPredictionCache* self = (NlPredictionCache*) _self;
+    return self->inner->inputToString(self->inner->vmPointer, input, target, maxTargetOctetSize);
+}
+
+/// Wraps the predicted simulation
+/// @param self prediction cache
+/// @param inner the predicted simulation
+/// @param log log
+void nlPredictionCacheInit(NlPredictionCache* self, TransmuteVm* inner, Clog log)
+{
+    self->inner = inner;
+    self->log = log;
+    self->entries = (NlPredictionCacheEntry*) tc_malloc(sizeof(NlPredictionCacheEntry) * NL_PREDICTION_CACHE_CAPACITY);
+    self->simulatedTickCount = 0U;
+    self->skippedTickCount = 0U;
+    self->matchingRollbackCount = 0U;
+    self->rollbackCount = 0U;
+    self->current = 0;
+    self->isInnerBehind = false;
+    nlPredictionCacheReset(self);
+
+    TransmuteVmSetup vmSetup;
+    vmSetup.tickFn = predictionCacheTick;
+    vmSetup.getStateFn = predictionCacheGetState;
+    vmSetup.setStateFn = predictionCacheSetState;
+    vmSetup.stateToString = predictionCacheStateToString;
+    vmSetup.inputToString = predictionCacheInputToString;
+    vmSetup.version = inner->version;
+
+    transmuteVmInit(&self->transmuteVm, self, vmSetup, inner->log);
+}
+
+/// Forgets all cached ticks, for example when joining a new game
+/// @param self prediction cache
+void nlPredictionCacheReset(NlPredictionCache* self)
+{
+    catchUpInner(self);
+
+    for (size_t i = 0U; i < NL_PREDICTION_CACHE_CAPACITY; ++i) {
+        self->entries[i].isSet = false;
+    }
+    self->nextSerial = 0U;
+    self->current = 0;
+    self->isInnerBehind = false;
+}
+
+void nlPredictionCacheDestroy(NlPredictionCache* self)
+{
+    tc_free(self->entries);
+    self->entries = 0;
+}
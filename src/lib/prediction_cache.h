@@ -0,0 +1,52 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_PREDICTION_CACHE_H
+#define NIMBLE_BALL_PREDICTION_CACHE_H
+
+#include <clog/clog.h>
+#include <nimble-ball-simulation/nimble_ball_simulation.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+#define NL_PREDICTION_CACHE_CAPACITY (64)
+#define NL_PREDICTION_CACHE_MAX_INPUT_OCTET_COUNT (1024)
+
+/// The predicted state after a tick and the input that was used to get there from its parent
+typedef struct NlPredictionCacheEntry {
+    bool isSet;
+    uint32_t serial;
+    uint32_t parentSerial;
+    NlGame game;
+    uint8_t input[NL_PREDICTION_CACHE_MAX_INPUT_OCTET_COUNT];
+    size_t inputOctetCount;
+} NlPredictionCacheEntry;
+
+/// Wraps the predicted simulation and keeps the predicted state and input of the latest ticks.
+/// When the prediction is rolled back to an authoritative state that is identical to what was predicted
+/// for that tick, the following ticks are not re-simulated as long as their inputs are identical to the
+/// ones that were predicted. The cached state is only copied to the simulation at the first tick that
+/// differs.
+typedef struct NlPredictionCache {
+    TransmuteVm transmuteVm;
+    TransmuteVm* inner;
+    NlPredictionCacheEntry* entries;
+    uint32_t nextSerial;
+    const NlPredictionCacheEntry* current;
+    bool isInnerBehind;
+    uint8_t input[NL_PREDICTION_CACHE_MAX_INPUT_OCTET_COUNT];
+    size_t simulatedTickCount;
+    size_t skippedTickCount;
+    size_t matchingRollbackCount;
+    size_t rollbackCount;
+    Clog log;
+} NlPredictionCache;
+
+void nlPredictionCacheInit(NlPredictionCache* self, TransmuteVm* inner, Clog log);
+void nlPredictionCacheReset(NlPredictionCache* self);
+void nlPredictionCacheDestroy(NlPredictionCache* self);
+
+#endif
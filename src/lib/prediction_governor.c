@@ -0,0 +1,147 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "prediction_governor.h"
+#include "thread_log.h"
+#include <tiny-libc/tiny_libc.h>
+
+static void predictionGovernorTick(void* _self, const TransmuteInput* input)
+{
+    NlPredictionGovernor* self = (NlPredictionGovernor*) _self;
+    NlClockMicros startedAt = nlClockNowMicros();
+    transmuteVmTick(self->inner, input);
+    self->updateDuration += nlClockNowMicros() - startedAt;
+    self->updateTickCount++;
+}
+
+static TransmuteState predictionGovernorGetState(const void* _self)
+{
+    const NlPredictionGovernor* self = (const NlPredictionGovernor*) _self;
+    return transmuteVmGetState(self->inner);
+}
+
+static void predictionGovernorSetState(void* _self, const TransmuteState* state)
+{
+    NlPredictionGovernor* self = (NlPredictionGovernor*) _self;
+    // Setting the state is part of the rollback, so it counts towards the budget
+    NlClockMicros startedAt = nlClockNowMicros();
+    transmuteVmSetState(self->inner, state);
+    self->updateDuration += nlClockNowMicros() - startedAt;
+}
+
+static int predictionGovernorStateToString(void* _self, const TransmuteState* state, char* target,
+                                           size_t maxTargetOctetSize)
+{
+    NlPredictionGovernor* self = (NlPredictionGovernor*) _self;
+    return self->inner->stateToString(self->inner->vmPointer, state, target, maxTargetOctetSize);
+}
+
+static int predictionGovernorInputToString(void* _self, const TransmuteParticipantInput* input, char* target,
+                                           size_t maxTargetOctetSize)
+{
+    NlPredictionGovernor* self = (NlPredictionGovernor*) _self;
+    return self->inner->inputToString(self->inner->vmPointer, input, target, maxTargetOctetSize);
+}
+
+void nlPredictionGovernorSetupInit(NlPredictionGovernorSetup* self)
+{
+    self->predictionBudget = 4000U;
+    self->minTicksFromAuthoritative = 2U;
+    self->maxTicksFromAuthoritative = 30U;
+    self->initialTicksFromAuthoritative = 10U;
+    self->marginTicks = 2U;
+}
+
+/// Wraps the predicted simulation
+/// @param self governor
+/// @param inner the predicted simulation
+/// @param setup budget and limits of the prediction window
+/// @param log log
+void nlPredictionGovernorInit(NlPredictionGovernor* self, TransmuteVm* inner, const NlPredictionGovernorSetup* setup,
+                              Clog log)
+{
+    self->inner = inner;
+    self->setup = *setup;
+    self->log = log;
+    // Reset keeps the measured tick cost, there is none yet
+    tc_mem_clear_type(&self->stats);
+    nlPredictionGovernorReset(self);
+
+    TransmuteVmSetup vmSetup;
+    vmSetup.tickFn = predictionGovernorTick;
+    vmSetup.getStateFn = predictionGovernorGetState;
+    vmSetup.setStateFn = predictionGovernorSetState;
+    vmSetup.stateToString = predictionGovernorStateToString;
+    vmSetup.inputToString = predictionGovernorInputToString;
+    vmSetup.version = inner->version;
+
+    transmuteVmInit(&self->transmuteVm, self, vmSetup, inner->log);
+}
+
+/// Starts over from the initial window, for example when joining a new game. The tick cost is kept.
+/// @param self governor
+void nlPredictionGovernorReset(NlPredictionGovernor* self)
+{
+    NlClockMicros tickCost = self->stats.tickCost;
+    tc_mem_clear_type(&self->stats);
+    self->stats.tickCost = tickCost;
+    self->stats.ticksFromAuthoritative = self->setup.initialTicksFromAuthoritative;
+    self->stats.affordableTicks = self->setup.maxTicksFromAuthoritative;
+    self->updateDuration = 0U;
+    self->updateTickCount = 0U;
+}
+
+/// Call after every engine client update. Uses the re-prediction time measured during the update.
+/// @param self governor
+/// @param lagTicks how many ticks the predicted state is ahead of the authoritative state
+/// @return the prediction window (max ticks from authoritative) to use
+size_t nlPredictionGovernorUpdate(NlPredictionGovernor* self, size_t lagTicks)
+{
+    NlPredictionGovernorStats* stats = &self->stats;
+
+    if (self->updateTickCount > 0U) {
+        NlClockMicros tickCost = self->updateDuration / self->updateTickCount;
+        // Smoothed, a single preempted update should not collapse the window
+        stats->tickCost = stats->tickCost == 0U ? tickCost : (stats->tickCost * 7U + tickCost) / 8U;
+    }
+
+    stats->lastPredictionDuration = self->updateDuration;
+    if (self->updateDuration > self->setup.predictionBudget) {
+        stats->overBudgetUpdateCount++;
+    }
+    self->updateDuration = 0U;
+    self->updateTickCount = 0U;
+
+    // Worst case, the complete window is re-predicted in a single update
+    stats->affordableTicks = stats->tickCost > 0U ? (size_t) (self->setup.predictionBudget / stats->tickCost)
+                                                  : self->setup.maxTicksFromAuthoritative;
+    stats->lagTicks = lagTicks;
+
+    size_t neededTicks = lagTicks + self->setup.marginTicks;
+    stats->isOverBudget = stats->affordableTicks < neededTicks;
+
+    size_t target = stats->isOverBudget ? stats->affordableTicks : neededTicks;
+    if (target < self->setup.minTicksFromAuthoritative) {
+        target = self->setup.minTicksFromAuthoritative;
+    }
+    if (target > self->setup.maxTicksFromAuthoritative) {
+        target = self->setup.maxTicksFromAuthoritative;
+    }
+
+    // One tick at a time, so jitter in the lag does not make the window oscillate
+    size_t previous = stats->ticksFromAuthoritative;
+    if (target > previous) {
+        stats->ticksFromAuthoritative++;
+    } else if (target < previous) {
+        stats->ticksFromAuthoritative--;
+    }
+
+    if (stats->ticksFromAuthoritative != previous) {
+        stats->adjustmentCount++;
+        NL_LOG_C_VERBOSE(&self->log, "prediction window %zu ticks (lag:%zu affordable:%zu tick cost:%d us)",
+                         stats->ticksFromAuthoritative, lagTicks, stats->affordableTicks, (int) stats->tickCost)
+    }
+
+    return stats->ticksFromAuthoritative;
+}
@@ -0,0 +1,53 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_PREDICTION_GOVERNOR_H
+#define NIMBLE_BALL_PREDICTION_GOVERNOR_H
+
+#include "clock.h"
+#include <clog/clog.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <transmute/transmute.h>
+
+typedef struct NlPredictionGovernorSetup {
+    NlClockMicros predictionBudget;
+    size_t minTicksFromAuthoritative;
+    size_t maxTicksFromAuthoritative;
+    size_t initialTicksFromAuthoritative;
+    size_t marginTicks;
+} NlPredictionGovernorSetup;
+
+/// The decisions of the governor and the measurements they are based on
+typedef struct NlPredictionGovernorStats {
+    size_t ticksFromAuthoritative;
+    size_t affordableTicks;
+    size_t lagTicks;
+    NlClockMicros tickCost;
+    NlClockMicros lastPredictionDuration;
+    bool isOverBudget;
+    size_t adjustmentCount;
+    size_t overBudgetUpdateCount;
+} NlPredictionGovernorStats;
+
+/// Wraps the predicted simulation and measures how long re-prediction takes. After every client update
+/// it moves the prediction window towards what is needed to cover the authoritative lag, but never
+/// further than what can be re-predicted within the budget.
+typedef struct NlPredictionGovernor {
+    TransmuteVm transmuteVm;
+    TransmuteVm* inner;
+    NlPredictionGovernorSetup setup;
+    NlClockMicros updateDuration;
+    size_t updateTickCount;
+    NlPredictionGovernorStats stats;
+    Clog log;
+} NlPredictionGovernor;
+
+void nlPredictionGovernorSetupInit(NlPredictionGovernorSetup* self);
+void nlPredictionGovernorInit(NlPredictionGovernor* self, TransmuteVm* inner, const NlPredictionGovernorSetup* setup,
+                              Clog log);
+void nlPredictionGovernorReset(NlPredictionGovernor* self);
+size_t nlPredictionGovernorUpdate(NlPredictionGovernor* self, size_t lagTicks);
+
+#endif
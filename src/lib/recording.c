@@ -0,0 +1,379 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "recording.h"
+#include "state_delta.h"
+#include "state_hash.h"
+#include <string.h>
+
+static const uint8_t nlRecordingMagic[4] = {'N', 'B', 'R', 'C'};
+static const uint16_t nlRecordingFormatVersion = 3U;
+static const size_t nlRecordingHeaderOctetCount = 16U;
+static const size_t nlRecordHeaderOctetCount = 5U;
+
+static void writeUint16(uint8_t* target, uint16_t value)
+{
+    target[0] = (uint8_t) (value & 0xff);
+    target[1] = (uint8_t) (value >> 8);
+}
+
+static void writeUint32(uint8_t* target, uint32_t value)
+{
+    for (size_t i = 0U; i < 4U; ++i) {
+        target[i] = (uint8_t) (value >> (i * 8U));
+    }
+}
+
+static uint16_t readUint16(const uint8_t* source)
+{
+    return (uint16_t) (source[0] | (source[1] << 8));
+}
+
+static uint32_t readUint32(const uint8_t* source)
+{
+    uint32_t value = 0U;
+    for (size_t i = 0U; i < 4U; ++i) {
+        value |= (uint32_t) source[i] << (i * 8U);
+    }
+    return value;
+}
+
+static void writeRecord(NlRecorder* self, NlRecordType type, const uint8_t* payload, size_t payloadOctetCount)
+{
+    uint8_t recordHeader[5];
+    recordHeader[0] = (uint8_t) type;
+    writeUint32(&recordHeader[1], (uint32_t) payloadOctetCount);
+
+    fwrite(recordHeader, 1, sizeof(recordHeader), self->file);
+    fwrite(payload, 1, payloadOctetCount, self->file);
+    self->recordCount++;
+}
+
+/// Creates a new recording file and writes the header
+/// @param self recorder
+/// @param filename file to create
+/// @param header version and state size of the recorded simulation
+/// @param log log
+/// @return negative on error
+int nlRecorderInit(NlRecorder* self, const char* filename, NlRecordingHeader header, Clog log)
+{
+    self->log = log;
+    self->recordCount = 0U;
+    self->authoritativeStepCount = 0U;
+    self->stateOctetCount = header.stateOctetCount;
+    self->hasBaseline = false;
+    self->stateOctetCountWritten = 0U;
+    self->stateDeltaOctetCountWritten = 0U;
+    self->file = fopen(filename, "wb");
+    if (self->file == 0) {
+        CLOG_C_WARN(&self->log, "could not create recording '%s'", filename)
+        return -1;
+    }
+
+    self->baseline = (uint8_t*) tc_malloc(self->stateOctetCount);
+    self->delta = (uint8_t*) tc_malloc(self->stateOctetCount);
+    if (self->baseline == 0 || self->delta == 0) {
+        CLOG_C_WARN(&self->log, "could not allocate %zu octets for the recording state", self->stateOctetCount)
+        tc_free(self->baseline);
+        tc_free(self->delta);
+        fclose(self->file);
+        return -2;
+    }
+
+    // Records are small, a large buffer keeps the number of write calls down
+    setvbuf(self->file, 0, _IOFBF, 64 * 1024);
+
+    uint8_t octets[16];
+    tc_memcpy_octets(octets, nlRecordingMagic, sizeof(nlRecordingMagic));
+    writeUint16(&octets[4], nlRecordingFormatVersion);
+    writeUint16(&octets[6], header.version.major);
+    writeUint16(&octets[8], header.version.minor);
+    writeUint16(&octets[10], header.version.patch);
+    writeUint32(&octets[12], header.stateOctetCount);
+    fwrite(octets, 1, nlRecordingHeaderOctetCount, self->file);
+
+    CLOG_C_INFO(&self->log, "recording to '%s'", filename)
+
+    return 0;
+}
+
+/// Sets the state that the first state written is encoded against. The reader must start from the same state.
+/// @param self recorder
+/// @param state baseline state, usually the initial state of the simulation
+void nlRecorderSetBaseline(NlRecorder* self, const TransmuteState* state)
+{
+    CLOG_ASSERT(state->octetSize == self->stateOctetCount, "wrong baseline size")
+    tc_memcpy_octets(self->baseline, state->state, state->octetSize);
+    self->hasBaseline = true;
+}
+
+/// Writes a state as a delta against the previously written state, or in full if there is no previous
+/// state or the delta would not be smaller
+/// @param self recorder
+/// @param state state to write
+void nlRecorderWriteState(NlRecorder* self, const TransmuteState* state)
+{
+    const uint8_t* octets = (const uint8_t*) state->state;
+    CLOG_ASSERT(state->octetSize == self->stateOctetCount, "wrong state size")
+
+    int deltaOctetCount = -1;
+    if (self->hasBaseline) {
+        deltaOctetCount = nlStateDeltaEncode(self->baseline, octets, state->octetSize, self->delta,
+                                             self->stateOctetCount);
+    }
+
+    if (deltaOctetCount >= 0) {
+        writeRecord(self, NlRecordTypeStateDelta, self->delta, (size_t) deltaOctetCount);
+        self->stateDeltaOctetCountWritten += (size_t) deltaOctetCount;
+    } else {
+        writeRecord(self, NlRecordTypeState, octets, state->octetSize);
+        self->stateDeltaOctetCountWritten += state->octetSize;
+    }
+    self->stateOctetCountWritten += state->octetSize;
+
+    tc_memcpy_octets(self->baseline, octets, state->octetSize);
+    self->hasBaseline = true;
+}
+
+/// Writes all participant inputs for a single tick
+/// @param self recorder
+/// @param type NlRecordTypeAuthoritativeStep or NlRecordTypePredictedInput
+/// @param input input for one tick
+void nlRecorderWriteInput(NlRecorder* self, NlRecordType type, const TransmuteInput* input)
+{
+    uint8_t payload[1 + NL_RECORDING_MAX_PARTICIPANT_INPUTS * (4 + 255)];
+    size_t pos = 0U;
+
+    CLOG_ASSERT(input->participantCount <= NL_RECORDING_MAX_PARTICIPANT_INPUTS, "too many participants to record")
+    payload[pos++] = (uint8_t) input->participantCount;
+    for (size_t i = 0U; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* participantInput = &input->participantInputs[i];
+        CLOG_ASSERT(participantInput->octetSize <= 255U, "participant input is too big to record")
+        payload[pos++] = participantInput->participantId;
+        payload[pos++] = (uint8_t) participantInput->inputType;
+        writeUint16(&payload[pos], (uint16_t) participantInput->octetSize);
+        pos += 2U;
+        tc_memcpy_octets(&payload[pos], participantInput->input, participantInput->octetSize);
+        pos += participantInput->octetSize;
+    }
+
+    if (type == NlRecordTypeAuthoritativeStep) {
+        self->authoritativeStepCount++;
+    }
+
+    writeRecord(self, type, payload, pos);
+}
+
+void nlRecorderWriteStateHash(NlRecorder* self, uint64_t hash)
+{
+    uint8_t payload[8];
+    writeUint32(&payload[0], (uint32_t) (hash & 0xffffffffU));
+    writeUint32(&payload[4], (uint32_t) (hash >> 32U));
+    writeRecord(self, NlRecordTypeStateHash, payload, sizeof(payload));
+}
+
+void nlRecorderClose(NlRecorder* self)
+{
+    if (self->file == 0) {
+        return;
+    }
+
+    fclose(self->file);
+    self->file = 0;
+    tc_free(self->baseline);
+    tc_free(self->delta);
+
+    CLOG_C_INFO(&self->log, "recording closed. records:%zu authoritative steps:%zu states:%zu of %zu octets",
+                self->recordCount, self->authoritativeStepCount, self->stateDeltaOctetCountWritten,
+                self->stateOctetCountWritten)
+}
+
+static void recordingVmTick(void* _self, const TransmuteInput* input)
+{
+    NlRecordingVm* self = (NlRecordingVm*) _self;
+    nlRecorderWriteInput(self->recorder, NlRecordTypeAuthoritativeStep, input);
+    transmuteVmTick(self->inner, input);
+
+    if (self->stateHashInterval > 0U && self->recorder->authoritativeStepCount % self->stateHashInterval == 0U) {
+        TransmuteState state = transmuteVmGetState(self->inner);
+        nlRecorderWriteStateHash(self->recorder, nlStateHash(state.state, state.octetSize));
+    }
+}
+
+static TransmuteState recordingVmGetState(const void* _self)
+{
+    const NlRecordingVm* self = (const NlRecordingVm*) _self;
+    return transmuteVmGetState(self->inner);
+}
+
+static void recordingVmSetState(void* _self, const TransmuteState* state)
+{
+    NlRecordingVm* self = (NlRecordingVm*) _self;
+    nlRecorderWriteState(self->recorder, state);
+    transmuteVmSetState(self->inner, state);
+}
+
+static int recordingVmStateToString(void* _self, const TransmuteState* state, char* target, size_t maxTargetOctetSize)
+{
+    NlRecordingVm* self = (NlRecordingVm*) _self;
+    return self->inner->stateToString(self->inner->vmPointer, state, target, maxTargetOctetSize);
+}
+
+static int recordingVmInputToString(void* _self, const TransmuteParticipantInput* input, char* target,
+                                    size_t maxTargetOctetSize)
+{
+    NlRecordingVm* self = (NlRecordingVm*) _self;
+    return self->inner->inputToString(self->inner->vmPointer, input, target, maxTargetOctetSize);
+}
+
+/// Wraps a simulation so every state set and authoritative step is recorded before it is forwarded
+/// @param self recording vm
+/// @param inner the simulation that does the actual work
+/// @param recorder recorder to write to
+/// @param stateHashInterval number of authoritative steps between state hashes, zero for none
+void nlRecordingVmInit(NlRecordingVm* self, TransmuteVm* inner, NlRecorder* recorder, size_t stateHashInterval)
+{
+    self->inner = inner;
+    self->recorder = recorder;
+    self->stateHashInterval = stateHashInterval;
+
+    TransmuteVmSetup setup;
+    setup.tickFn = recordingVmTick;
+    setup.getStateFn = recordingVmGetState;
+    setup.setStateFn = recordingVmSetState;
+    setup.stateToString = recordingVmStateToString;
+    setup.inputToString = recordingVmInputToString;
+    setup.version = inner->version;
+
+    transmuteVmInit(&self->transmuteVm, self, setup, inner->log);
+}
+
+/// Validates the header of a recording loaded into memory
+/// @param self reader
+/// @param octets complete recording
+/// @param octetCount number of octets in the recording
+/// @return negative on error
+int nlRecordingReaderInit(NlRecordingReader* self, const uint8_t* octets, size_t octetCount)
+{
+    self->octets = octets;
+    self->octetCount = octetCount;
+    self->position = nlRecordingHeaderOctetCount;
+
+    if (octetCount < nlRecordingHeaderOctetCount || memcmp(octets, nlRecordingMagic, 4) != 0) {
+        return -1;
+    }
+
+    // Version 1 has no state deltas and versions 1 and 2 hash with FNV-1a, otherwise they are read the same way
+    self->formatVersion = readUint16(&octets[4]);
+    if (self->formatVersion < 1U || self->formatVersion > nlRecordingFormatVersion) {
+        return -2;
+    }
+
+    self->header.version.major = readUint16(&octets[6]);
+    self->header.version.minor = readUint16(&octets[8]);
+    self->header.version.patch = readUint16(&octets[10]);
+    self->header.stateOctetCount = readUint32(&octets[12]);
+
+    return 0;
+}
+
+/// Hashes a state with the same hash function that the recording used for its state hash records
+/// @param self reader
+/// @param state state octets
+/// @param octetCount number of octets in state
+/// @return 64-bit hash
+uint64_t nlRecordingReaderStateHash(const NlRecordingReader* self, const void* state, size_t octetCount)
+{
+    if (self->formatVersion < 3U) {
+        return nlStateHashFnv1a(state, octetCount);
+    }
+
+    return nlStateHash(state, octetCount);
+}
+
+/// Reads the next record. The payload points into the memory given to nlRecordingReaderInit()
+/// @param self reader
+/// @param record the record that was read
+/// @return 1 if a record was read, 0 at the end and negative if the recording is truncated
+int nlRecordingReaderNext(NlRecordingReader* self, NlRecord* record)
+{
+    if (self->position == self->octetCount) {
+        return 0;
+    }
+
+    if (self->position + nlRecordHeaderOctetCount > self->octetCount) {
+        return -1;
+    }
+
+    const uint8_t* recordHeader = &self->octets[self->position];
+    size_t payloadOctetCount = readUint32(&recordHeader[1]);
+    if (self->position + nlRecordHeaderOctetCount + payloadOctetCount > self->octetCount) {
+        return -2;
+    }
+
+    record->type = (NlRecordType) recordHeader[0];
+    record->payload = recordHeader + nlRecordHeaderOctetCount;
+    record->payloadOctetCount = payloadOctetCount;
+    self->position += nlRecordHeaderOctetCount + payloadOctetCount;
+
+    return 1;
+}
+
+/// Reads an input record. The participant inputs point into the record payload.
+/// @param record NlRecordTypeAuthoritativeStep or NlRecordTypePredictedInput record
+/// @param input target input
+/// @param participantInputs storage for the participant inputs
+/// @param maxParticipantInputs capacity of participantInputs
+/// @return negative on error
+int nlRecordReadInput(const NlRecord* record, TransmuteInput* input, TransmuteParticipantInput* participantInputs,
+                      size_t maxParticipantInputs)
+{
+    const uint8_t* payload = record->payload;
+    size_t pos = 0U;
+
+    if (record->payloadOctetCount < 1U) {
+        return -1;
+    }
+
+    size_t participantCount = payload[pos++];
+    if (participantCount > maxParticipantInputs) {
+        return -2;
+    }
+
+    for (size_t i = 0U; i < participantCount; ++i) {
+        if (pos + 4U > record->payloadOctetCount) {
+            return -3;
+        }
+        TransmuteParticipantInput* participantInput = &participantInputs[i];
+        participantInput->participantId = payload[pos++];
+        participantInput->inputType = (TransmuteParticipantInputType) payload[pos++];
+        participantInput->octetSize = readUint16(&payload[pos]);
+        pos += 2U;
+        if (pos + participantInput->octetSize > record->payloadOctetCount) {
+            return -4;
+        }
+        participantInput->input = participantInput->octetSize > 0U ? &payload[pos] : 0;
+        pos += participantInput->octetSize;
+    }
+
+    input->participantInputs = participantInputs;
+    input->participantCount = participantCount;
+
+    return 0;
+}
+
+/// Reads a state hash record
+/// @param record NlRecordTypeStateHash record
+/// @param hash target hash
+/// @return negative if the record is too short
+int nlRecordReadStateHash(const NlRecord* record, uint64_t* hash)
+{
+    if (record->payloadOctetCount < 8U) {
+        return -1;
+    }
+
+    *hash = (uint64_t) readUint32(&record->payload[0]) | ((uint64_t) readUint32(&record->payload[4]) << 32U);
+
+    return 0;
+}
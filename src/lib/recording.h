@@ -0,0 +1,82 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_RECORDING_H
+#define NIMBLE_BALL_RECORDING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <transmute/transmute.h>
+
+#define NL_RECORDING_MAX_PARTICIPANT_INPUTS (16)
+
+typedef enum NlRecordType {
+    NlRecordTypeState = 1,
+    NlRecordTypeAuthoritativeStep = 2,
+    NlRecordTypePredictedInput = 3,
+    NlRecordTypeStateHash = 4,
+    NlRecordTypeStateDelta = 5,
+} NlRecordType;
+
+typedef struct NlRecordingHeader {
+    TransmuteVmVersion version;
+    uint32_t stateOctetCount;
+} NlRecordingHeader;
+
+/// Appends records to a binary session recording. States are written as deltas against the previous
+/// state, see state_delta.h
+typedef struct NlRecorder {
+    FILE* file;
+    size_t recordCount;
+    size_t authoritativeStepCount;
+    size_t stateOctetCount;
+    uint8_t* baseline;
+    uint8_t* delta;
+    bool hasBaseline;
+    size_t stateOctetCountWritten;
+    size_t stateDeltaOctetCountWritten;
+    Clog log;
+} NlRecorder;
+
+int nlRecorderInit(NlRecorder* self, const char* filename, NlRecordingHeader header, Clog log);
+void nlRecorderSetBaseline(NlRecorder* self, const TransmuteState* state);
+void nlRecorderWriteState(NlRecorder* self, const TransmuteState* state);
+void nlRecorderWriteInput(NlRecorder* self, NlRecordType type, const TransmuteInput* input);
+void nlRecorderWriteStateHash(NlRecorder* self, uint64_t hash);
+void nlRecorderClose(NlRecorder* self);
+
+/// Wraps a TransmuteVm and records every state and authoritative step passed to it
+typedef struct NlRecordingVm {
+    TransmuteVm transmuteVm;
+    TransmuteVm* inner;
+    NlRecorder* recorder;
+    size_t stateHashInterval;
+} NlRecordingVm;
+
+void nlRecordingVmInit(NlRecordingVm* self, TransmuteVm* inner, NlRecorder* recorder, size_t stateHashInterval);
+
+typedef struct NlRecord {
+    NlRecordType type;
+    const uint8_t* payload;
+    size_t payloadOctetCount;
+} NlRecord;
+
+/// Iterates over a recording that is completely loaded into memory
+typedef struct NlRecordingReader {
+    const uint8_t* octets;
+    size_t octetCount;
+    size_t position;
+    uint16_t formatVersion;
+    NlRecordingHeader header;
+} NlRecordingReader;
+
+int nlRecordingReaderInit(NlRecordingReader* self, const uint8_t* octets, size_t octetCount);
+int nlRecordingReaderNext(NlRecordingReader* self, NlRecord* record);
+uint64_t nlRecordingReaderStateHash(const NlRecordingReader* self, const void* state, size_t octetCount);
+int nlRecordReadInput(const NlRecord* record, TransmuteInput* input, TransmuteParticipantInput* participantInputs,
+                      size_t maxParticipantInputs);
+int nlRecordReadStateHash(const NlRecord* record, uint64_t* hash);
+
+#endif
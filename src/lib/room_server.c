@@ -0,0 +1,490 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "room_server.h"
+#include "engine_client.h"
+#include "host.h"
+#include "trace.h"
+
+// The keeper is always the first connection of a room
+static const int nlRoomKeeperConnectionId = 0;
+
+static int roomKeeperSend(void* _self, const uint8_t* data, size_t size)
+{
+    NlRoom* self = (NlRoom*) _self;
+    return nlDatagramQueuePush(&self->inbox, nlRoomKeeperConnectionId, data, size);
+}
+
+static ssize_t roomKeeperReceive(void* _self, uint8_t* data, size_t size)
+{
+    NlRoom* self = (NlRoom*) _self;
+    int connectionId;
+    return nlDatagramQueuePop(&self->keeper.toKeeper, &connectionId, data, size);
+}
+
+/// Sends to the keeper directly and queues everything else until the router sends it on the real transport
+static int roomSendTo(void* _self, int connectionId, const uint8_t* data, size_t size)
+{
+    NlRoom* self = (NlRoom*) _self;
+    if (connectionId == nlRoomKeeperConnectionId) {
+        return nlDatagramQueuePush(&self->keeper.toKeeper, nlRoomKeeperConnectionId, data, size);
+    }
+    return nlDatagramQueuePush(&self->outbox, connectionId, data, size);
+}
+
+static int roomReceiveFrom(void* _self, int* connectionId, uint8_t* data, size_t size)
+{
+    NlRoom* self = (NlRoom*) _self;
+    return nlDatagramQueuePop(&self->inbox, connectionId, data, size);
+}
+
+static int roomInit(NlRoom* self, NlRoomServer* server, size_t index, const NlRoomServerSetup* setup)
+{
+    self->index = index;
+    self->server = server;
+    self->isStarted = false;
+    self->connectionCount = 0U;
+    self->activeConnectionCount = 0U;
+    self->maxUpdateDuration = 0U;
+    self->log.config = &g_clog;
+    self->log.constantPrefix = "Room";
+    for (size_t i = 0U; i < NL_ROOM_MAX_CONNECTIONS; ++i) {
+        self->globalConnectionIds[i] = -1;
+    }
+    nlDatagramQueueInit(&self->inbox);
+    nlDatagramQueueInit(&self->outbox);
+    nlDatagramQueueInit(&self->keeper.toKeeper);
+
+    // Each room has its own memory, the allocators are not thread safe and the room can be updated on any worker
+    imprintDefaultSetupInit(&self->memory, setup->roomMemoryOctetCount);
+    struct ImprintAllocator* allocator = &self->memory.tagAllocator.info;
+    struct ImprintAllocatorWithFree* allocatorWithFree = &self->memory.slabAllocator.info;
+
+    DatagramTransportMulti roomTransport;
+    roomTransport.self = self;
+    roomTransport.sendTo = roomSendTo;
+    roomTransport.receiveFrom = roomReceiveFrom;
+
+    NlAppHostSetup hostSetup;
+    nlAppHostSetupInit(&hostSetup, setup->applicationVersion, allocator, allocatorWithFree);
+    hostSetup.maxConnectionCount = setup->maxConnectionCountForEachRoom + 1U;
+    hostSetup.maxParticipantCount = setup->maxParticipantCountForEachRoom;
+    int errorCode = nlAppHostInitServer(&self->nimbleServer, roomTransport, &hostSetup, self->log);
+    if (errorCode < 0) {
+        CLOG_C_ERROR(&self->log, "could not start room %zu: %d", index, errorCode)
+        imprintDefaultSetupDestroy(&self->memory);
+        return errorCode;
+    }
+
+    Clog authoritativeLog;
+    authoritativeLog.constantPrefix = "KeeperAuth";
+    authoritativeLog.config = &g_clog;
+    nlSimulationVmInit(&self->keeper.authoritative, authoritativeLog);
+
+    Clog predictedLog;
+    predictedLog.constantPrefix = "KeeperPredicted";
+    predictedLog.config = &g_clog;
+    nlSimulationVmInit(&self->keeper.predicted, predictedLog);
+
+    DatagramTransport keeperTransport;
+    keeperTransport.self = self;
+    keeperTransport.send = roomKeeperSend;
+    keeperTransport.receive = roomKeeperReceive;
+
+    NlEngineClientSetup clientSetup;
+    nlEngineClientSetupInit(&clientSetup, keeperTransport, &self->keeper.authoritative.transmuteVm,
+                            &self->keeper.predicted.transmuteVm, allocator, allocatorWithFree);
+    clientSetup.localPlayerCount = 0U;
+    nlEngineClientStartJoining(&self->keeper.nimbleEngineClient, &clientSetup);
+    self->isStarted = true;
+
+    return 0;
+}
+
+static void roomDestroy(NlRoom* self)
+{
+    if (!self->isStarted) {
+        return;
+    }
+    imprintDefaultSetupDestroy(&self->memory);
+    self->isStarted = false;
+}
+
+/// Starts a room that has no connections left over again, so its connection slots can be used by new connections
+static void roomRecycle(NlRoomServer* self, NlRoom* room)
+{
+    NlClockMicros maxUpdateDuration = room->maxUpdateDuration;
+    self->outboxDroppedCount += room->outbox.droppedCount;
+    roomDestroy(room);
+    if (roomInit(room, self, room->index, &self->setup) < 0) {
+        return;
+    }
+    room->maxUpdateDuration = maxUpdateDuration;
+    self->recycledRoomCount++;
+}
+
+static void roomUpdate(NlRoom* self, MonotonicTimeMs now)
+{
+    NlClockMicros startedAt = nlClockNowMicros();
+
+    nimbleEngineClientUpdate(&self->keeper.nimbleEngineClient);
+    nimbleServerUpdate(&self->nimbleServer, now);
+    if (self->keeper.nimbleEngineClient.phase == NimbleEngineClientPhaseSynced &&
+        nimbleServerMustProvideGameState(&self->nimbleServer)) {
+        nlAppHostServerProvideGameStateFromClient(&self->nimbleServer, &self->keeper.nimbleEngineClient);
+    }
+
+    NlClockMicros duration = nlClockNowMicros() - startedAt;
+    if (duration > self->maxUpdateDuration) {
+        self->maxUpdateDuration = duration;
+    }
+}
+
+static void updateRoomJob(void* context, size_t jobIndex)
+{
+    NlRoomServer* self = (NlRoomServer*) context;
+    NlRoom* room = &self->rooms[jobIndex];
+    if (!room->isStarted) {
+        return;
+    }
+    NL_TRACE_BEGIN("roomUpdate")
+    roomUpdate(room, self->now);
+    NL_TRACE_END()
+}
+
+/// The nimble libraries format their log lines into the one shared clog buffer, so two rooms that log at the same
+/// time would race on it. While more than one worker updates the rooms, the clog level is raised above anything
+/// they log. The router thread is the only other thread that logs, and it is busy being worker zero until all
+/// rooms are updated.
+static void updateRooms(NlRoomServer* self)
+{
+    if (self->workerPool.workerCount == 1U) {
+        nlWorkerPoolRun(&self->workerPool, self->roomCount, updateRoomJob, self);
+        return;
+    }
+
+    int level = g_clog.level;
+    g_clog.level = CLOG_TYPE_ERROR + 1;
+    nlWorkerPoolRun(&self->workerPool, self->roomCount, updateRoomJob, self);
+    g_clog.level = level;
+}
+
+/// Assigns a connection to the first room that has a free slot, so matches fill up before new ones are started
+static NlRoomConnection* findOrAssignConnection(NlRoomServer* self, int connectionId)
+{
+    if (connectionId < 0 || connectionId >= NL_ROOM_SERVER_MAX_CONNECTIONS) {
+        return 0;
+    }
+
+    NlRoomConnection* connection = &self->connections[connectionId];
+    if (connection->isAssigned) {
+        connection->lastReceivedAt = self->now;
+        return connection;
+    }
+
+    for (size_t i = 0U; i < self->roomCount; ++i) {
+        NlRoom* room = &self->rooms[i];
+        if (!room->isStarted || room->connectionCount == self->maxConnectionCountForEachRoom) {
+            continue;
+        }
+        room->connectionCount++;
+        room->activeConnectionCount++;
+        int localConnectionId = (int) room->connectionCount;
+        room->globalConnectionIds[localConnectionId] = connectionId;
+        connection->isAssigned = true;
+        connection->roomIndex = i;
+        connection->localConnectionId = localConnectionId;
+        connection->lastReceivedAt = self->now;
+        CLOG_C_INFO(&self->log, "connection %d joins room %zu", connectionId, i)
+        return connection;
+    }
+
+    return 0;
+}
+
+/// Releases the connections that have not sent anything for the idle timeout and recycles the rooms they left empty
+static void releaseIdleConnections(NlRoomServer* self)
+{
+    if (self->setup.connectionIdleTimeoutMs == 0U) {
+        return;
+    }
+
+    for (int i = 0; i < NL_ROOM_SERVER_MAX_CONNECTIONS; ++i) {
+        const NlRoomConnection* connection = &self->connections[i];
+        if (connection->isAssigned &&
+            self->now - connection->lastReceivedAt > (MonotonicTimeMs) self->setup.connectionIdleTimeoutMs) {
+            CLOG_C_INFO(&self->log, "connection %d timed out", i)
+            nlRoomServerReleaseConnection(self, i);
+        }
+    }
+}
+
+static void routeIncoming(NlRoomServer* self)
+{
+    uint8_t datagram[NL_DATAGRAM_MAX_OCTET_COUNT];
+
+    while (true) {
+        int connectionId;
+        int octetCount = datagramTransportMultiReceiveFrom(&self->transport, &connectionId, datagram, sizeof(datagram));
+        if (octetCount <= 0) {
+            break;
+        }
+
+        const NlRoomConnection* connection = findOrAssignConnection(self, connectionId);
+        if (connection == 0) {
+            self->droppedDatagramCount++;
+            continue;
+        }
+
+        NlRoom* room = &self->rooms[connection->roomIndex];
+        if (nlDatagramQueuePush(&room->inbox, connection->localConnectionId, datagram, (size_t) octetCount) < 0) {
+            self->droppedDatagramCount++;
+            continue;
+        }
+        self->routedDatagramCount++;
+    }
+}
+
+static void flushOutgoing(NlRoomServer* self)
+{
+    uint8_t datagram[NL_DATAGRAM_MAX_OCTET_COUNT];
+
+    for (size_t i = 0U; i < self->roomCount; ++i) {
+        NlRoom* room = &self->rooms[i];
+        int localConnectionId;
+        int octetCount;
+        while ((octetCount = nlDatagramQueuePop(&room->outbox, &localConnectionId, datagram, sizeof(datagram))) > 0) {
+            if (localConnectionId <= 0 || (size_t) localConnectionId > room->connectionCount) {
+                continue;
+            }
+            // The connection has been released, the global id can already belong to someone else
+            int connectionId = room->globalConnectionIds[localConnectionId];
+            if (connectionId < 0) {
+                continue;
+            }
+            datagramTransportMultiSendTo(&self->transport, connectionId, datagram, (size_t) octetCount);
+            self->sentDatagramCount++;
+            self->sentOctetCount += (size_t) octetCount;
+        }
+    }
+}
+
+/// Listens on a single transport and starts all rooms and the worker pool
+/// @param self room server
+/// @param hostname hostname to listen on. Empty string for any interface. The batch socket always listens on
+/// all interfaces
+/// @param port port to listen on
+/// @param setup room server setup
+/// @return negative on error
+static void destroyRooms(NlRoomServer* self)
+{
+    for (size_t i = 0U; i < self->roomCount; ++i) {
+        roomDestroy(&self->rooms[i]);
+    }
+    tc_free(self->rooms);
+    self->rooms = 0;
+    self->roomCount = 0U;
+}
+
+static void destroyTransport(NlRoomServer* self)
+{
+    if (self->isImpaired) {
+        nlImpairedTransportMultiDestroy(&self->impairedTransport);
+    }
+
+    if (self->useBatchSocket) {
+        nlUdpBatchSocketDestroy(&self->batchSocket);
+    } else {
+        imprintDefaultSetupDestroy(&self->transportMemory);
+    }
+}
+
+int nlRoomServerInit(NlRoomServer* self, const char* hostname, uint16_t port, const NlRoomServerSetup* setup)
+{
+    self->log.config = &g_clog;
+    self->log.constantPrefix = "RoomServer";
+    self->routedDatagramCount = 0U;
+    self->droppedDatagramCount = 0U;
+    self->sentDatagramCount = 0U;
+    self->sentOctetCount = 0U;
+    self->outboxDroppedCount = 0U;
+    self->releasedConnectionCount = 0U;
+    self->recycledRoomCount = 0U;
+    self->now = monotonicTimeMsNow();
+    self->roomCount = 0U;
+    self->rooms = 0;
+
+    if (setup->maxConnectionCountForEachRoom + 1U > NL_ROOM_MAX_CONNECTIONS) {
+        CLOG_C_ERROR(&self->log, "at most %d connections for each room", NL_ROOM_MAX_CONNECTIONS - 1)
+        return -1;
+    }
+    self->maxConnectionCountForEachRoom = setup->maxConnectionCountForEachRoom;
+    self->setup = *setup;
+
+    for (size_t i = 0U; i < NL_ROOM_SERVER_MAX_CONNECTIONS; ++i) {
+        self->connections[i].isAssigned = false;
+    }
+
+    self->useBatchSocket = setup->datagramBatchCount > 1U;
+    if (self->useBatchSocket) {
+        Clog batchLog;
+        batchLog.config = &g_clog;
+        batchLog.constantPrefix = "batch";
+        if (nlUdpBatchSocketInit(&self->batchSocket, port, setup->datagramBatchCount, batchLog) < 0) {
+            return -3;
+        }
+        self->transport = self->batchSocket.multiTransport;
+    } else {
+        imprintDefaultSetupInit(&self->transportMemory, 1024 * 1024);
+        Clog multiLog;
+        multiLog.config = &g_clog;
+        multiLog.constantPrefix = "multi";
+        transportStackMultiInit(&self->multiTransport, &self->transportMemory.tagAllocator.info,
+                                &self->transportMemory.slabAllocator.info, TransportStackModeLocalUdp, multiLog);
+        transportStackMultiListen(&self->multiTransport, hostname, port);
+        self->transport = self->multiTransport.multiTransport;
+    }
+
+    self->isImpaired = setup->impairmentProfile != 0;
+    if (self->isImpaired) {
+        nlImpairedTransportMultiInit(&self->impairedTransport, self->transport, setup->impairmentProfile,
+                                     setup->impairmentSeed);
+        self->transport = self->impairedTransport.multiTransport;
+    }
+
+    self->rooms = (NlRoom*) tc_malloc(sizeof(NlRoom) * setup->roomCount);
+    for (size_t i = 0U; i < setup->roomCount; ++i) {
+        int errorCode = roomInit(&self->rooms[i], self, i, setup);
+        self->roomCount++;
+        if (errorCode < 0) {
+            destroyRooms(self);
+            destroyTransport(self);
+            return errorCode;
+        }
+    }
+
+    if (nlWorkerPoolInit(&self->workerPool, setup->workerCount) < 0) {
+        destroyRooms(self);
+        destroyTransport(self);
+        return -2;
+    }
+
+    CLOG_C_INFO(&self->log, "hosting %zu rooms on %zu workers", self->roomCount, setup->workerCount)
+    if (setup->workerCount > 1U) {
+        CLOG_C_NOTICE(&self->log, "the rooms do not log while they are updated on more than one worker")
+    }
+
+    return 0;
+}
+
+/// Routes received datagrams to the rooms, updates all rooms in parallel and sends what they produced
+/// @param self room server
+/// @param now current monotonic time
+void nlRoomServerUpdate(NlRoomServer* self, MonotonicTimeMs now)
+{
+    self->now = now;
+
+    NL_TRACE_BEGIN("routeIncoming")
+    if (!self->useBatchSocket) {
+        transportStackMultiUpdate(&self->multiTransport);
+    }
+    routeIncoming(self);
+    releaseIdleConnections(self);
+    NL_TRACE_END()
+
+    updateRooms(self);
+
+    NL_TRACE_BEGIN("flushOutgoing")
+    flushOutgoing(self);
+    if (self->useBatchSocket) {
+        nlUdpBatchSocketFlush(&self->batchSocket);
+    }
+    NL_TRACE_END()
+}
+
+/// Releases a connection from its room. The local connection id is not handed out again, but when the last
+/// connection of a room is released the room is started over and all its connection slots become free.
+/// @param self room server
+/// @param connectionId the connection id on the real transport
+void nlRoomServerReleaseConnection(NlRoomServer* self, int connectionId)
+{
+    if (connectionId < 0 || connectionId >= NL_ROOM_SERVER_MAX_CONNECTIONS) {
+        return;
+    }
+
+    NlRoomConnection* connection = &self->connections[connectionId];
+    if (!connection->isAssigned) {
+        return;
+    }
+
+    NlRoom* room = &self->rooms[connection->roomIndex];
+    room->globalConnectionIds[connection->localConnectionId] = -1;
+    room->activeConnectionCount--;
+    connection->isAssigned = false;
+    self->releasedConnectionCount++;
+    if (self->isImpaired) {
+        nlImpairedTransportMultiResetConnection(&self->impairedTransport, connectionId);
+    }
+    if (self->useBatchSocket) {
+        nlUdpBatchSocketReleaseConnection(&self->batchSocket, connectionId);
+    }
+    CLOG_C_INFO(&self->log, "connection %d leaves room %zu", connectionId, room->index)
+
+    if (room->activeConnectionCount == 0U) {
+        CLOG_C_INFO(&self->log, "room %zu is empty, starting it over", room->index)
+        roomRecycle(self, room);
+    }
+}
+
+size_t nlRoomServerActiveConnectionCount(const NlRoomServer* self)
+{
+    size_t count = 0U;
+    for (size_t i = 0U; i < self->roomCount; ++i) {
+        count += self->rooms[i].activeConnectionCount;
+    }
+    return count;
+}
+
+void nlRoomServerDestroy(NlRoomServer* self)
+{
+    nlWorkerPoolDestroy(&self->workerPool);
+
+    NlClockMicros maxUpdateDuration = 0U;
+    size_t outboxDroppedCount = self->outboxDroppedCount;
+    for (size_t i = 0U; i < self->roomCount; ++i) {
+        const NlRoom* room = &self->rooms[i];
+        if (room->maxUpdateDuration > maxUpdateDuration) {
+            maxUpdateDuration = room->maxUpdateDuration;
+        }
+        outboxDroppedCount += room->outbox.droppedCount;
+    }
+
+    size_t stolenJobCount = 0U;
+    for (size_t i = 0U; i < self->workerPool.workerCount; ++i) {
+        stolenJobCount += self->workerPool.workers[i].stolenJobCount;
+    }
+
+    CLOG_C_INFO(&self->log, "routed %zu datagrams, dropped %zu. longest room update %d us, %zu stolen room updates",
+                self->routedDatagramCount, self->droppedDatagramCount, (int) maxUpdateDuration, stolenJobCount)
+    CLOG_C_INFO(&self->log, "dropped %zu datagrams on full room outboxes. released %zu connections, recycled %zu rooms",
+                outboxDroppedCount, self->releasedConnectionCount, self->recycledRoomCount)
+
+    if (self->isImpaired) {
+        const NlImpairment* impairment = &self->impairedTransport.impairment;
+        CLOG_C_INFO(&self->log, "impairment out: %zu passed %zu dropped, in: %zu passed %zu dropped",
+                    impairment->outgoing.passedCount, impairment->outgoing.droppedCount,
+                    impairment->incoming.passedCount, impairment->incoming.droppedCount)
+    }
+
+    if (self->useBatchSocket) {
+        CLOG_C_INFO(&self->log,
+                    "received %zu datagrams in %zu calls, sent %zu in %zu calls, dropped %zu. released %zu addresses",
+                    self->batchSocket.receivedDatagramCount, self->batchSocket.receiveCallCount,
+                    self->batchSocket.sentDatagramCount, self->batchSocket.sendCallCount,
+                    self->batchSocket.droppedDatagramCount, self->batchSocket.releasedConnectionCount)
+    }
+
+    destroyTransport(self);
+    destroyRooms(self);
+}
@@ -0,0 +1,111 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_ROOM_SERVER_H
+#define NIMBLE_BALL_ROOM_SERVER_H
+
+#include "clock.h"
+#include "datagram_queue.h"
+#include "impaired_transport.h"
+#include "udp_batch.h"
+#include "worker_pool.h"
+#include <imprint/default_setup.h>
+#include <monotonic-time/monotonic_time.h>
+#include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
+#include <nimble-engine-client/client.h>
+#include <nimble-server/server.h>
+#include <transport-stack/multi.h>
+
+#define NL_ROOM_MAX_CONNECTIONS (16)
+#define NL_ROOM_SERVER_MAX_CONNECTIONS (1024)
+
+/// Keeps an authoritative copy of the game of a room by joining it without any local participants.
+/// The nimble server itself never simulates, so it asks for a game state when a late joiner needs one.
+/// Connected to the room through an in-memory pipe instead of a socket.
+typedef struct NlRoomKeeper {
+    NlDatagramQueue toKeeper;
+    NimbleEngineClient nimbleEngineClient;
+    NlSimulationVm authoritative;
+    NlSimulationVm predicted;
+} NlRoomKeeper;
+
+struct NlRoomServer;
+
+/// A nimble server for a single match. Only touched by one worker at a time.
+/// Local connection ids are handed out once. A released id is not reused, since the nimble server still has
+/// the state of that connection, so the room is restarted (recycled) when its last connection is released.
+typedef struct NlRoom {
+    size_t index;
+    struct NlRoomServer* server;
+    bool isStarted;
+    NimbleServer nimbleServer;
+    ImprintDefaultSetup memory;
+    NlDatagramQueue inbox;
+    NlDatagramQueue outbox;
+    int globalConnectionIds[NL_ROOM_MAX_CONNECTIONS];
+    size_t connectionCount;
+    size_t activeConnectionCount;
+    NlRoomKeeper keeper;
+    NlClockMicros maxUpdateDuration;
+    Clog log;
+} NlRoom;
+
+typedef struct NlRoomConnection {
+    bool isAssigned;
+    size_t roomIndex;
+    int localConnectionId;
+    MonotonicTimeMs lastReceivedAt;
+} NlRoomConnection;
+
+typedef struct NlRoomServerSetup {
+    NimbleSerializeVersion applicationVersion;
+    size_t roomCount;
+    size_t workerCount;
+    size_t maxConnectionCountForEachRoom;
+    size_t maxParticipantCountForEachRoom;
+    size_t roomMemoryOctetCount;
+    size_t datagramBatchCount;
+    const NlImpairmentProfile* impairmentProfile;
+    uint32_t impairmentSeed;
+    size_t connectionIdleTimeoutMs;
+} NlRoomServerSetup;
+
+/// Hosts many independent nimble servers behind a single listening transport.
+/// New connections are routed to the first room with a free connection slot and the rooms are
+/// updated in parallel on a work stealing worker pool. The transports do not report disconnects, so a
+/// connection that has not sent anything for the idle timeout is considered gone and released.
+/// With a datagram batch count above one, the transport stack is replaced by a socket that receives and sends
+/// a batch of datagrams for each system call. An impairment profile is applied on top of either transport.
+typedef struct NlRoomServer {
+    DatagramTransportMulti transport;
+    TransportStackMulti multiTransport;
+    ImprintDefaultSetup transportMemory;
+    bool useBatchSocket;
+    NlUdpBatchSocket batchSocket;
+    bool isImpaired;
+    NlImpairedTransportMulti impairedTransport;
+    NlRoomServerSetup setup;
+    NlRoom* rooms;
+    size_t roomCount;
+    size_t maxConnectionCountForEachRoom;
+    NlRoomConnection connections[NL_ROOM_SERVER_MAX_CONNECTIONS];
+    NlWorkerPool workerPool;
+    MonotonicTimeMs now;
+    size_t routedDatagramCount;
+    size_t droppedDatagramCount;
+    size_t sentDatagramCount;
+    size_t sentOctetCount;
+    size_t outboxDroppedCount;
+    size_t releasedConnectionCount;
+    size_t recycledRoomCount;
+    Clog log;
+} NlRoomServer;
+
+int nlRoomServerInit(NlRoomServer* self, const char* hostname, uint16_t port, const NlRoomServerSetup* setup);
+void nlRoomServerUpdate(NlRoomServer* self, MonotonicTimeMs now);
+void nlRoomServerReleaseConnection(NlRoomServer* self, int connectionId);
+size_t nlRoomServerActiveConnectionCount(const NlRoomServer* self);
+void nlRoomServerDestroy(NlRoomServer* self);
+
+#endif
@@ -0,0 +1,124 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "session_memory.h"
+#include "thread_log.h"
+#include <string.h>
+
+/// Initializes the session memory. No memory is reserved until a session begins.
+/// @param self session memory
+/// @param name name used in the log
+/// @param capacity octet count to reserve for each session
+/// @param log log
+void nlSessionMemoryInit(NlSessionMemory* self, const char* name, size_t capacity, Clog log)
+{
+    self->name = name;
+    self->capacity = capacity;
+    self->isActive = false;
+    self->sessionCount = 0U;
+    self->markedOctetCount = 0U;
+    self->highWaterOctetCount = 0U;
+    self->subsystemCount = 0U;
+    self->log = log;
+}
+
+/// @param self session memory
+/// @return octets taken from the memory of the active session, including the reserved slab caches
+size_t nlSessionMemoryUsedOctetCount(const NlSessionMemory* self)
+{
+    if (!self->isActive) {
+        return 0U;
+    }
+
+    return (size_t) (self->setup.linearAllocator.next - self->setup.linearAllocator.memory);
+}
+
+/// Reserves fresh memory for a new session. The previous session must have been ended.
+/// @param self session memory
+void nlSessionMemoryBegin(NlSessionMemory* self)
+{
+    CLOG_ASSERT(!self->isActive, "session memory %s: previous session was not ended", self->name)
+
+    imprintDefaultSetupInit(&self->setup, self->capacity);
+    self->isActive = true;
+    self->sessionCount++;
+
+    for (size_t i = 0U; i < self->subsystemCount; ++i) {
+        self->subsystems[i].octetCount = 0U;
+    }
+
+    // The slab caches that serve allocatorWithFree are taken from the linear memory up front, allocations
+    // from them do not move it. Account the caches as a whole, so used and high-water include them.
+    self->markedOctetCount = 0U;
+    nlSessionMemoryAccount(self, "slabCaches");
+}
+
+static NlSessionMemorySubsystem* findOrAddSubsystem(NlSessionMemory* self, const char* subsystemName)
+{
+    for (size_t i = 0U; i < self->subsystemCount; ++i) {
+        if (strcmp(self->subsystems[i].name, subsystemName) == 0) {
+            return &self->subsystems[i];
+        }
+    }
+
+    if (self->subsystemCount == NL_SESSION_MEMORY_MAX_SUBSYSTEMS) {
+        return 0;
+    }
+
+    NlSessionMemorySubsystem* subsystem = &self->subsystems[self->subsystemCount++];
+    subsystem->name = subsystemName;
+    subsystem->octetCount = 0U;
+    subsystem->highWaterOctetCount = 0U;
+
+    return subsystem;
+}
+
+/// Accounts everything allocated since the previous call to the specified subsystem
+/// @param self session memory
+/// @param subsystemName name of the subsystem, must be a string literal
+void nlSessionMemoryAccount(NlSessionMemory* self, const char* subsystemName)
+{
+    size_t used = nlSessionMemoryUsedOctetCount(self);
+    NlSessionMemorySubsystem* subsystem = findOrAddSubsystem(self, subsystemName);
+    if (subsystem != 0) {
+        subsystem->octetCount += used - self->markedOctetCount;
+        if (subsystem->octetCount > subsystem->highWaterOctetCount) {
+            subsystem->highWaterOctetCount = subsystem->octetCount;
+        }
+    }
+    self->markedOctetCount = used;
+
+    if (used > self->highWaterOctetCount) {
+        self->highWaterOctetCount = used;
+    }
+}
+
+/// Releases all memory of the session
+/// @param self session memory
+void nlSessionMemoryEnd(NlSessionMemory* self)
+{
+    if (!self->isActive) {
+        return;
+    }
+
+    nlSessionMemoryAccount(self, "runtime");
+
+    NL_LOG_C_INFO(&self->log, "%s session %zu ended. used %zu of %zu octets", self->name, self->sessionCount,
+                  self->markedOctetCount, self->capacity)
+
+    imprintDefaultSetupDestroy(&self->setup);
+    self->isActive = false;
+}
+
+/// Logs the highest usage of each subsystem over all sessions, useful for sizing the capacity
+/// @param self session memory
+void nlSessionMemoryLogHighWater(const NlSessionMemory* self)
+{
+    NL_LOG_C_INFO(&self->log, "%s high-water %zu of %zu octets over %zu sessions", self->name,
+                  self->highWaterOctetCount, self->capacity, self->sessionCount)
+    for (size_t i = 0U; i < self->subsystemCount; ++i) {
+        const NlSessionMemorySubsystem* subsystem = &self->subsystems[i];
+        NL_LOG_C_INFO(&self->log, "  %s: %zu octets", subsystem->name, subsystem->highWaterOctetCount)
+    }
+}
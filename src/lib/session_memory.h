@@ -0,0 +1,45 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_SESSION_MEMORY_H
+#define NIMBLE_BALL_SESSION_MEMORY_H
+
+#include <clog/clog.h>
+#include <imprint/default_setup.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define NL_SESSION_MEMORY_MAX_SUBSYSTEMS (8)
+
+typedef struct NlSessionMemorySubsystem {
+    const char* name;
+    size_t octetCount;
+    size_t highWaterOctetCount;
+} NlSessionMemorySubsystem;
+
+/// Memory that lives as long as a hosted or joined session. Everything allocated from it is released
+/// at once when the session ends. Usage is accounted to the subsystems that allocated it and the
+/// high-water marks are kept over all sessions. The slab caches behind `setup.slabAllocator` are reserved
+/// when the session begins and are accounted as a whole to "slabCaches", not to the subsystems that use them.
+typedef struct NlSessionMemory {
+    const char* name;
+    size_t capacity;
+    ImprintDefaultSetup setup;
+    bool isActive;
+    size_t sessionCount;
+    size_t markedOctetCount;
+    size_t highWaterOctetCount;
+    NlSessionMemorySubsystem subsystems[NL_SESSION_MEMORY_MAX_SUBSYSTEMS];
+    size_t subsystemCount;
+    Clog log;
+} NlSessionMemory;
+
+void nlSessionMemoryInit(NlSessionMemory* self, const char* name, size_t capacity, Clog log);
+void nlSessionMemoryBegin(NlSessionMemory* self);
+void nlSessionMemoryAccount(NlSessionMemory* self, const char* subsystemName);
+void nlSessionMemoryEnd(NlSessionMemory* self);
+size_t nlSessionMemoryUsedOctetCount(const NlSessionMemory* self);
+void nlSessionMemoryLogHighWater(const NlSessionMemory* self);
+
+#endif
@@ -0,0 +1,99 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "state_check.h"
+#include "state_hash.h"
+#include "thread_log.h"
+
+static void stateCheckVmTick(void* _self, const TransmuteInput* input)
+{
+    NlStateCheckVm* self = (NlStateCheckVm*) _self;
+
+    bool mustCheck = self->shadow != 0 && self->checkInterval > 0U &&
+                     (self->tickCount + 1U) % self->checkInterval == 0U;
+    if (mustCheck) {
+        TransmuteState before = transmuteVmGetState(self->inner);
+        transmuteVmSetState(self->shadow, &before);
+    }
+
+    transmuteVmTick(self->inner, input);
+    self->tickCount++;
+
+    if (!mustCheck) {
+        return;
+    }
+
+    transmuteVmTick(self->shadow, input);
+    TransmuteState after = transmuteVmGetState(self->inner);
+    TransmuteState shadowAfter = transmuteVmGetState(self->shadow);
+    self->checkCount++;
+    if (nlStateHash(shadowAfter.state, shadowAfter.octetSize) != nlStateHash(after.state, after.octetSize)) {
+        self->mismatchCount++;
+        self->lastMismatchTickCount = self->tickCount;
+        NL_LOG_C_WARN(&self->log, "determinism self-check failed at tick %zu (%zu of %zu checks)", self->tickCount,
+                      self->mismatchCount, self->checkCount)
+    }
+}
+
+static TransmuteState stateCheckVmGetState(const void* _self)
+{
+    const NlStateCheckVm* self = (const NlStateCheckVm*) _self;
+    return transmuteVmGetState(self->inner);
+}
+
+static void stateCheckVmSetState(void* _self, const TransmuteState* state)
+{
+    NlStateCheckVm* self = (NlStateCheckVm*) _self;
+    transmuteVmSetState(self->inner, state);
+}
+
+static int stateCheckVmStateToString(void* _self, const TransmuteState* state, char* target,
+                                     size_t maxTargetOctetSize)
+{
+    NlStateCheckVm* self = (NlStateCheckVm*) _self;
+    return self->inner->stateToString(self->inner->vmPointer, state, target, maxTargetOctetSize);
+}
+
+static int stateCheckVmInputToString(void* _self, const TransmuteParticipantInput* input, char* target,
+                                     size_t maxTargetOctetSize)
+{
+    NlStateCheckVm* self = (NlStateCheckVm*) _self;
+    return self->inner->inputToString(self->inner->vmPointer, input, target, maxTargetOctetSize);
+}
+
+/// Wraps a simulation so a tick is regularly verified against a shadow simulation
+/// @param self state check vm
+/// @param inner the simulation that does the actual work
+/// @param shadow a second instance of the same simulation, only used for verification. Can be zero.
+/// @param checkInterval number of ticks between verifications, zero to only pass the ticks through
+/// @param log log
+void nlStateCheckVmInit(NlStateCheckVm* self, TransmuteVm* inner, TransmuteVm* shadow, size_t checkInterval,
+                        Clog log)
+{
+    self->inner = inner;
+    self->shadow = shadow;
+    self->checkInterval = checkInterval;
+    self->log = log;
+    nlStateCheckVmReset(self);
+
+    TransmuteVmSetup setup;
+    setup.tickFn = stateCheckVmTick;
+    setup.getStateFn = stateCheckVmGetState;
+    setup.setStateFn = stateCheckVmSetState;
+    setup.stateToString = stateCheckVmStateToString;
+    setup.inputToString = stateCheckVmInputToString;
+    setup.version = inner->version;
+
+    transmuteVmInit(&self->transmuteVm, self, setup, inner->log);
+}
+
+/// Clears the counters, for example when joining a new game
+/// @param self state check vm
+void nlStateCheckVmReset(NlStateCheckVm* self)
+{
+    self->tickCount = 0U;
+    self->checkCount = 0U;
+    self->mismatchCount = 0U;
+    self->lastMismatchTickCount = 0U;
+}
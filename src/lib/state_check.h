@@ -0,0 +1,33 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_STATE_CHECK_H
+#define NIMBLE_BALL_STATE_CHECK_H
+
+#include <clog/clog.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+/// Determinism self-check, a debugging aid. Wraps the authoritative simulation, and every checkInterval ticks the
+/// same tick is also run on a local shadow simulation from the same state and both states are hashed. Different
+/// hashes mean that the simulation is not deterministic on this machine, for example because of uninitialized
+/// memory. It is not a cross-peer check: the hashes are never compared to the ones of the host or other clients.
+typedef struct NlStateCheckVm {
+    TransmuteVm transmuteVm;
+    TransmuteVm* inner;
+    TransmuteVm* shadow;
+    size_t checkInterval;
+    size_t tickCount;
+    size_t checkCount;
+    size_t mismatchCount;
+    size_t lastMismatchTickCount;
+    Clog log;
+} NlStateCheckVm;
+
+void nlStateCheckVmInit(NlStateCheckVm* self, TransmuteVm* inner, TransmuteVm* shadow, size_t checkInterval,
+                        Clog log);
+void nlStateCheckVmReset(NlStateCheckVm* self);
+
+#endif
@@ -0,0 +1,138 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "state_delta.h"
+#include <tiny-libc/tiny_libc.h>
+
+// Shorter runs of unchanged octets are cheaper to keep in the literal than to start a new run for
+static const size_t nlStateDeltaMinZeroRun = 4U;
+
+static int writeVarint(uint8_t* target, size_t targetCapacity, size_t* pos, size_t value)
+{
+    do {
+        if (*pos == targetCapacity) {
+            return -1;
+        }
+        uint8_t octet = (uint8_t) (value & 0x7f);
+        value >>= 7U;
+        if (value != 0U) {
+            octet |= 0x80;
+        }
+        target[(*pos)++] = octet;
+    } while (value != 0U);
+
+    return 0;
+}
+
+static int readVarint(const uint8_t* source, size_t sourceOctetCount, size_t* pos, size_t* value)
+{
+    size_t result = 0U;
+    for (size_t shift = 0U; shift < 35U; shift += 7U) {
+        if (*pos == sourceOctetCount) {
+            return -1;
+        }
+        uint8_t octet = source[(*pos)++];
+        result |= (size_t) (octet & 0x7f) << shift;
+        if ((octet & 0x80) == 0) {
+            *value = result;
+            return 0;
+        }
+    }
+
+    return -2;
+}
+
+static size_t zeroRunLength(const uint8_t* baseline, const uint8_t* state, size_t pos, size_t octetCount)
+{
+    size_t start = pos;
+    while (pos < octetCount && baseline[pos] == state[pos]) {
+        pos++;
+    }
+    return pos - start;
+}
+
+/// Encodes the difference between a state and a baseline that the receiver already has.
+/// The state is XORed with the baseline, runs of unchanged octets are run-length encoded and the
+/// changed octets are stored as is. Unchanged octets at the end are not stored at all.
+/// @param baseline the state that both sides have
+/// @param state state to encode
+/// @param octetCount octet count of both baseline and state
+/// @param target encoded delta
+/// @param targetCapacity capacity of target
+/// @return the encoded octet count or negative if it does not fit in target
+int nlStateDeltaEncode(const uint8_t* baseline, const uint8_t* state, size_t octetCount, uint8_t* target,
+                       size_t targetCapacity)
+{
+    size_t pos = 0U;
+    size_t targetPos = 0U;
+
+    while (pos < octetCount) {
+        size_t zeroCount = zeroRunLength(baseline, state, pos, octetCount);
+        pos += zeroCount;
+        if (pos == octetCount) {
+            break;
+        }
+
+        size_t literalStart = pos;
+        while (pos < octetCount) {
+            size_t gap = zeroRunLength(baseline, state, pos, octetCount);
+            if (gap >= nlStateDeltaMinZeroRun || pos + gap == octetCount) {
+                break;
+            }
+            pos += gap + 1U;
+        }
+        size_t literalCount = pos - literalStart;
+
+        if (writeVarint(target, targetCapacity, &targetPos, zeroCount) < 0 ||
+            writeVarint(target, targetCapacity, &targetPos, literalCount) < 0) {
+            return -1;
+        }
+        if (targetPos + literalCount > targetCapacity) {
+            return -1;
+        }
+        for (size_t i = 0U; i < literalCount; ++i) {
+            target[targetPos++] = baseline[literalStart + i] ^ state[literalStart + i];
+        }
+    }
+
+    return (int) targetPos;
+}
+
+/// Applies a delta from nlStateDeltaEncode() to the same baseline that it was encoded against
+/// @param baseline the state that the delta was encoded against
+/// @param delta encoded delta
+/// @param deltaOctetCount octet count of the delta
+/// @param target the decoded state. Must not overlap the baseline
+/// @param octetCount octet count of both baseline and target
+/// @return negative if the delta is malformed
+int nlStateDeltaDecode(const uint8_t* baseline, const uint8_t* delta, size_t deltaOctetCount, uint8_t* target,
+                       size_t octetCount)
+{
+    size_t pos = 0U;
+    size_t deltaPos = 0U;
+
+    while (deltaPos < deltaOctetCount) {
+        size_t zeroCount;
+        size_t literalCount;
+        if (readVarint(delta, deltaOctetCount, &deltaPos, &zeroCount) < 0 ||
+            readVarint(delta, deltaOctetCount, &deltaPos, &literalCount) < 0) {
+            return -1;
+        }
+        if (zeroCount > octetCount - pos || literalCount > octetCount - pos - zeroCount ||
+            literalCount > deltaOctetCount - deltaPos) {
+            return -2;
+        }
+
+        tc_memcpy_octets(&target[pos], &baseline[pos], zeroCount);
+        pos += zeroCount;
+        for (size_t i = 0U; i < literalCount; ++i) {
+            target[pos] = baseline[pos] ^ delta[deltaPos++];
+            pos++;
+        }
+    }
+
+    tc_memcpy_octets(&target[pos], &baseline[pos], octetCount - pos);
+
+    return 0;
+}
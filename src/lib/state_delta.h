@@ -0,0 +1,16 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_STATE_DELTA_H
+#define NIMBLE_BALL_STATE_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+int nlStateDeltaEncode(const uint8_t* baseline, const uint8_t* state, size_t octetCount, uint8_t* target,
+                       size_t targetCapacity);
+int nlStateDeltaDecode(const uint8_t* baseline, const uint8_t* delta, size_t deltaOctetCount, uint8_t* target,
+                       size_t octetCount);
+
+#endif
@@ -0,0 +1,115 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "state_hash.h"
+#include <tiny-libc/tiny_libc.h>
+
+static const uint64_t nlStateHashPrime1 = 0x9e3779b185ebca87U;
+static const uint64_t nlStateHashPrime2 = 0xc2b2ae3d27d4eb4fU;
+static const uint64_t nlStateHashPrime3 = 0x165667b19e3779f9U;
+static const uint64_t nlStateHashPrime4 = 0x85ebca77c2b2ae63U;
+
+static uint64_t rotateLeft(uint64_t value, unsigned int count)
+{
+    return (value << count) | (value >> (64U - count));
+}
+
+static uint64_t readUint64(const uint8_t* octets)
+{
+    uint64_t value;
+    tc_memcpy_octets(&value, octets, sizeof(value));
+    return value;
+}
+
+static uint64_t round64(uint64_t accumulator, uint64_t value)
+{
+    accumulator += value * nlStateHashPrime2;
+    accumulator = rotateLeft(accumulator, 31U);
+    return accumulator * nlStateHashPrime1;
+}
+
+static uint64_t mergeLane(uint64_t hash, uint64_t lane)
+{
+    hash ^= round64(0U, lane);
+    return hash * nlStateHashPrime1 + nlStateHashPrime4;
+}
+
+/// Hashes a blittable simulation state. Four independent lanes consume 32 octets per round, so the
+/// compiler can keep them in registers and the multiplies can run in parallel. Cheap enough to run every tick.
+/// The result depends on the byte order of the host, which is fine as long as it is only compared
+/// between machines of the same kind.
+/// @param state state octets
+/// @param octetCount number of octets in state
+/// @return 64-bit hash
+uint64_t nlStateHash(const void* state, size_t octetCount)
+{
+    const uint8_t* octets = (const uint8_t*) state;
+    const uint8_t* end = octets + octetCount;
+    uint64_t hash;
+
+    if (octetCount >= 32U) {
+        uint64_t lanes[4] = {
+            nlStateHashPrime1 + nlStateHashPrime2,
+            nlStateHashPrime2,
+            0U,
+            0U - nlStateHashPrime1,
+        };
+
+        const uint8_t* blockEnd = end - 32U;
+        do {
+            for (size_t lane = 0U; lane < 4U; ++lane) {
+                lanes[lane] = round64(lanes[lane], readUint64(octets + lane * 8U));
+            }
+            octets += 32U;
+        } while (octets <= blockEnd);
+
+        hash = rotateLeft(lanes[0], 1U) + rotateLeft(lanes[1], 7U) + rotateLeft(lanes[2], 12U) +
+               rotateLeft(lanes[3], 18U);
+        for (size_t lane = 0U; lane < 4U; ++lane) {
+            hash = mergeLane(hash, lanes[lane]);
+        }
+    } else {
+        hash = nlStateHashPrime3;
+    }
+
+    hash += (uint64_t) octetCount;
+
+    while (octets + 8U <= end) {
+        hash ^= round64(0U, readUint64(octets));
+        hash = rotateLeft(hash, 27U) * nlStateHashPrime1 + nlStateHashPrime4;
+        octets += 8U;
+    }
+
+    while (octets < end) {
+        hash ^= (uint64_t) (*octets) * nlStateHashPrime3;
+        hash = rotateLeft(hash, 11U) * nlStateHashPrime1;
+        octets++;
+    }
+
+    hash ^= hash >> 33U;
+    hash *= nlStateHashPrime2;
+    hash ^= hash >> 29U;
+    hash *= nlStateHashPrime3;
+    hash ^= hash >> 32U;
+
+    return hash;
+}
+
+/// Hashes a blittable simulation state with FNV-1a. Only used to verify recordings made before
+/// nlStateHash() replaced it (format version 2 and older).
+/// @param state state octets
+/// @param octetCount number of octets in state
+/// @return 64-bit hash
+uint64_t nlStateHashFnv1a(const void* state, size_t octetCount)
+{
+    const uint8_t* octets = (const uint8_t*) state;
+    uint64_t hash = 0xcbf29ce484222325U;
+
+    for (size_t i = 0U; i < octetCount; ++i) {
+        hash ^= octets[i];
+        hash *= 0x100000001b3U;
+    }
+
+    return hash;
+}
@@ -0,0 +1,14 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_STATE_HASH_H
+#define NIMBLE_BALL_STATE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t nlStateHash(const void* state, size_t octetCount);
+uint64_t nlStateHashFnv1a(const void* state, size_t octetCount);
+
+#endif
@@ -0,0 +1,151 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "text_cache.h"
+#include <stdbool.h>
+#include <string.h>
+
+/// Initializes an empty text cache
+/// @param self text cache
+/// @param renderer renderer that owns the textures
+void nlTextCacheInit(NlTextCache* self, SDL_Renderer* renderer)
+{
+    self->renderer = renderer;
+    self->entryCount = 0U;
+    self->frame = 0U;
+    self->rasterizeCount = 0U;
+}
+
+void nlTextCacheDestroy(NlTextCache* self)
+{
+    for (size_t i = 0U; i < self->entryCount; ++i) {
+        SDL_DestroyTexture(self->entries[i].texture);
+    }
+    self->entryCount = 0U;
+}
+
+/// Must be called once every frame, used to find the least recently used entry
+/// @param self text cache
+void nlTextCacheNextFrame(NlTextCache* self)
+{
+    self->frame++;
+}
+
+static uint32_t textHash(const char* text, SDL_Color color)
+{
+    uint32_t hash = 2166136261U;
+    for (const char* p = text; *p != 0; ++p) {
+        hash = (hash ^ (uint8_t) *p) * 16777619U;
+    }
+    uint32_t packedColor = (uint32_t) color.r | ((uint32_t) color.g << 8) | ((uint32_t) color.b << 16) |
+                           ((uint32_t) color.a << 24);
+    return (hash ^ packedColor) * 16777619U;
+}
+
+static bool isSameColor(SDL_Color a, SDL_Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static NlTextCacheEntry* findEntry(NlTextCache* self, uint32_t hash, const SrFont* font, const char* text,
+                                   SDL_Color color)
+{
+    for (size_t i = 0U; i < self->entryCount; ++i) {
+        NlTextCacheEntry* entry = &self->entries[i];
+        if (entry->hash == hash && entry->font == font->font && isSameColor(entry->color, color) &&
+            strcmp(entry->text, text) == 0) {
+            return entry;
+        }
+    }
+
+    return 0;
+}
+
+static NlTextCacheEntry* allocateEntry(NlTextCache* self)
+{
+    if (self->entryCount < NL_TEXT_CACHE_MAX_ENTRIES) {
+        return &self->entries[self->entryCount++];
+    }
+
+    NlTextCacheEntry* leastRecentlyUsed = &self->entries[0];
+    for (size_t i = 1U; i < self->entryCount; ++i) {
+        if (self->entries[i].lastUsedFrame < leastRecentlyUsed->lastUsedFrame) {
+            leastRecentlyUsed = &self->entries[i];
+        }
+    }
+    SDL_DestroyTexture(leastRecentlyUsed->texture);
+
+    return leastRecentlyUsed;
+}
+
+static NlTextCacheEntry* rasterize(NlTextCache* self, uint32_t hash, const SrFont* font, const char* text,
+                                   SDL_Color color)
+{
+    SDL_Surface* surface = TTF_RenderUTF8_Blended(font->font, text, color);
+    if (surface == 0) {
+        return 0;
+    }
+
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(self->renderer, surface);
+    int width = surface->w;
+    int height = surface->h;
+    SDL_FreeSurface(surface);
+    if (texture == 0) {
+        return 0;
+    }
+
+    NlTextCacheEntry* entry = allocateEntry(self);
+    entry->hash = hash;
+    strncpy(entry->text, text, NL_TEXT_CACHE_MAX_TEXT_LENGTH);
+    entry->text[NL_TEXT_CACHE_MAX_TEXT_LENGTH] = 0;
+    entry->color = color;
+    entry->font = font->font;
+    entry->texture = texture;
+    entry->width = width;
+    entry->height = height;
+    self->rasterizeCount++;
+
+    return entry;
+}
+
+/// Renders text at the same position as srFontRenderAndCopy() (y is up), but only rasterizes it
+/// the first time the (text, color, font) combination is used.
+/// Text longer than NL_TEXT_CACHE_MAX_TEXT_LENGTH is rendered without caching.
+/// @param self text cache
+/// @param font font
+/// @param text text to render
+/// @param x left position
+/// @param y bottom position
+/// @param color text color
+void nlTextCacheRender(NlTextCache* self, const SrFont* font, const char* text, int x, int y, SDL_Color color)
+{
+    if (strlen(text) > NL_TEXT_CACHE_MAX_TEXT_LENGTH) {
+        srFontRenderAndCopy((SrFont*) font, text, x, y, color);
+        return;
+    }
+
+    uint32_t hash = textHash(text, color);
+    NlTextCacheEntry* entry = findEntry(self, hash, font, text, color);
+    if (entry == 0) {
+        entry = rasterize(self, hash, font, text, color);
+        if (entry == 0) {
+            return;
+        }
+    }
+    entry->lastUsedFrame = self->frame;
+
+    int targetWidth;
+    int targetHeight;
+    SDL_RenderGetLogicalSize(self->renderer, &targetWidth, &targetHeight);
+    if (targetHeight == 0) {
+        SDL_GetRendererOutputSize(self->renderer, &targetWidth, &targetHeight);
+    }
+
+    SDL_Rect target;
+    target.x = x;
+    target.y = targetHeight - y - entry->height;
+    target.w = entry->width;
+    target.h = entry->height;
+    SDL_RenderCopy(self->renderer, entry->texture, 0, &target);
+}
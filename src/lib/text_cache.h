@@ -0,0 +1,41 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_TEXT_CACHE_H
+#define NIMBLE_BALL_TEXT_CACHE_H
+
+#include <sdl-render/font.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_TEXT_CACHE_MAX_ENTRIES (64)
+#define NL_TEXT_CACHE_MAX_TEXT_LENGTH (63)
+
+typedef struct NlTextCacheEntry {
+    uint32_t hash;
+    char text[NL_TEXT_CACHE_MAX_TEXT_LENGTH + 1];
+    SDL_Color color;
+    TTF_Font* font;
+    SDL_Texture* texture;
+    int width;
+    int height;
+    uint64_t lastUsedFrame;
+} NlTextCacheEntry;
+
+/// Keeps rendered text as textures, keyed on (text, color, font), so text that does not change
+/// is only rasterized once. The least recently used entry is evicted when the cache is full.
+typedef struct NlTextCache {
+    SDL_Renderer* renderer;
+    NlTextCacheEntry entries[NL_TEXT_CACHE_MAX_ENTRIES];
+    size_t entryCount;
+    uint64_t frame;
+    size_t rasterizeCount;
+} NlTextCache;
+
+void nlTextCacheInit(NlTextCache* self, SDL_Renderer* renderer);
+void nlTextCacheDestroy(NlTextCache* self);
+void nlTextCacheNextFrame(NlTextCache* self);
+void nlTextCacheRender(NlTextCache* self, const SrFont* font, const char* text, int x, int y, SDL_Color color);
+
+#endif
@@ -0,0 +1,157 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "thread.h"
+#include "async_log.h"
+#include "trace.h"
+
+#if defined _WIN32
+
+static DWORD WINAPI threadEntry(LPVOID _self)
+{
+    NlThread* self = (NlThread*) _self;
+    self->fn(self->arg);
+    NL_TRACE_THREAD_EXIT()
+    nlAsyncLogReleaseThread();
+    return 0;
+}
+
+/// Starts a new thread. The NlThread must stay at the same address until it has been joined.
+/// @param self thread
+/// @param fn function to run on the thread
+/// @param arg argument passed to fn
+/// @return negative on error
+int nlThreadCreate(NlThread* self, NlThreadFn fn, void* arg)
+{
+    self->fn = fn;
+    self->arg = arg;
+    self->handle = CreateThread(0, 0, threadEntry, self, 0, 0);
+
+    return self->handle == 0 ? -1 : 0;
+}
+
+void nlThreadJoin(NlThread* self)
+{
+    WaitForSingleObject(self->handle, INFINITE);
+    CloseHandle(self->handle);
+}
+
+void nlMutexInit(NlMutex* self)
+{
+    InitializeSRWLock(&self->lock);
+}
+
+void nlMutexLock(NlMutex* self)
+{
+    AcquireSRWLockExclusive(&self->lock);
+}
+
+void nlMutexUnlock(NlMutex* self)
+{
+    ReleaseSRWLockExclusive(&self->lock);
+}
+
+void nlMutexDestroy(NlMutex* self)
+{
+    (void) self;
+}
+
+void nlConditionInit(NlCondition* self)
+{
+    InitializeConditionVariable(&self->condition);
+}
+
+/// Unlocks the mutex, sleeps until signaled and locks the mutex again. Can wake up without a signal,
+/// so always wait in a loop that checks the state.
+/// @param self condition
+/// @param mutex locked mutex that protects the state
+void nlConditionWait(NlCondition* self, NlMutex* mutex)
+{
+    SleepConditionVariableSRW(&self->condition, &mutex->lock, INFINITE, 0);
+}
+
+void nlConditionSignalAll(NlCondition* self)
+{
+    WakeAllConditionVariable(&self->condition);
+}
+
+void nlConditionDestroy(NlCondition* self)
+{
+    (void) self;
+}
+
+#else
+
+static void* threadEntry(void* _self)
+{
+    NlThread* self = (NlThread*) _self;
+    self->fn(self->arg);
+    NL_TRACE_THREAD_EXIT()
+    nlAsyncLogReleaseThread();
+    return 0;
+}
+
+/// Starts a new thread. The NlThread must stay at the same address until it has been joined.
+/// @param self thread
+/// @param fn function to run on the thread
+/// @param arg argument passed to fn
+/// @return negative on error
+int nlThreadCreate(NlThread* self, NlThreadFn fn, void* arg)
+{
+    self->fn = fn;
+    self->arg = arg;
+
+    return pthread_create(&self->handle, 0, threadEntry, self) != 0 ? -1 : 0;
+}
+
+void nlThreadJoin(NlThread* self)
+{
+    pthread_join(self->handle, 0);
+}
+
+void nlMutexInit(NlMutex* self)
+{
+    pthread_mutex_init(&self->mutex, 0);
+}
+
+void nlMutexLock(NlMutex* self)
+{
+    pthread_mutex_lock(&self->mutex);
+}
+
+void nlMutexUnlock(NlMutex* self)
+{
+    pthread_mutex_unlock(&self->mutex);
+}
+
+void nlMutexDestroy(NlMutex* self)
+{
+    pthread_mutex_destroy(&self->mutex);
+}
+
+void nlConditionInit(NlCondition* self)
+{
+    pthread_cond_init(&self->condition, 0);
+}
+
+/// Unlocks the mutex, sleeps until signaled and locks the mutex again. Can wake up without a signal,
+/// so always wait in a loop that checks the state.
+/// @param self condition
+/// @param mutex locked mutex that protects the state
+void nlConditionWait(NlCondition* self, NlMutex* mutex)
+{
+    pthread_cond_wait(&self->condition, &mutex->mutex);
+}
+
+void nlConditionSignalAll(NlCondition* self)
+{
+    pthread_cond_broadcast(&self->condition);
+}
+
+void nlConditionDestroy(NlCondition* self)
+{
+    pthread_cond_destroy(&self->condition);
+}
+
+#endif
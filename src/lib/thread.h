@@ -0,0 +1,62 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_THREAD_H
+#define NIMBLE_BALL_THREAD_H
+
+#if defined _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if defined _MSC_VER
+#define NL_THREAD_LOCAL __declspec(thread)
+#else
+#define NL_THREAD_LOCAL _Thread_local
+#endif
+
+typedef void (*NlThreadFn)(void* arg);
+
+typedef struct NlThread {
+#if defined _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    NlThreadFn fn;
+    void* arg;
+} NlThread;
+
+typedef struct NlMutex {
+#if defined _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t mutex;
+#endif
+} NlMutex;
+
+/// Lets threads sleep until another thread signals that the state they wait for has changed
+typedef struct NlCondition {
+#if defined _WIN32
+    CONDITION_VARIABLE condition;
+#else
+    pthread_cond_t condition;
+#endif
+} NlCondition;
+
+int nlThreadCreate(NlThread* self, NlThreadFn fn, void* arg);
+void nlThreadJoin(NlThread* self);
+
+void nlMutexInit(NlMutex* self);
+void nlMutexLock(NlMutex* self);
+void nlMutexUnlock(NlMutex* self);
+void nlMutexDestroy(NlMutex* self);
+
+void nlConditionInit(NlCondition* self);
+void nlConditionWait(NlCondition* self, NlMutex* mutex);
+void nlConditionSignalAll(NlCondition* self);
+void nlConditionDestroy(NlCondition* self);
+
+#endif
@@ -0,0 +1,29 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "thread_log.h"
+#include "thread.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+static NL_THREAD_LOCAL char t_threadLogLine[CLOG_TEMP_STR_SIZE];
+
+/// Formats a log line into a buffer owned by the calling thread and passes it to the clog backend.
+/// Use the NL_LOG_* macros instead, they skip the formatting for filtered out levels.
+/// @param prefix constant prefix of the log
+/// @param type log type
+/// @param format printf style format
+void nlThreadLog(const char* prefix, enum clog_type type, const char* format, ...)
+{
+    if (g_clog.log == 0) {
+        return;
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(t_threadLogLine, sizeof(t_threadLogLine), format, arguments);
+    va_end(arguments);
+
+    g_clog.log(type, prefix, t_threadLogLine);
+}
@@ -0,0 +1,49 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_THREAD_LOG_H
+#define NIMBLE_BALL_THREAD_LOG_H
+
+#include <clog/clog.h>
+
+/// Logging that can be used from any thread. The CLOG_* macros format into the single shared
+/// `g_clog_temp_str`, so two threads logging at the same time race on it. The NL_LOG_* macros take the same
+/// arguments but format into a buffer of the calling thread before handing the line to the `g_clog.log` backend.
+///
+/// Code in this repository that runs on the host thread, the network thread or the room server workers must use
+/// NL_LOG_*. The dependencies (nimble-server, nimble-engine-client, transport-stack) still log with CLOG_*, so
+/// lines they log from those threads can come out garbled. The room server mutes all logging while more than
+/// one worker updates rooms, since there every room would log at the same time.
+
+void nlThreadLog(const char* prefix, enum clog_type type, const char* format, ...);
+
+#define NL_LOG_C_EX(logtype, logger, ...)                                                                              \
+    {                                                                                                                  \
+        if ((logger)->config->level <= (logtype)) {                                                                    \
+            nlThreadLog((logger)->constantPrefix, logtype, __VA_ARGS__);                                               \
+        }                                                                                                              \
+    }
+
+#define NL_LOG_EX(logtype, ...)                                                                                        \
+    {                                                                                                                  \
+        if (g_clog.level <= (logtype)) {                                                                               \
+            nlThreadLog("", logtype, __VA_ARGS__);                                                                     \
+        }                                                                                                              \
+    }
+
+#define NL_LOG_C_VERBOSE(logger, ...) NL_LOG_C_EX(CLOG_TYPE_VERBOSE, logger, __VA_ARGS__)
+#define NL_LOG_C_DEBUG(logger, ...) NL_LOG_C_EX(CLOG_TYPE_DEBUG, logger, __VA_ARGS__)
+#define NL_LOG_C_INFO(logger, ...) NL_LOG_C_EX(CLOG_TYPE_INFO, logger, __VA_ARGS__)
+#define NL_LOG_C_NOTICE(logger, ...) NL_LOG_C_EX(CLOG_TYPE_NOTICE, logger, __VA_ARGS__)
+#define NL_LOG_C_WARN(logger, ...) NL_LOG_C_EX(CLOG_TYPE_WARN, logger, __VA_ARGS__)
+#define NL_LOG_C_ERROR(logger, ...) NL_LOG_C_EX(CLOG_TYPE_ERROR, logger, __VA_ARGS__)
+
+#define NL_LOG_VERBOSE(...) NL_LOG_EX(CLOG_TYPE_VERBOSE, __VA_ARGS__)
+#define NL_LOG_DEBUG(...) NL_LOG_EX(CLOG_TYPE_DEBUG, __VA_ARGS__)
+#define NL_LOG_INFO(...) NL_LOG_EX(CLOG_TYPE_INFO, __VA_ARGS__)
+#define NL_LOG_NOTICE(...) NL_LOG_EX(CLOG_TYPE_NOTICE, __VA_ARGS__)
+#define NL_LOG_WARN(...) NL_LOG_EX(CLOG_TYPE_WARN, __VA_ARGS__)
+#define NL_LOG_ERROR(...) NL_LOG_EX(CLOG_TYPE_ERROR, __VA_ARGS__)
+
+#endif
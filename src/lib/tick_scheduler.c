@@ -0,0 +1,52 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "tick_scheduler.h"
+
+/// Initializes a fixed rate tick scheduler
+/// @param self tick scheduler
+/// @param tickDuration duration of a single tick in microseconds
+/// @param now current monotonic time
+void nlTickSchedulerInit(NlTickScheduler* self, NlClockMicros tickDuration, NlClockMicros now)
+{
+    self->tickDuration = tickDuration;
+    self->nextTickAt = now;
+    self->maxCatchUpTicks = 4U;
+}
+
+/// Returns the number of ticks that should be run now
+/// If the caller has fallen too far behind, the schedule is moved forward instead of
+/// trying to catch up with a burst of ticks.
+/// @param self tick scheduler
+/// @param now current monotonic time
+/// @return number of ticks to run
+size_t nlTickSchedulerTicksDue(NlTickScheduler* self, NlClockMicros now)
+{
+    if (now < self->nextTickAt) {
+        return 0U;
+    }
+
+    size_t count = (size_t) ((now - self->nextTickAt) / self->tickDuration) + 1U;
+    if (count > self->maxCatchUpTicks) {
+        count = self->maxCatchUpTicks;
+        self->nextTickAt = now + self->tickDuration;
+        return count;
+    }
+
+    self->nextTickAt += (NlClockMicros) count * self->tickDuration;
+
+    return count;
+}
+
+/// Sleeps until the next tick is due
+/// @param self tick scheduler
+void nlTickSchedulerWaitForNextTick(const NlTickScheduler* self)
+{
+    NlClockMicros now = nlClockNowMicros();
+    if (now >= self->nextTickAt) {
+        return;
+    }
+
+    nlClockSleepMicros(self->nextTickAt - now);
+}
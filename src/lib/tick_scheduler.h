@@ -0,0 +1,22 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_TICK_SCHEDULER_H
+#define NIMBLE_BALL_TICK_SCHEDULER_H
+
+#include "clock.h"
+#include <stddef.h>
+
+/// Schedules ticks at a fixed rate on the monotonic clock
+typedef struct NlTickScheduler {
+    NlClockMicros tickDuration;
+    NlClockMicros nextTickAt;
+    size_t maxCatchUpTicks;
+} NlTickScheduler;
+
+void nlTickSchedulerInit(NlTickScheduler* self, NlClockMicros tickDuration, NlClockMicros now);
+size_t nlTickSchedulerTicksDue(NlTickScheduler* self, NlClockMicros now);
+void nlTickSchedulerWaitForNextTick(const NlTickScheduler* self);
+
+#endif
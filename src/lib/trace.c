@@ -0,0 +1,183 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "trace.h"
+
+#if defined NL_TRACE_ENABLED
+
+#include "clock.h"
+#include "thread.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define NL_TRACE_MAX_THREADS (8)
+#define NL_TRACE_EVENT_CAPACITY (16 * 1024)
+#define NL_TRACE_MAX_DEPTH (16)
+
+typedef struct NlTraceEvent {
+    const char* name;
+    NlClockMicros startedAt;
+    uint32_t duration;
+    uint32_t depth;
+} NlTraceEvent;
+
+/// Only written by the owning thread. Completed events overwrite the oldest ones when full.
+/// A released slot keeps its events and is taken over by the next thread that starts tracing.
+typedef struct NlTraceThread {
+    const char* name;
+    atomic_bool isReleased;
+    atomic_size_t eventCount;
+    NlTraceEvent events[NL_TRACE_EVENT_CAPACITY];
+    const char* openNames[NL_TRACE_MAX_DEPTH];
+    NlClockMicros openStartedAt[NL_TRACE_MAX_DEPTH];
+    size_t depth;
+} NlTraceThread;
+
+static NlTraceThread g_traceThreads[NL_TRACE_MAX_THREADS];
+static atomic_size_t g_traceThreadCount;
+static NlClockMicros g_traceEpoch;
+static NL_THREAD_LOCAL NlTraceThread* t_traceThread;
+
+static NlTraceThread* traceThread(void)
+{
+    if (t_traceThread != 0) {
+        return t_traceThread;
+    }
+
+    // Restarted threads (e.g. the host thread of the next session) take over the slot of an exited one
+    size_t claimedCount = atomic_load(&g_traceThreadCount);
+    if (claimedCount > NL_TRACE_MAX_THREADS) {
+        claimedCount = NL_TRACE_MAX_THREADS;
+    }
+    for (size_t i = 0U; i < claimedCount; ++i) {
+        bool isReleased = true;
+        if (atomic_compare_exchange_strong(&g_traceThreads[i].isReleased, &isReleased, false)) {
+            t_traceThread = &g_traceThreads[i];
+            t_traceThread->name = "thread";
+            t_traceThread->depth = 0U;
+            return t_traceThread;
+        }
+    }
+
+    size_t index = atomic_fetch_add(&g_traceThreadCount, 1U);
+    if (index >= NL_TRACE_MAX_THREADS) {
+        return 0;
+    }
+
+    if (index == 0U) {
+        g_traceEpoch = nlClockNowMicros();
+    }
+
+    t_traceThread = &g_traceThreads[index];
+    t_traceThread->name = "thread";
+
+    return t_traceThread;
+}
+
+/// Gives the slot of the calling thread back, so a thread that is started later can use it.
+/// Called by nlThreadCreate() threads when they exit.
+void nlTraceReleaseThread(void)
+{
+    NlTraceThread* self = t_traceThread;
+    if (self == 0) {
+        return;
+    }
+    t_traceThread = 0;
+    atomic_store(&self->isReleased, true);
+}
+
+/// Names the calling thread in the trace output
+/// @param name thread name
+void nlTraceSetThreadName(const char* name)
+{
+    NlTraceThread* self = traceThread();
+    if (self == 0) {
+        return;
+    }
+    self->name = name;
+}
+
+/// Starts a zone on the calling thread. Must be paired with nlTraceEnd()
+/// @param name zone name
+void nlTraceBegin(const char* name)
+{
+    NlTraceThread* self = traceThread();
+    if (self == 0) {
+        return;
+    }
+
+    if (self->depth < NL_TRACE_MAX_DEPTH) {
+        self->openNames[self->depth] = name;
+        self->openStartedAt[self->depth] = nlClockNowMicros();
+    }
+    self->depth++;
+}
+
+void nlTraceEnd(void)
+{
+    NlTraceThread* self = t_traceThread;
+    if (self == 0 || self->depth == 0U) {
+        return;
+    }
+
+    self->depth--;
+    if (self->depth >= NL_TRACE_MAX_DEPTH) {
+        return;
+    }
+
+    NlClockMicros now = nlClockNowMicros();
+    size_t eventCount = atomic_load_explicit(&self->eventCount, memory_order_relaxed);
+    NlTraceEvent* event = &self->events[eventCount % NL_TRACE_EVENT_CAPACITY];
+    event->name = self->openNames[self->depth];
+    event->startedAt = self->openStartedAt[self->depth];
+    event->duration = (uint32_t) (now - event->startedAt);
+    event->depth = (uint32_t) self->depth;
+    atomic_store_explicit(&self->eventCount, eventCount + 1U, memory_order_release);
+}
+
+/// Writes the most recent events of all threads in the Chrome trace event format
+/// (load it in chrome://tracing or ui.perfetto.dev). Events that are overwritten by other
+/// threads while writing can come out garbled, so prefer calling it when other threads are idle.
+/// @param filename file to write
+/// @return negative on error
+int nlTraceWriteChromeJson(const char* filename)
+{
+    FILE* file = fopen(filename, "wb");
+    if (file == 0) {
+        return -1;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    size_t threadCount = atomic_load(&g_traceThreadCount);
+    if (threadCount > NL_TRACE_MAX_THREADS) {
+        threadCount = NL_TRACE_MAX_THREADS;
+    }
+
+    bool isFirst = true;
+    for (size_t threadIndex = 0U; threadIndex < threadCount; ++threadIndex) {
+        const NlTraceThread* thread = &g_traceThreads[threadIndex];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                isFirst ? "" : ",\n", threadIndex, thread->name);
+        isFirst = false;
+
+        size_t eventCount = atomic_load_explicit(&thread->eventCount, memory_order_acquire);
+        size_t first = eventCount > NL_TRACE_EVENT_CAPACITY ? eventCount - NL_TRACE_EVENT_CAPACITY : 0U;
+        for (size_t i = first; i < eventCount; ++i) {
+            const NlTraceEvent* event = &thread->events[i % NL_TRACE_EVENT_CAPACITY];
+            NlClockMicros timestamp = event->startedAt > g_traceEpoch ? event->startedAt - g_traceEpoch : 0U;
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%llu,\"dur\":%u}", event->name,
+                    threadIndex, (unsigned long long) timestamp, event->duration);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_TRACE_H
+#define NIMBLE_BALL_TRACE_H
+
+/// Scoped timing zones that are collected into a ring buffer for each thread and can be
+/// written as a Chrome / Perfetto trace file. Compiled out unless NL_TRACE_ENABLED is defined.
+/// Zone names must be string literals (or otherwise outlive the trace).
+
+#if defined NL_TRACE_ENABLED
+
+void nlTraceSetThreadName(const char* name);
+void nlTraceBegin(const char* name);
+void nlTraceEnd(void);
+void nlTraceReleaseThread(void);
+int nlTraceWriteChromeJson(const char* filename);
+
+#define NL_TRACE_THREAD_NAME(name) nlTraceSetThreadName(name);
+#define NL_TRACE_BEGIN(name) nlTraceBegin(name);
+#define NL_TRACE_END() nlTraceEnd();
+#define NL_TRACE_THREAD_EXIT() nlTraceReleaseThread();
+#define NL_TRACE_WRITE(filename) nlTraceWriteChromeJson(filename);
+
+#else
+
+#define NL_TRACE_THREAD_NAME(name)
+#define NL_TRACE_BEGIN(name)
+#define NL_TRACE_END()
+#define NL_TRACE_THREAD_EXIT()
+#define NL_TRACE_WRITE(filename)
+
+#endif
+
+#endif
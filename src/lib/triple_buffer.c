@@ -0,0 +1,65 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "triple_buffer.h"
+
+// The shared slot index lives in the lower bits, the upper bit tells the consumer that it is unread
+static const unsigned nlTripleBufferFreshBit = 0x4U;
+static const unsigned nlTripleBufferIndexMask = 0x3U;
+
+/// Initializes the triple buffer
+/// @param self triple buffer
+/// @param memory memory for three slots of slotOctetCount each
+/// @param slotOctetCount octet count for a single slot
+void nlTripleBufferInit(NlTripleBuffer* self, void* memory, size_t slotOctetCount)
+{
+    uint8_t* octets = (uint8_t*) memory;
+    for (size_t i = 0U; i < 3U; ++i) {
+        self->slots[i] = octets + i * slotOctetCount;
+    }
+    self->slotOctetCount = slotOctetCount;
+    self->writeIndex = 0U;
+    atomic_init(&self->shared, 1U);
+    self->readIndex = 2U;
+}
+
+/// Returns the slot that the producer can fill in. Only call from the producer.
+/// @param self triple buffer
+/// @return slot memory
+void* nlTripleBufferWriteSlot(NlTripleBuffer* self)
+{
+    return self->slots[self->writeIndex];
+}
+
+/// Publishes the slot returned from nlTripleBufferWriteSlot(). Only call from the producer.
+/// @param self triple buffer
+void nlTripleBufferPublish(NlTripleBuffer* self)
+{
+    unsigned previous = atomic_exchange_explicit(&self->shared, self->writeIndex | nlTripleBufferFreshBit,
+                                                 memory_order_acq_rel);
+    self->writeIndex = previous & nlTripleBufferIndexMask;
+}
+
+/// Takes ownership of the latest published slot, if there is a new one. Only call from the consumer.
+/// @param self triple buffer
+/// @return true if a new slot was published since the last call
+bool nlTripleBufferConsume(NlTripleBuffer* self)
+{
+    if ((atomic_load_explicit(&self->shared, memory_order_relaxed) & nlTripleBufferFreshBit) == 0U) {
+        return false;
+    }
+
+    unsigned previous = atomic_exchange_explicit(&self->shared, self->readIndex, memory_order_acq_rel);
+    self->readIndex = previous & nlTripleBufferIndexMask;
+
+    return true;
+}
+
+/// Returns the slot most recently consumed. Only call from the consumer.
+/// @param self triple buffer
+/// @return slot memory
+const void* nlTripleBufferReadSlot(const NlTripleBuffer* self)
+{
+    return self->slots[self->readIndex];
+}
@@ -0,0 +1,29 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_TRIPLE_BUFFER_H
+#define NIMBLE_BALL_TRIPLE_BUFFER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Lock-free single producer / single consumer mailbox that always hands the consumer the latest
+/// published slot. The producer never waits for the consumer and vice versa.
+typedef struct NlTripleBuffer {
+    uint8_t* slots[3];
+    size_t slotOctetCount;
+    atomic_uint shared;
+    unsigned writeIndex;
+    unsigned readIndex;
+} NlTripleBuffer;
+
+void nlTripleBufferInit(NlTripleBuffer* self, void* memory, size_t slotOctetCount);
+void* nlTripleBufferWriteSlot(NlTripleBuffer* self);
+void nlTripleBufferPublish(NlTripleBuffer* self);
+bool nlTripleBufferConsume(NlTripleBuffer* self);
+const void* nlTripleBufferReadSlot(const NlTripleBuffer* self);
+
+#endif
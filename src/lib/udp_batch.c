@@ -0,0 +1,351 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#if defined __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "udp_batch.h"
+#include "datagram_queue.h"
+#include <stdbool.h>
+#include <tiny-libc/tiny_libc.h>
+
+#if defined __linux__
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Twice the connection count, so the open addressing probes stay short
+#define NL_UDP_BATCH_LOOKUP_SIZE (NL_UDP_BATCH_MAX_CONNECTIONS * 2)
+
+typedef struct NlUdpBatchRing {
+    uint8_t octets[NL_UDP_BATCH_MAX_COUNT][NL_DATAGRAM_MAX_OCTET_COUNT];
+    struct sockaddr_in addresses[NL_UDP_BATCH_MAX_COUNT];
+    struct iovec vectors[NL_UDP_BATCH_MAX_COUNT];
+    struct mmsghdr headers[NL_UDP_BATCH_MAX_COUNT];
+    size_t count;
+    size_t readIndex;
+} NlUdpBatchRing;
+
+typedef struct NlUdpBatchBuffers {
+    NlUdpBatchRing receive;
+    NlUdpBatchRing send;
+    struct sockaddr_in connectionAddresses[NL_UDP_BATCH_MAX_CONNECTIONS];
+    bool isConnected[NL_UDP_BATCH_MAX_CONNECTIONS];
+    int freeConnectionIds[NL_UDP_BATCH_MAX_CONNECTIONS];
+    size_t freeConnectionIdCount;
+    int lookup[NL_UDP_BATCH_LOOKUP_SIZE];
+} NlUdpBatchBuffers;
+
+static void ringInit(NlUdpBatchRing* self)
+{
+    for (size_t i = 0U; i < NL_UDP_BATCH_MAX_COUNT; ++i) {
+        self->vectors[i].iov_base = self->octets[i];
+        self->vectors[i].iov_len = NL_DATAGRAM_MAX_OCTET_COUNT;
+        tc_mem_clear_type(&self->headers[i]);
+        self->headers[i].msg_hdr.msg_iov = &self->vectors[i];
+        self->headers[i].msg_hdr.msg_iovlen = 1;
+        self->headers[i].msg_hdr.msg_name = &self->addresses[i];
+        self->headers[i].msg_hdr.msg_namelen = sizeof(self->addresses[i]);
+    }
+    self->count = 0U;
+    self->readIndex = 0U;
+}
+
+static size_t addressSlot(const struct sockaddr_in* address)
+{
+    uint32_t hash = (uint32_t) address->sin_addr.s_addr * 0x9e3779b1U ^ (uint32_t) address->sin_port * 0x85ebca77U;
+    return (size_t) (hash % NL_UDP_BATCH_LOOKUP_SIZE);
+}
+
+static int isSameAddress(const struct sockaddr_in* a, const struct sockaddr_in* b)
+{
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/// Finds the lookup slot of a remote address, or the empty slot where it would be added
+static size_t findSlot(const NlUdpBatchBuffers* buffers, const struct sockaddr_in* address)
+{
+    size_t slot = addressSlot(address);
+    while (buffers->lookup[slot] >= 0) {
+        if (isSameAddress(&buffers->connectionAddresses[buffers->lookup[slot]], address)) {
+            return slot;
+        }
+        slot = (slot + 1U) % NL_UDP_BATCH_LOOKUP_SIZE;
+    }
+    return slot;
+}
+
+/// Finds the connection id for a remote address, assigning a free one to a new address.
+/// Released ids are used first, so the ids stay below NL_UDP_BATCH_MAX_CONNECTIONS.
+/// @return connection id or negative if there are no free connection ids
+static int findOrAddConnection(NlUdpBatchSocket* self, const struct sockaddr_in* address)
+{
+    NlUdpBatchBuffers* buffers = self->buffers;
+    size_t slot = findSlot(buffers, address);
+    if (buffers->lookup[slot] >= 0) {
+        return buffers->lookup[slot];
+    }
+
+    int connectionId;
+    if (buffers->freeConnectionIdCount > 0U) {
+        connectionId = buffers->freeConnectionIds[--buffers->freeConnectionIdCount];
+    } else if (self->usedConnectionIdCount < NL_UDP_BATCH_MAX_CONNECTIONS) {
+        connectionId = (int) self->usedConnectionIdCount++;
+    } else {
+        return -1;
+    }
+
+    self->connectionCount++;
+    buffers->connectionAddresses[connectionId] = *address;
+    buffers->isConnected[connectionId] = true;
+    buffers->lookup[slot] = connectionId;
+
+    char addressString[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address->sin_addr, addressString, sizeof(addressString));
+    CLOG_C_DEBUG(&self->log, "new connection %d from %s:%d", connectionId, addressString, ntohs(address->sin_port))
+
+    return connectionId;
+}
+
+/// Drains up to a full batch from the socket with a single system call
+static int receiveBatch(NlUdpBatchSocket* self)
+{
+    NlUdpBatchRing* ring = &self->buffers->receive;
+    for (size_t i = 0U; i < self->batchCount; ++i) {
+        ring->headers[i].msg_hdr.msg_namelen = sizeof(ring->addresses[i]);
+    }
+
+    int count = recvmmsg(self->handle, ring->headers, (unsigned int) self->batchCount, MSG_DONTWAIT, 0);
+    self->receiveCallCount++;
+    if (count < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        CLOG_C_WARN(&self->log, "recvmmsg failed %d", errno)
+        return -1;
+    }
+
+    ring->count = (size_t) count;
+    ring->readIndex = 0U;
+    self->receivedDatagramCount += (size_t) count;
+
+    return count;
+}
+
+static int udpBatchReceiveFrom(void* _self, int* connectionId, uint8_t* data, size_t size)
+{
+    NlUdpBatchSocket* self = (NlUdpBatchSocket*) _self;
+    NlUdpBatchRing* ring = &self->buffers->receive;
+
+    while (true) {
+        if (ring->readIndex == ring->count) {
+            int result = receiveBatch(self);
+            if (result <= 0) {
+                return result;
+            }
+        }
+
+        size_t index = ring->readIndex++;
+        size_t octetCount = ring->headers[index].msg_len;
+        int foundConnectionId = findOrAddConnection(self, &ring->addresses[index]);
+        if (foundConnectionId < 0 || octetCount > size || (ring->headers[index].msg_hdr.msg_flags & MSG_TRUNC)) {
+            self->droppedDatagramCount++;
+            continue;
+        }
+
+        *connectionId = foundConnectionId;
+        tc_memcpy_octets(data, ring->octets[index], octetCount);
+
+        return (int) octetCount;
+    }
+}
+
+static int udpBatchSendTo(void* _self, int connectionId, const uint8_t* data, size_t size)
+{
+    NlUdpBatchSocket* self = (NlUdpBatchSocket*) _self;
+    NlUdpBatchRing* ring = &self->buffers->send;
+
+    if (connectionId < 0 || connectionId >= NL_UDP_BATCH_MAX_CONNECTIONS || !self->buffers->isConnected[connectionId] ||
+        size > NL_DATAGRAM_MAX_OCTET_COUNT) {
+        self->droppedDatagramCount++;
+        return -1;
+    }
+
+    if (ring->count == self->batchCount) {
+        nlUdpBatchSocketFlush(self);
+    }
+
+    size_t index = ring->count++;
+    tc_memcpy_octets(ring->octets[index], data, size);
+    ring->vectors[index].iov_len = size;
+    ring->addresses[index] = self->buffers->connectionAddresses[connectionId];
+
+    return 0;
+}
+
+/// Opens a non-blocking UDP socket on all interfaces
+/// @param self batch socket
+/// @param port port to listen on
+/// @param batchCount maximum number of datagrams for each system call, at most NL_UDP_BATCH_MAX_COUNT
+/// @param log log
+/// @return negative on error
+int nlUdpBatchSocketInit(NlUdpBatchSocket* self, uint16_t port, size_t batchCount, Clog log)
+{
+    self->log = log;
+    self->batchCount = batchCount > NL_UDP_BATCH_MAX_COUNT ? NL_UDP_BATCH_MAX_COUNT : batchCount;
+    self->connectionCount = 0U;
+    self->usedConnectionIdCount = 0U;
+    self->releasedConnectionCount = 0U;
+    self->receiveCallCount = 0U;
+    self->receivedDatagramCount = 0U;
+    self->sendCallCount = 0U;
+    self->sentDatagramCount = 0U;
+    self->droppedDatagramCount = 0U;
+    self->buffers = 0;
+
+    self->handle = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+    if (self->handle < 0) {
+        CLOG_C_ERROR(&self->log, "could not create socket %d", errno)
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    tc_mem_clear_type(&address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(self->handle, (const struct sockaddr*) &address, sizeof(address)) < 0) {
+        CLOG_C_ERROR(&self->log, "could not bind to port %d %d", port, errno)
+        close(self->handle);
+        return -2;
+    }
+
+    self->buffers = (NlUdpBatchBuffers*) tc_malloc(sizeof(NlUdpBatchBuffers));
+    ringInit(&self->buffers->receive);
+    ringInit(&self->buffers->send);
+    for (size_t i = 0U; i < NL_UDP_BATCH_LOOKUP_SIZE; ++i) {
+        self->buffers->lookup[i] = -1;
+    }
+    for (size_t i = 0U; i < NL_UDP_BATCH_MAX_CONNECTIONS; ++i) {
+        self->buffers->isConnected[i] = false;
+    }
+    self->buffers->freeConnectionIdCount = 0U;
+
+    self->multiTransport.self = self;
+    self->multiTransport.receiveFrom = udpBatchReceiveFrom;
+    self->multiTransport.sendTo = udpBatchSendTo;
+
+    return 0;
+}
+
+/// Sends all collected datagrams, a full batch for each system call
+/// @param self batch socket
+/// @return negative on error
+int nlUdpBatchSocketFlush(NlUdpBatchSocket* self)
+{
+    NlUdpBatchRing* ring = &self->buffers->send;
+    int result = 0;
+
+    while (ring->readIndex < ring->count) {
+        size_t pendingCount = ring->count - ring->readIndex;
+        int sentCount = sendmmsg(self->handle, &ring->headers[ring->readIndex], (unsigned int) pendingCount, 0);
+        self->sendCallCount++;
+        if (sentCount <= 0) {
+            // Same as a full socket buffer, the protocol above handles lost datagrams
+            CLOG_C_NOTICE(&self->log, "sendmmsg failed %d, dropping %zu datagrams", errno, pendingCount)
+            self->droppedDatagramCount += pendingCount;
+            result = -1;
+            break;
+        }
+        ring->readIndex += (size_t) sentCount;
+        self->sentDatagramCount += (size_t) sentCount;
+    }
+
+    for (size_t i = 0U; i < ring->count; ++i) {
+        ring->vectors[i].iov_len = NL_DATAGRAM_MAX_OCTET_COUNT;
+    }
+    ring->count = 0U;
+    ring->readIndex = 0U;
+
+    return result;
+}
+
+/// Forgets the remote address of a connection and makes the connection id free for the next new address.
+/// Datagrams from the same address that arrive later are treated as a new connection.
+/// @param self batch socket
+/// @param connectionId connection id
+void nlUdpBatchSocketReleaseConnection(NlUdpBatchSocket* self, int connectionId)
+{
+    NlUdpBatchBuffers* buffers = self->buffers;
+    if (connectionId < 0 || connectionId >= NL_UDP_BATCH_MAX_CONNECTIONS || !buffers->isConnected[connectionId]) {
+        return;
+    }
+
+    // Backward shift deletion, moves the following entries of the probe sequence into the hole
+    // so lookups never need tombstones
+    size_t hole = findSlot(buffers, &buffers->connectionAddresses[connectionId]);
+    size_t slot = (hole + 1U) % NL_UDP_BATCH_LOOKUP_SIZE;
+    while (buffers->lookup[slot] >= 0) {
+        size_t home = addressSlot(&buffers->connectionAddresses[buffers->lookup[slot]]);
+        size_t distanceFromHome = (slot + NL_UDP_BATCH_LOOKUP_SIZE - home) % NL_UDP_BATCH_LOOKUP_SIZE;
+        size_t distanceFromHole = (slot + NL_UDP_BATCH_LOOKUP_SIZE - hole) % NL_UDP_BATCH_LOOKUP_SIZE;
+        if (distanceFromHome >= distanceFromHole) {
+            buffers->lookup[hole] = buffers->lookup[slot];
+            hole = slot;
+        }
+        slot = (slot + 1U) % NL_UDP_BATCH_LOOKUP_SIZE;
+    }
+    buffers->lookup[hole] = -1;
+
+    buffers->isConnected[connectionId] = false;
+    buffers->freeConnectionIds[buffers->freeConnectionIdCount++] = connectionId;
+    self->connectionCount--;
+    self->releasedConnectionCount++;
+}
+
+void nlUdpBatchSocketDestroy(NlUdpBatchSocket* self)
+{
+    if (self->buffers == 0) {
+        return;
+    }
+
+    nlUdpBatchSocketFlush(self);
+    close(self->handle);
+    tc_free(self->buffers);
+    self->buffers = 0;
+}
+
+#else
+
+int nlUdpBatchSocketInit(NlUdpBatchSocket* self, uint16_t port, size_t batchCount, Clog log)
+{
+    (void) port;
+    (void) batchCount;
+    self->log = log;
+    self->buffers = 0;
+    CLOG_C_ERROR(&self->log, "batched datagram I/O is only supported on Linux")
+    return -1;
+}
+
+int nlUdpBatchSocketFlush(NlUdpBatchSocket* self)
+{
+    (void) self;
+    return 0;
+}
+
+void nlUdpBatchSocketReleaseConnection(NlUdpBatchSocket* self, int connectionId)
+{
+    (void) self;
+    (void) connectionId;
+}
+
+void nlUdpBatchSocketDestroy(NlUdpBatchSocket* self)
+{
+    (void) self;
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_UDP_BATCH_H
+#define NIMBLE_BALL_UDP_BATCH_H
+
+#include <clog/clog.h>
+#include <datagram-transport/multi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_UDP_BATCH_MAX_COUNT (64)
+#define NL_UDP_BATCH_MAX_CONNECTIONS (1024)
+
+struct NlUdpBatchBuffers;
+
+/// Listening UDP socket that receives and sends up to `batchCount` datagrams for each system call
+/// (`recvmmsg`/`sendmmsg`). Received datagrams are drained into a preallocated ring, and sent datagrams
+/// are collected until the ring is full or the socket is flushed. Each new remote address is given a free
+/// connection id, which is returned when the connection is released. Only supported on Linux.
+typedef struct NlUdpBatchSocket {
+    int handle;
+    size_t batchCount;
+    struct NlUdpBatchBuffers* buffers;
+    size_t connectionCount;
+    size_t usedConnectionIdCount;
+    size_t releasedConnectionCount;
+    size_t receiveCallCount;
+    size_t receivedDatagramCount;
+    size_t sendCallCount;
+    size_t sentDatagramCount;
+    size_t droppedDatagramCount;
+    DatagramTransportMulti multiTransport;
+    Clog log;
+} NlUdpBatchSocket;
+
+int nlUdpBatchSocketInit(NlUdpBatchSocket* self, uint16_t port, size_t batchCount, Clog log);
+int nlUdpBatchSocketFlush(NlUdpBatchSocket* self);
+void nlUdpBatchSocketReleaseConnection(NlUdpBatchSocket* self, int connectionId);
+void nlUdpBatchSocketDestroy(NlUdpBatchSocket* self);
+
+#endif
@@ -0,0 +1,157 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "worker_pool.h"
+#include "trace.h"
+#include <clog/clog.h>
+
+static size_t runJobsFromQueue(NlWorkerPool* self, NlWorkerQueue* queue)
+{
+    size_t runCount = 0U;
+    size_t jobIndex;
+    while ((jobIndex = atomic_fetch_add_explicit(&queue->next, 1U, memory_order_relaxed)) < queue->end) {
+        self->jobFn(self->context, jobIndex);
+        runCount++;
+    }
+    return runCount;
+}
+
+/// Runs the jobs of the own queue first and then steals from the others, starting with the neighbour
+static void runBatch(NlWorker* worker)
+{
+    NlWorkerPool* self = worker->pool;
+
+    worker->runJobCount += runJobsFromQueue(self, &self->queues[worker->index]);
+    for (size_t i = 1U; i < self->workerCount; ++i) {
+        size_t victim = (worker->index + i) % self->workerCount;
+        size_t stolenCount = runJobsFromQueue(self, &self->queues[victim]);
+        worker->runJobCount += stolenCount;
+        worker->stolenJobCount += stolenCount;
+    }
+
+    if (atomic_fetch_sub_explicit(&self->busyWorkerCount, 1U, memory_order_acq_rel) == 1U) {
+        // Signaled with the mutex held, so the calling thread can not miss it between its check and its wait
+        nlMutexLock(&self->mutex);
+        nlConditionSignalAll(&self->batchDone);
+        nlMutexUnlock(&self->mutex);
+    }
+}
+
+static void workerRun(void* _self)
+{
+    NlWorker* worker = (NlWorker*) _self;
+    NlWorkerPool* self = worker->pool;
+
+    NL_TRACE_THREAD_NAME("worker")
+
+    size_t seenGeneration = 0U;
+    while (true) {
+        nlMutexLock(&self->mutex);
+        while (atomic_load_explicit(&self->generation, memory_order_acquire) == seenGeneration) {
+            nlConditionWait(&self->batchStarted, &self->mutex);
+        }
+        seenGeneration = atomic_load_explicit(&self->generation, memory_order_acquire);
+        nlMutexUnlock(&self->mutex);
+
+        if (!atomic_load_explicit(&self->isRunning, memory_order_acquire)) {
+            break;
+        }
+
+        NL_TRACE_BEGIN("workerBatch")
+        runBatch(worker);
+        NL_TRACE_END()
+    }
+}
+
+/// Starts the worker threads
+/// @param self worker pool
+/// @param workerCount number of workers including the calling thread
+/// @return negative on error
+int nlWorkerPoolInit(NlWorkerPool* self, size_t workerCount)
+{
+    if (workerCount == 0U || workerCount > NL_WORKER_POOL_MAX_WORKERS) {
+        return -1;
+    }
+
+    self->workerCount = workerCount;
+    self->jobFn = 0;
+    self->context = 0;
+    atomic_init(&self->generation, 0U);
+    atomic_init(&self->busyWorkerCount, 0U);
+    atomic_init(&self->isRunning, true);
+    nlMutexInit(&self->mutex);
+    nlConditionInit(&self->batchStarted);
+    nlConditionInit(&self->batchDone);
+
+    for (size_t i = 0U; i < workerCount; ++i) {
+        NlWorker* worker = &self->workers[i];
+        worker->pool = self;
+        worker->index = i;
+        worker->runJobCount = 0U;
+        worker->stolenJobCount = 0U;
+        atomic_init(&self->queues[i].next, 0U);
+        self->queues[i].end = 0U;
+    }
+
+    for (size_t i = 1U; i < workerCount; ++i) {
+        if (nlThreadCreate(&self->workers[i].thread, workerRun, &self->workers[i]) < 0) {
+            CLOG_WARN("could not start worker thread %zu", i)
+            self->workerCount = i;
+            nlWorkerPoolDestroy(self);
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+/// Runs jobFn once for every job index and returns when all of them are done.
+/// The jobs are split evenly over the workers, a worker that runs out of jobs steals from the others.
+/// @param self worker pool
+/// @param jobCount number of jobs
+/// @param jobFn called with each job index, from any of the worker threads
+/// @param context passed to jobFn
+void nlWorkerPoolRun(NlWorkerPool* self, size_t jobCount, NlWorkerPoolJobFn jobFn, void* context)
+{
+    self->jobFn = jobFn;
+    self->context = context;
+    for (size_t i = 0U; i < self->workerCount; ++i) {
+        atomic_store_explicit(&self->queues[i].next, i * jobCount / self->workerCount, memory_order_relaxed);
+        self->queues[i].end = (i + 1U) * jobCount / self->workerCount;
+    }
+    atomic_store_explicit(&self->busyWorkerCount, self->workerCount, memory_order_relaxed);
+
+    nlMutexLock(&self->mutex);
+    atomic_fetch_add_explicit(&self->generation, 1U, memory_order_release);
+    nlConditionSignalAll(&self->batchStarted);
+    nlMutexUnlock(&self->mutex);
+
+    runBatch(&self->workers[0]);
+
+    // Workers that are still scanning for work to steal must be done before the queues can be reused
+    nlMutexLock(&self->mutex);
+    while (atomic_load_explicit(&self->busyWorkerCount, memory_order_acquire) > 0U) {
+        nlConditionWait(&self->batchDone, &self->mutex);
+    }
+    nlMutexUnlock(&self->mutex);
+}
+
+/// Stops and joins all worker threads
+/// @param self worker pool
+void nlWorkerPoolDestroy(NlWorkerPool* self)
+{
+    nlMutexLock(&self->mutex);
+    atomic_store_explicit(&self->isRunning, false, memory_order_release);
+    atomic_fetch_add_explicit(&self->generation, 1U, memory_order_release);
+    nlConditionSignalAll(&self->batchStarted);
+    nlMutexUnlock(&self->mutex);
+
+    for (size_t i = 1U; i < self->workerCount; ++i) {
+        nlThreadJoin(&self->workers[i].thread);
+    }
+
+    nlConditionDestroy(&self->batchDone);
+    nlConditionDestroy(&self->batchStarted);
+    nlMutexDestroy(&self->mutex);
+}
@@ -0,0 +1,55 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef NIMBLE_BALL_WORKER_POOL_H
+#define NIMBLE_BALL_WORKER_POOL_H
+
+#include "thread.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define NL_WORKER_POOL_MAX_WORKERS (32)
+
+typedef void (*NlWorkerPoolJobFn)(void* context, size_t jobIndex);
+
+/// The range of job indices that a worker starts out with. Other workers steal from it by taking
+/// indices from the same cursor, so a job is never run twice.
+typedef struct NlWorkerQueue {
+    _Alignas(64) atomic_size_t next;
+    size_t end;
+} NlWorkerQueue;
+
+struct NlWorkerPool;
+
+typedef struct NlWorker {
+    NlThread thread;
+    struct NlWorkerPool* pool;
+    size_t index;
+    size_t runJobCount;
+    size_t stolenJobCount;
+} NlWorker;
+
+/// Runs batches of independent jobs on a fixed set of threads. The calling thread is worker zero.
+/// Idle workers sleep on a condition until the generation changes, the last worker to finish a batch wakes up
+/// the calling thread.
+typedef struct NlWorkerPool {
+    NlWorker workers[NL_WORKER_POOL_MAX_WORKERS];
+    NlWorkerQueue queues[NL_WORKER_POOL_MAX_WORKERS];
+    size_t workerCount;
+    NlWorkerPoolJobFn jobFn;
+    void* context;
+    NlMutex mutex;
+    NlCondition batchStarted;
+    NlCondition batchDone;
+    atomic_size_t generation;
+    atomic_size_t busyWorkerCount;
+    atomic_bool isRunning;
+} NlWorkerPool;
+
+int nlWorkerPoolInit(NlWorkerPool* self, size_t workerCount);
+void nlWorkerPoolRun(NlWorkerPool* self, size_t jobCount, NlWorkerPoolJobFn jobFn, void* context);
+void nlWorkerPoolDestroy(NlWorkerPool* self);
+
+#endif
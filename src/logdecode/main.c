@@ -0,0 +1,76 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "async_log.h"
+#include <stdio.h>
+#include <string.h>
+
+clog_config g_clog;
+
+char g_clog_temp_str[CLOG_TEMP_STR_SIZE];
+
+static const char* typeName(uint8_t type)
+{
+    static const char* names[] = {"VERBOSE", "DEBUG", "INFO", "NOTICE", "WARN", "ERROR", "FATAL"};
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+/// Prints the records of a binary log as text, with the time in milliseconds since the first record
+/// @param file binary log, positioned after the magic
+/// @return number of records
+static size_t decode(FILE* file)
+{
+    char prefix[256];
+    char text[65536];
+    uint64_t firstTime = 0U;
+    size_t recordCount = 0U;
+
+    NlAsyncLogRecordHeader header;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (fread(prefix, 1, header.prefixOctetCount, file) != header.prefixOctetCount ||
+            fread(text, 1, header.textOctetCount, file) != header.textOctetCount) {
+            fprintf(stderr, "truncated record after %zu records\n", recordCount);
+            break;
+        }
+        prefix[header.prefixOctetCount] = 0;
+        text[header.textOctetCount] = 0;
+
+        if (recordCount == 0U) {
+            firstTime = header.time;
+        }
+        recordCount++;
+
+        printf("%10.3f %-7s #%d %s: %s\n", (double) (header.time - firstTime) / 1000.0, typeName(header.type),
+               header.threadIndex, prefix, text);
+    }
+
+    return recordCount;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: nimble-ball-log-decode <log file>\n");
+        return -1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == 0) {
+        fprintf(stderr, "could not read '%s'\n", argv[1]);
+        return -1;
+    }
+
+    char magic[NL_ASYNC_LOG_MAGIC_OCTET_COUNT];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, NL_ASYNC_LOG_MAGIC, NL_ASYNC_LOG_MAGIC_OCTET_COUNT) != 0) {
+        fprintf(stderr, "'%s' is not a nimble ball log\n", argv[1]);
+        fclose(file);
+        return -2;
+    }
+
+    decode(file);
+    fclose(file);
+
+    return 0;
+}
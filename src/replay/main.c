@@ -0,0 +1,195 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "clock.h"
+#include "recording.h"
+#include "state_delta.h"
+#include "state_hash.h"
+#include <clog/console.h>
+#include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+clog_config g_clog;
+
+char g_clog_temp_str[CLOG_TEMP_STR_SIZE];
+
+typedef struct NlReplayResult {
+    size_t tickCount;
+    size_t stateCount;
+    size_t verifiedHashCount;
+    size_t mismatchedHashCount;
+    size_t badRecordCount;
+    NlClockMicros duration;
+} NlReplayResult;
+
+static uint8_t* loadFile(const char* filename, size_t* outOctetCount)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == 0) {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(file);
+        return 0;
+    }
+
+    uint8_t* octets = (uint8_t*) malloc((size_t) size);
+    size_t readOctetCount = fread(octets, 1, (size_t) size, file);
+    fclose(file);
+    if (readOctetCount != (size_t) size) {
+        free(octets);
+        return 0;
+    }
+
+    *outOctetCount = readOctetCount;
+
+    return octets;
+}
+
+/// Feeds all the authoritative steps in the recording through the simulation as fast as possible
+/// @param vm simulation
+/// @param octets complete recording
+/// @param octetCount octet count of the recording
+/// @param result statistics and verification results
+/// @return negative on error
+static int replay(NlSimulationVm* vm, const uint8_t* octets, size_t octetCount, NlReplayResult* result)
+{
+    NlRecordingReader reader;
+    if (nlRecordingReaderInit(&reader, octets, octetCount) < 0) {
+        CLOG_WARN("not a supported recording")
+        return -1;
+    }
+
+    TransmuteVmVersion version = vm->transmuteVm.version;
+    if (reader.header.stateOctetCount != sizeof(NlGame) || reader.header.version.major != version.major ||
+        reader.header.version.minor != version.minor || reader.header.version.patch != version.patch) {
+        CLOG_WARN("recording was made with simulation %d.%d.%d", reader.header.version.major,
+                  reader.header.version.minor, reader.header.version.patch)
+        return -2;
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    // States are recorded as deltas against the previous state, starting from the default game
+    static NlGame baseline;
+    static NlGame decoded;
+    nlGameInit(&baseline);
+
+    TransmuteParticipantInput participantInputs[NL_RECORDING_MAX_PARTICIPANT_INPUTS];
+    NlClockMicros startedAt = nlClockNowMicros();
+    NlRecord record;
+    int readResult;
+    while ((readResult = nlRecordingReaderNext(&reader, &record)) > 0) {
+        switch (record.type) {
+            case NlRecordTypeState: {
+                if (record.payloadOctetCount != sizeof(NlGame)) {
+                    return -4;
+                }
+                tc_memcpy_octets(&baseline, record.payload, sizeof(NlGame));
+                TransmuteState state;
+                state.state = &baseline;
+                state.octetSize = sizeof(NlGame);
+                transmuteVmSetState(&vm->transmuteVm, &state);
+                result->stateCount++;
+            } break;
+            case NlRecordTypeStateDelta: {
+                if (nlStateDeltaDecode((const uint8_t*) &baseline, record.payload, record.payloadOctetCount,
+                                       (uint8_t*) &decoded, sizeof(NlGame)) < 0) {
+                    return -5;
+                }
+                baseline = decoded;
+                TransmuteState state;
+                state.state = &baseline;
+                state.octetSize = sizeof(NlGame);
+                transmuteVmSetState(&vm->transmuteVm, &state);
+                result->stateCount++;
+            } break;
+            case NlRecordTypeAuthoritativeStep: {
+                TransmuteInput input;
+                if (nlRecordReadInput(&record, &input, participantInputs, NL_RECORDING_MAX_PARTICIPANT_INPUTS) < 0) {
+                    return -3;
+                }
+                transmuteVmTick(&vm->transmuteVm, &input);
+                result->tickCount++;
+            } break;
+            case NlRecordTypeStateHash: {
+                uint64_t recordedHash;
+                if (nlRecordReadStateHash(&record, &recordedHash) < 0) {
+                    result->badRecordCount++;
+                    CLOG_WARN("state hash record after %zu ticks is too short", result->tickCount)
+                    break;
+                }
+                TransmuteState state = transmuteVmGetState(&vm->transmuteVm);
+                if (nlRecordingReaderStateHash(&reader, state.state, state.octetSize) == recordedHash) {
+                    result->verifiedHashCount++;
+                } else {
+                    result->mismatchedHashCount++;
+                    CLOG_WARN("state hash mismatch after %zu ticks", result->tickCount)
+                }
+            } break;
+            case NlRecordTypePredictedInput:
+                break;
+        }
+    }
+    result->duration = nlClockNowMicros() - startedAt;
+
+    return readResult;
+}
+
+int main(int argc, char* argv[])
+{
+    g_clog.log = clog_console;
+    g_clog.level = CLOG_TYPE_WARN;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: nimble-ball-replay <recording> [repeat count]\n");
+        return -1;
+    }
+
+    size_t octetCount;
+    uint8_t* octets = loadFile(argv[1], &octetCount);
+    if (octets == 0) {
+        fprintf(stderr, "could not read '%s'\n", argv[1]);
+        return -1;
+    }
+
+    long repeatCount = argc > 2 ? strtol(argv[2], 0, 10) : 1;
+    if (repeatCount < 1) {
+        repeatCount = 1;
+    }
+
+    Clog vmLog;
+    vmLog.constantPrefix = "Replay";
+    vmLog.config = &g_clog;
+
+    NlReplayResult result;
+    NlClockMicros bestDuration = (NlClockMicros) -1;
+    for (long i = 0; i < repeatCount; ++i) {
+        NlSimulationVm vm;
+        nlSimulationVmInit(&vm, vmLog);
+        if (replay(&vm, octets, octetCount, &result) < 0) {
+            free(octets);
+            return -2;
+        }
+        if (result.duration < bestDuration) {
+            bestDuration = result.duration;
+        }
+    }
+
+    double seconds = (double) bestDuration / 1000000.0;
+    printf("ticks:%zu states:%zu best:%.3f ms ticks/s:%.0f hashes verified:%zu mismatched:%zu bad records:%zu\n",
+           result.tickCount, result.stateCount, (double) bestDuration / 1000.0,
+           seconds > 0.0 ? (double) result.tickCount / seconds : 0.0, result.verifiedHashCount,
+           result.mismatchedHashCount, result.badRecordCount);
+
+    free(octets);
+
+    return result.mismatchedHashCount > 0U || result.badRecordCount > 0U ? 1 : 0;
+}
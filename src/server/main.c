@@ -0,0 +1,243 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include "metrics.h"
+#include "room_server.h"
+#include "tick_scheduler.h"
+#include <clog/console.h>
+#include <nimble-ball-simulation/nimble_ball_simulation_vm.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+clog_config g_clog;
+
+char g_clog_temp_str[CLOG_TEMP_STR_SIZE];
+
+static volatile sig_atomic_t g_wantsToQuit;
+
+static void onSignal(int signal)
+{
+    (void) signal;
+    g_wantsToQuit = 1;
+}
+
+typedef struct NlServerMetrics {
+    NlMetrics metrics;
+    NlMetricsEndpoint endpoint;
+    size_t roomCount;
+    size_t connectionCount;
+    size_t routedDatagrams;
+    size_t droppedDatagrams;
+    size_t sentDatagrams;
+    size_t sentOctets;
+} NlServerMetrics;
+
+static int serverMetricsInit(NlServerMetrics* self, const char* path)
+{
+    NlMetrics* metrics = &self->metrics;
+    nlMetricsInit(metrics);
+    self->roomCount = nlMetricsRegister(metrics, "nimble_ball_server_rooms", "Hosted rooms", NlMetricTypeGauge);
+    self->connectionCount = nlMetricsRegister(metrics, "nimble_ball_server_connections",
+                                              "Connections assigned to a room", NlMetricTypeGauge);
+    self->routedDatagrams = nlMetricsRegister(metrics, "nimble_ball_server_routed_datagrams_total",
+                                              "Received datagrams routed to a room", NlMetricTypeCounter);
+    self->droppedDatagrams = nlMetricsRegister(metrics, "nimble_ball_server_dropped_datagrams_total",
+                                               "Received datagrams that could not be routed", NlMetricTypeCounter);
+    self->sentDatagrams = nlMetricsRegister(metrics, "nimble_ball_server_sent_datagrams_total", "Sent datagrams",
+                                            NlMetricTypeCounter);
+    self->sentOctets = nlMetricsRegister(metrics, "nimble_ball_server_sent_octets_total", "Sent datagram octets",
+                                         NlMetricTypeCounter);
+
+    Clog log;
+    log.config = &g_clog;
+    log.constantPrefix = "Metrics";
+
+    return nlMetricsEndpointInit(&self->endpoint, path, log);
+}
+
+static void serverMetricsUpdate(NlServerMetrics* self, const NlRoomServer* roomServer)
+{
+    size_t connectionCount = nlRoomServerActiveConnectionCount(roomServer);
+
+    NlMetrics* metrics = &self->metrics;
+    nlMetricsSet(metrics, self->roomCount, (int64_t) roomServer->roomCount);
+    nlMetricsSet(metrics, self->connectionCount, (int64_t) connectionCount);
+    nlMetricsSet(metrics, self->routedDatagrams, (int64_t) roomServer->routedDatagramCount);
+    nlMetricsSet(metrics, self->droppedDatagrams, (int64_t) roomServer->droppedDatagramCount);
+    nlMetricsSet(metrics, self->sentDatagrams, (int64_t) roomServer->sentDatagramCount);
+    nlMetricsSet(metrics, self->sentOctets, (int64_t) roomServer->sentOctetCount);
+
+    nlMetricsEndpointUpdate(&self->endpoint, metrics);
+}
+
+typedef struct NlServerOptions {
+    uint16_t port;
+    size_t maxConnectionCount;
+    size_t maxParticipantCount;
+    size_t tickRate;
+    size_t memoryMiB;
+    size_t roomCount;
+    size_t workerCount;
+    size_t datagramBatchCount;
+    size_t idleTimeoutMs;
+    const char* metricsSocketPath;
+    const char* impairmentFilename;
+    uint32_t impairmentSeed;
+} NlServerOptions;
+
+static void printUsage(void)
+{
+    fprintf(stderr, "usage: nimble-ball-server [--port <port>] [--max-connections <count>] "
+                    "[--max-participants <count>] [--tick-rate <hz>] [--memory <MiB>] [--rooms <count>] "
+                    "[--workers <count>] [--io-batch <count>] [--idle-timeout-ms <ms>] [--metrics-socket <path>] "
+                    "[--impairment <filename>] [--impairment-seed <seed>]\n");
+}
+
+static int parseOptions(NlServerOptions* options, int argc, char* argv[])
+{
+    options->port = 27003U;
+    options->maxConnectionCount = 4U;
+    options->maxParticipantCount = 8U;
+    options->tickRate = 62U;
+    options->memoryMiB = 5U;
+    options->roomCount = 1U;
+    options->workerCount = 1U;
+    options->datagramBatchCount = 1U;
+    options->idleTimeoutMs = 10000U;
+    options->metricsSocketPath = 0;
+    options->impairmentFilename = 0;
+    options->impairmentSeed = 1U;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* name = argv[i];
+        if (i + 1 >= argc) {
+            return -1;
+        }
+        if (strcmp(name, "--metrics-socket") == 0) {
+            options->metricsSocketPath = argv[++i];
+            continue;
+        }
+        if (strcmp(name, "--impairment") == 0) {
+            options->impairmentFilename = argv[++i];
+            continue;
+        }
+        long value = strtol(argv[++i], 0, 10);
+        if (value <= 0) {
+            return -2;
+        }
+
+        if (strcmp(name, "--port") == 0 && value <= 0xffff) {
+            options->port = (uint16_t) value;
+        } else if (strcmp(name, "--max-connections") == 0) {
+            options->maxConnectionCount = (size_t) value;
+        } else if (strcmp(name, "--max-participants") == 0) {
+            options->maxParticipantCount = (size_t) value;
+        } else if (strcmp(name, "--tick-rate") == 0 && value <= 1000) {
+            options->tickRate = (size_t) value;
+        } else if (strcmp(name, "--memory") == 0) {
+            options->memoryMiB = (size_t) value;
+        } else if (strcmp(name, "--rooms") == 0) {
+            options->roomCount = (size_t) value;
+        } else if (strcmp(name, "--workers") == 0 && value <= NL_WORKER_POOL_MAX_WORKERS) {
+            options->workerCount = (size_t) value;
+        } else if (strcmp(name, "--io-batch") == 0 && value <= NL_UDP_BATCH_MAX_COUNT) {
+            options->datagramBatchCount = (size_t) value;
+        } else if (strcmp(name, "--idle-timeout-ms") == 0) {
+            options->idleTimeoutMs = (size_t) value;
+        } else if (strcmp(name, "--impairment-seed") == 0) {
+            options->impairmentSeed = (uint32_t) value;
+        } else {
+            return -3;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    g_clog.log = clog_console;
+    g_clog.level = CLOG_TYPE_INFO;
+
+    NlServerOptions options;
+    if (parseOptions(&options, argc, argv) < 0) {
+        printUsage();
+        return -1;
+    }
+
+    NlSimulationVm versionVm;
+    Clog versionLog;
+    versionLog.constantPrefix = "NimbleBallVersion";
+    versionLog.config = &g_clog;
+    nlSimulationVmInit(&versionVm, versionLog);
+
+    NimbleSerializeVersion applicationVersion = {
+        versionVm.transmuteVm.version.major,
+        versionVm.transmuteVm.version.minor,
+        versionVm.transmuteVm.version.patch,
+    };
+
+    NlRoomServerSetup roomServerSetup;
+    roomServerSetup.applicationVersion = applicationVersion;
+    roomServerSetup.roomCount = options.roomCount;
+    roomServerSetup.workerCount = options.workerCount;
+    roomServerSetup.maxConnectionCountForEachRoom = options.maxConnectionCount;
+    roomServerSetup.maxParticipantCountForEachRoom = options.maxParticipantCount;
+    roomServerSetup.roomMemoryOctetCount = options.memoryMiB * 1024 * 1024;
+    roomServerSetup.datagramBatchCount = options.datagramBatchCount;
+    roomServerSetup.impairmentProfile = 0;
+    roomServerSetup.impairmentSeed = options.impairmentSeed;
+    roomServerSetup.connectionIdleTimeoutMs = options.idleTimeoutMs;
+
+    static NlImpairmentProfile impairmentProfile;
+    if (options.impairmentFilename != 0) {
+        if (nlImpairmentProfileLoad(&impairmentProfile, options.impairmentFilename) < 0) {
+            return -3;
+        }
+        roomServerSetup.impairmentProfile = &impairmentProfile;
+    }
+
+    static NlRoomServer roomServer;
+    if (nlRoomServerInit(&roomServer, "", options.port, &roomServerSetup) < 0) {
+        return -2;
+    }
+
+    CLOG_INFO("nimble ball server listening on port %d. rooms:%zu workers:%zu connections:%zu participants:%zu tick "
+              "rate:%zu",
+              options.port, options.roomCount, options.workerCount, options.maxConnectionCount,
+              options.maxParticipantCount, options.tickRate)
+
+    static NlServerMetrics serverMetrics;
+    bool useMetrics = options.metricsSocketPath != 0 &&
+                      serverMetricsInit(&serverMetrics, options.metricsSocketPath) >= 0;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    NlTickScheduler tickScheduler;
+    nlTickSchedulerInit(&tickScheduler, 1000000U / options.tickRate, nlClockNowMicros());
+
+    while (!g_wantsToQuit) {
+        nlTickSchedulerWaitForNextTick(&tickScheduler);
+        // The nimble server steps on wall clock time, so a late tick is only run once
+        if (nlTickSchedulerTicksDue(&tickScheduler, nlClockNowMicros()) == 0U) {
+            continue;
+        }
+
+        nlRoomServerUpdate(&roomServer, monotonicTimeMsNow());
+        if (useMetrics) {
+            serverMetricsUpdate(&serverMetrics, &roomServer);
+        }
+    }
+
+    CLOG_INFO("nimble ball server shutting down")
+    if (useMetrics) {
+        nlMetricsEndpointDestroy(&serverMetrics.endpoint);
+    }
+    nlRoomServerDestroy(&roomServer);
+
+    return 0;
+}